@@ -0,0 +1,221 @@
+//Window management scalability benchmark for the linux native code, runs against a synthetic desktop on Xvfb
+//built by native/linux/wmtree.cc (the alt1wmtree target). Measures rs handle enumeration, the latency from a
+//click to its click listener (record thread and hit test) and the window thread's create/destroy event throughput
+//
+//usage: node --experimental-strip-types bench/wmbench.ts [options]
+//	--windows n       filler clients (2000)
+//	--depth n         reparenting frames around every client (3)
+//	--shaped n        shaped windows stacked over the click point (100)
+//	--decoys n        rs class windows that are no rs client (200)
+//	--enumerations n  getRsHandles calls (50)
+//	--clicks n        clicks (50)
+//	--churn n         rs clients created and destroyed (500)
+//	--display :n      display for the Xvfb instance (:99)
+//	--size wxh        screen size (1920x1080)
+//	--build dir       build directory with addon.node and alt1wmtree (build/Release)
+//	--out file        write the json result to file instead of stdout
+import { spawn, ChildProcess } from "node:child_process";
+import * as fs from "node:fs";
+import * as path from "node:path";
+import * as readline from "node:readline";
+import { createRequire } from "node:module";
+import { fileURLToPath } from "node:url";
+
+type Options = {
+	windows: number,
+	depth: number,
+	shaped: number,
+	decoys: number,
+	enumerations: number,
+	clicks: number,
+	churn: number,
+	display: string,
+	size: string,
+	build: string,
+	out: string
+};
+
+const rootdir = path.resolve(path.dirname(fileURLToPath(import.meta.url)), "..");
+
+function parseOptions(args: string[]) {
+	let opts: Options = {
+		windows: 2000, depth: 3, shaped: 100, decoys: 200,
+		enumerations: 50, clicks: 50, churn: 500,
+		display: ":99", size: "1920x1080", build: "build/Release", out: ""
+	};
+	for (let i = 0; i < args.length; i += 2) {
+		let key = args[i].replace(/^--/, "");
+		if (!(key in opts) || i + 1 >= args.length) { throw new Error(`unknown option ${args[i]}`); }
+		let value = args[i + 1];
+		if (typeof opts[key] == "number") {
+			if (!/^\d+$/.test(value)) { throw new Error(`${args[i]} needs a number`); }
+			opts[key] = +value;
+		} else {
+			opts[key] = value;
+		}
+	}
+	return opts;
+}
+
+//CLOCK_MONOTONIC in ns, same clock as the timestamps of wmtree
+function now() {
+	return Number(process.hrtime.bigint());
+}
+
+function sleep(ms: number) {
+	return new Promise<void>(done => setTimeout(done, ms));
+}
+
+async function waitUntil(cond: () => boolean, timeout: number, what: string) {
+	let end = Date.now() + timeout;
+	while (!cond()) {
+		if (Date.now() > end) { throw new Error(`timed out waiting for ${what}`); }
+		await sleep(5);
+	}
+}
+
+function timeout<T>(prom: Promise<T>, ms: number, what: string) {
+	return Promise.race([prom, sleep(ms).then(() => { throw new Error(`timed out waiting for ${what}`); })]);
+}
+
+//sample distribution in ms
+function distribution(samples: number[]) {
+	let sorted = samples.slice().sort((a, b) => a - b);
+	let pick = (p: number) => sorted[Math.min(sorted.length - 1, Math.floor(p * sorted.length))];
+	let round = (v: number) => Math.round(v * 1000) / 1000;
+	return {
+		samples: sorted.length,
+		mean: round(sorted.reduce((a, b) => a + b, 0) / sorted.length),
+		min: round(sorted[0]),
+		p50: round(pick(0.5)),
+		p90: round(pick(0.9)),
+		p99: round(pick(0.99)),
+		max: round(sorted[sorted.length - 1])
+	};
+}
+
+async function startXvfb(opts: Options) {
+	let socket = `/tmp/.X11-unix/X${opts.display.replace(/^:/, "")}`;
+	if (fs.existsSync(socket)) { throw new Error(`display ${opts.display} is already in use`); }
+	let proc = spawn("Xvfb", [opts.display, "-screen", "0", `${opts.size}x24`, "-nolisten", "tcp"], { stdio: "ignore" });
+	let exited = false;
+	proc.on("exit", () => exited = true);
+	await waitUntil(() => exited || fs.existsSync(socket), 10000, "Xvfb");
+	if (exited) { throw new Error("Xvfb exited, is it installed?"); }
+	return proc;
+}
+
+//wmtree process, every command gets a single json line back
+class DesktopBuilder {
+	proc: ChildProcess;
+	lines: string[] = [];
+	waiting: ((line: string) => void) | null = null;
+
+	constructor(exe: string, opts: Options) {
+		this.proc = spawn(exe, ["--windows", "" + opts.windows, "--depth", "" + opts.depth, "--shaped", "" + opts.shaped, "--decoys", "" + opts.decoys], { stdio: ["pipe", "pipe", "inherit"] });
+		readline.createInterface({ input: this.proc.stdout! }).on("line", line => {
+			if (this.waiting) {
+				let cb = this.waiting;
+				this.waiting = null;
+				cb(line);
+			} else {
+				this.lines.push(line);
+			}
+		});
+	}
+
+	next(): Promise<any> {
+		let line = this.lines.shift();
+		if (line !== undefined) { return Promise.resolve(JSON.parse(line)); }
+		return timeout(new Promise<string>(done => this.waiting = done), 120000, "wmtree").then(line => JSON.parse(line));
+	}
+
+	send(command: string) {
+		this.proc.stdin!.write(command + "\n");
+		return this.next();
+	}
+}
+
+async function run(opts: Options) {
+	let builddir = path.resolve(rootdir, opts.build);
+	let xvfb = await startXvfb(opts);
+	try {
+		//the addon starts connecting as soon as it is loaded
+		process.env.DISPLAY = opts.display;
+		let builder = new DesktopBuilder(path.resolve(builddir, "alt1wmtree"), opts);
+		let desktop = await builder.next();
+		let native = createRequire(import.meta.url)(path.resolve(builddir, "addon.node"));
+		let target = BigInt(desktop.target);
+
+		//handle enumeration walks the whole tree and checks the class of every window
+		let handles: BigInt[] = [];
+		let enumeration: number[] = [];
+		for (let i = 0; i < opts.enumerations; i++) {
+			let t = now();
+			handles = native.getRsHandles();
+			enumeration.push((now() - t) / 1e6);
+		}
+		if (handles.length != 1 || handles[0] != target) { throw new Error("getRsHandles didn't find exactly the target window"); }
+
+		//click latency, from the fake input request to the js listener of the window that the hit test found
+		let onclick: ((time: number) => void) | null = null;
+		let clicklistener = () => { if (onclick) { onclick(now()); } };
+		native.newWindowListener(target, "click", clicklistener);
+		//the record thread needs a moment to enable its context
+		await sleep(500);
+		let clicks: number[] = [];
+		for (let i = 0; i < opts.clicks; i++) {
+			let received = new Promise<number>(done => onclick = done);
+			let sent = await builder.send("click");
+			let time = await timeout(received, 5000, "click listener");
+			clicks.push((time - sent.clicked) / 1e6);
+			await sleep(20);
+		}
+
+		//window thread throughput, every framed rs client is a show event and gets a close listener for its destroy event
+		let shown = 0, lastshow = 0, closed = 0, lastclose = 0;
+		let closelistener = () => { closed++; lastclose = now(); };
+		let showlistener = (wnd: BigInt) => {
+			shown++;
+			lastshow = now();
+			native.newWindowListener(wnd, "close", closelistener);
+		};
+		native.newWindowListener(BigInt(0), "show", showlistener);
+		let churn = await builder.send(`churn ${opts.churn}`);
+		await waitUntil(() => shown >= opts.churn, 60000, "show events");
+		let clear = await builder.send("clear");
+		await waitUntil(() => closed >= shown, 60000, "close events");
+
+		builder.send("quit").catch(() => { });
+		return {
+			config: { windows: opts.windows, depth: opts.depth, shaped: opts.shaped, decoys: opts.decoys, size: opts.size, totalWindows: desktop.windows },
+			enumeration: distribution(enumeration),
+			clickLatency: distribution(clicks),
+			churn: {
+				windows: opts.churn,
+				//from the first create request to the last show event
+				createMs: Math.round((lastshow - churn.start) / 1e3) / 1e3,
+				createPerSecond: Math.round(opts.churn / ((lastshow - churn.start) / 1e9)),
+				destroyMs: Math.round((lastclose - clear.start) / 1e3) / 1e3,
+				destroyPerSecond: Math.round(closed / ((lastclose - clear.start) / 1e9))
+			}
+		};
+	} finally {
+		xvfb.kill();
+	}
+}
+
+let opts = parseOptions(process.argv.slice(2));
+run(opts).then(res => {
+	let json = JSON.stringify(res, undefined, "\t");
+	if (opts.out) {
+		fs.writeFileSync(opts.out, json);
+	} else {
+		console.log(json);
+	}
+	//the native event threads stop when the environment is torn down
+	process.exit(0);
+}, err => {
+	console.error(err);
+	process.exit(1);
+});
@@ -1,13 +1,23 @@
 {
 	"variables": {
-		"pkg-config": "pkg-config"
+		"pkg-config": "pkg-config",
+		# 1 builds alt1wmtree for bench/wmbench.ts, which needs xcb-xtest
+		"wmbench%": 0
 	},
 	"targets": [
 		{
 			"target_name": "addon",
 			"sources": [
 				"./native/lib.cc",
-				"./native/util.cc"
+				"./native/util.cc",
+				"./native/ocr.cc",
+				"./native/watch.cc",
+				"./native/capturescheduler.cc",
+				"./native/frame.cc",
+				"./native/pipeline.cc",
+				"./native/templates.cc",
+				"./native/derived.cc",
+				"./native/ncc.cc"
 			],
 			"include_dirs": [
 				"<!@(node -p \"require('node-addon-api').include\")"
@@ -55,7 +65,10 @@
 					"sources": [
 						"./native/os_x11_linux.cc",
 						"./native/linux/x11.cc",
-						"./native/linux/shm.cc"
+						"./native/linux/shm.cc",
+						"./native/linux/overlay.cc",
+						"./native/linux/frametimer.cc",
+						"./native/linux/glcapture.cc"
 					],
 					'cflags': [
 						'<!@(<(pkg-config) --cflags xcb)',
@@ -64,6 +77,7 @@
 						'<!@(<(pkg-config) --cflags xcb-composite)',
 						'<!@(<(pkg-config) --cflags xcb-record)',
 						'<!@(<(pkg-config) --cflags xcb-shape)',
+						'<!@(<(pkg-config) --cflags xcb-damage)',
 						'<!@(<(pkg-config) --cflags libprocps)'
 					],
 					'ldflags': [
@@ -73,6 +87,7 @@
 						'<!@(<(pkg-config) --libs-only-L --libs-only-other xcb-composite)',
 						'<!@(<(pkg-config) --libs-only-L --libs-only-other xcb-record)',
 						'<!@(<(pkg-config) --libs-only-L --libs-only-other xcb-shape)',
+						'<!@(<(pkg-config) --libs-only-L --libs-only-other xcb-damage)',
 						'<!@(<(pkg-config) --libs-only-L --libs-only-other libprocps)'
 					],
 					'libraries': [
@@ -82,7 +97,9 @@
 						'<!@(<(pkg-config) --libs-only-l xcb-composite)',
 						'<!@(<(pkg-config) --libs-only-l xcb-record)',
 						'<!@(<(pkg-config) --libs-only-l xcb-shape)',
-						'<!@(<(pkg-config) --libs-only-l libprocps)'
+						'<!@(<(pkg-config) --libs-only-l xcb-damage)',
+						'<!@(<(pkg-config) --libs-only-l libprocps)',
+						'-lrt'
 					],
 					"cflags_cc": [ "-std=c++17" ],
 				}],
@@ -96,5 +113,41 @@
 				}],
 			]
 		}
+	],
+	"conditions": [
+		['OS=="linux"', {
+			"targets": [
+				{
+					# preloaded into the game client for the OpenGL capture mode, see native/linux/glhook.cc
+					"target_name": "alt1glhook",
+					"type": "shared_library",
+					"product_prefix": "",
+					"sources": [
+						"./native/linux/glhook.cc"
+					],
+					"cflags_cc": [ "-std=c++17" ],
+					"libraries": [ "-ldl", "-lGL", "-lrt" ]
+				}
+			]
+		}],
+		['OS=="linux" and wmbench==1', {
+			"targets": [
+				{
+					# builds the synthetic desktop for bench/wmbench.ts, not shipped
+					"target_name": "alt1wmtree",
+					"type": "executable",
+					"sources": [
+						"./native/linux/wmtree.cc"
+					],
+					"cflags_cc": [
+						"-std=c++17",
+						'<!@(<(pkg-config) --cflags xcb xcb-shape xcb-xtest)'
+					],
+					"libraries": [
+						'<!@(<(pkg-config) --libs xcb xcb-shape xcb-xtest)'
+					]
+				}
+			]
+		}]
 	]
 }
@@ -0,0 +1,116 @@
+#include <algorithm>
+#include "capturescheduler.h"
+
+CaptureScheduler::CaptureScheduler(Napi::Env env) : env(env) {
+	this->completions = Napi::ThreadSafeFunction::New(env, Napi::Function::New(env, [](const Napi::CallbackInfo&) {}), "capture", 0, 1);
+	this->completions.Unref(env);
+	this->thread = std::thread(&CaptureScheduler::run, this);
+}
+
+// runs on the js thread, either from the environment cleanup or when the instance data is freed
+CaptureScheduler::~CaptureScheduler() {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	this->wakeup.notify_all();
+	this->thread.join();
+	for (Finished* finished : this->undelivered) {
+		std::unique_ptr<Finished> owned(finished);
+		try {
+			owned->done(this->env, owned->error);
+		} catch (...) {
+			// js can't run anymore, the promise goes away with the environment
+		}
+	}
+	this->undelivered.clear();
+	this->completions.Release();
+}
+
+void CaptureScheduler::submit(Request&& req) {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		// nothing to wait for when this is the only request for its target, the next ones join the queue while
+		// this one is being captured
+		bool alone = std::none_of(this->pending.begin(), this->pending.end(), [&req](const Request& other) { return other.wnd == req.wnd && other.mode == req.mode; });
+		if (alone) {
+			req.deadline = clock::now();
+		}
+		this->pending.push_back(std::move(req));
+	}
+	this->wakeup.notify_all();
+}
+
+void CaptureScheduler::run() {
+	std::unique_lock<std::mutex> lock(this->mutex);
+	while (true) {
+		if (this->stopping) {
+			break;
+		}
+		if (this->pending.empty()) {
+			this->wakeup.wait(lock);
+			continue;
+		}
+		// sleep until the earliest deadline, a new request might move it forward
+		auto due = std::min_element(this->pending.begin(), this->pending.end(), [](const Request& a, const Request& b) { return a.deadline < b.deadline; });
+		if (due->deadline > clock::now()) {
+			this->wakeup.wait_until(lock, due->deadline);
+			continue;
+		}
+
+		// everything pending for the same target shares the snapshot, even if it could have waited longer
+		std::vector<Request> batch;
+		OSWindow wnd = due->wnd;
+		CaptureMode mode = due->mode;
+		for (auto it = this->pending.begin(); it != this->pending.end();) {
+			if (it->wnd == wnd && it->mode == mode) {
+				batch.push_back(std::move(*it));
+				it = this->pending.erase(it);
+			} else {
+				it++;
+			}
+		}
+		lock.unlock();
+		capture(batch);
+		lock.lock();
+	}
+
+	// fail whatever was still waiting so no promise is left hanging
+	std::list<Request> left = std::move(this->pending);
+	this->pending.clear();
+	lock.unlock();
+	for (Request& req : left) {
+		finish(req, "capture scheduler stopped");
+	}
+}
+
+void CaptureScheduler::finish(Request& req, const std::string& error) {
+	auto finished = new Finished{ std::move(req.done), error };
+	napi_status status = this->completions.BlockingCall(finished, [](Napi::Env env, Napi::Function, Finished* f) {
+		std::unique_ptr<Finished> owned(f);
+		owned->done(env, owned->error);
+	});
+	if (status != napi_ok) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->undelivered.push_back(finished);
+	}
+}
+
+void CaptureScheduler::capture(std::vector<Request>& batch) {
+	std::stable_sort(batch.begin(), batch.end(), [](const Request& a, const Request& b) { return a.priority > b.priority; });
+	std::vector<CaptureRect> rects;
+	for (const Request& req : batch) {
+		rects.insert(rects.end(), req.rects.begin(), req.rects.end());
+	}
+	std::string error;
+	try {
+		OSCaptureMulti(batch[0].wnd, batch[0].mode, rects, this->env);
+	} catch (const std::exception& e) {
+		error = e.what();
+	} catch (...) {
+		error = "capture failed";
+	}
+	for (Request& req : batch) {
+		finish(req, error);
+	}
+}
@@ -0,0 +1,61 @@
+/**
+ * Coalesces capture requests that arrive close together. Requests for the same window and capture mode that are
+ * pending at the same time are served by a single OSCaptureMulti call, so they all come from one snapshot. A request
+ * without others for its target is captured right away, only requests that queue up behind it wait for their deadline
+ */
+
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <list>
+#include "os.h"
+
+class CaptureScheduler {
+public:
+	typedef std::chrono::steady_clock clock;
+	// called on the js thread, error is empty on success
+	typedef std::function<void(Napi::Env env, const std::string& error)> Completion;
+
+	struct Request {
+		OSWindow wnd;
+		CaptureMode mode;
+		// target buffers must stay valid until the completion is called
+		std::vector<CaptureRect> rects;
+		// requests in the same batch complete in order of priority, highest first
+		int priority = 0;
+		// the batch containing this request is captured no later than this, ignored when it is the only pending
+		// request for its target
+		clock::time_point deadline;
+		Completion done;
+	};
+
+	CaptureScheduler(Napi::Env env);
+	~CaptureScheduler();
+	void submit(Request&& req);
+
+private:
+	struct Finished {
+		Completion done;
+		std::string error;
+	};
+
+	void run();
+	void capture(std::vector<Request>& batch);
+	void finish(Request& req, const std::string& error);
+
+	// passed on to OSCaptureMulti, which doesn't touch js
+	Napi::Env env;
+	// delivers all completions, one for the lifetime of the scheduler. Unreferenced so the scheduler thread doesn't
+	// keep the process alive
+	Napi::ThreadSafeFunction completions;
+	// completions that couldn't be queued because the environment is shutting down, settled by the destructor
+	std::vector<Finished*> undelivered;
+	std::list<Request> pending;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wakeup;
+	bool stopping = false;
+};
@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cstdlib>
+#include "derived.h"
+
+// The kernels are plain loops over contiguous rows without branches in the inner loop, which gcc, clang and msvc
+// vectorize on their own at -O2/-O3
+
+static void ComputeLuminance(const FrameData& frame, JSRectangle region, uint16_t* out) {
+	for (int y = 0; y < region.height; y++) {
+		const uint8_t* src = frame.Pixel(region.x, region.y + y);
+		uint16_t* dst = out + (size_t)y * region.width;
+		for (int x = 0; x < region.width; x++) {
+			dst[x] = PixelLuminance(src + x * 4);
+		}
+	}
+}
+
+static void ComputeLuminanceSquared(const FrameData& frame, JSRectangle region, uint16_t* out) {
+	for (int y = 0; y < region.height; y++) {
+		const uint8_t* src = frame.Pixel(region.x, region.y + y);
+		uint16_t* dst = out + (size_t)y * region.width;
+		for (int x = 0; x < region.width; x++) {
+			uint16_t lum = PixelLuminance(src + x * 4);
+			dst[x] = lum * lum;
+		}
+	}
+}
+
+static inline uint16_t PixelDifference(const uint8_t* a, const uint8_t* b) {
+	return (uint16_t)(std::abs(a[0] - b[0]) + std::abs(a[1] - b[1]) + std::abs(a[2] - b[2]));
+}
+
+static void ComputeEdgeX(const FrameData& frame, JSRectangle region, uint16_t* out) {
+	// the right neighbour of the last region column can still be inside the frame
+	int inner = std::min(region.width, frame.width - 1 - region.x);
+	for (int y = 0; y < region.height; y++) {
+		const uint8_t* src = frame.Pixel(region.x, region.y + y);
+		uint16_t* dst = out + (size_t)y * region.width;
+		for (int x = 0; x < inner; x++) {
+			dst[x] = PixelDifference(src + x * 4, src + x * 4 + 4);
+		}
+		for (int x = std::max(0, inner); x < region.width; x++) {
+			dst[x] = 0;
+		}
+	}
+}
+
+static void ComputeEdgeY(const FrameData& frame, JSRectangle region, uint16_t* out) {
+	for (int y = 0; y < region.height; y++) {
+		uint16_t* dst = out + (size_t)y * region.width;
+		if (region.y + y + 1 >= frame.height) {
+			std::fill(dst, dst + region.width, 0);
+			continue;
+		}
+		const uint8_t* src = frame.Pixel(region.x, region.y + y);
+		const uint8_t* below = frame.Pixel(region.x, region.y + y + 1);
+		for (int x = 0; x < region.width; x++) {
+			dst[x] = PixelDifference(src + x * 4, below + x * 4);
+		}
+	}
+}
+
+uint64_t DerivedPlane::Sum(JSRectangle rect) const {
+	size_t stride = (size_t)this->region.width + 1;
+	int x1 = rect.x - this->region.x;
+	int y1 = rect.y - this->region.y;
+	int x2 = x1 + rect.width;
+	int y2 = y1 + rect.height;
+	return this->sums[y2 * stride + x2] - this->sums[y1 * stride + x2] - this->sums[y2 * stride + x1] + this->sums[y1 * stride + x1];
+}
+
+DerivedCache& DerivedCache::Global() {
+	static DerivedCache cache;
+	return cache;
+}
+
+std::shared_ptr<const DerivedPlane> DerivedCache::Find(uint64_t frame, DerivedKind kind, bool integral, JSRectangle region) {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	for (auto it = this->entries.begin(); it != this->entries.end(); it++) {
+		const JSRectangle& r = it->region;
+		if (it->frame == frame && it->kind == kind && it->integral == integral && r.x == region.x && r.y == region.y && r.width == region.width && r.height == region.height) {
+			this->entries.splice(this->entries.begin(), this->entries, it);
+			return it->plane;
+		}
+	}
+	return nullptr;
+}
+
+void DerivedCache::Insert(Entry entry) {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->used += entry.plane->Bytes();
+	this->entries.push_front(std::move(entry));
+	// consumers still holding an evicted plane keep it alive, it just won't be found again
+	while (this->used > this->budget && this->entries.size() > 1) {
+		this->used -= this->entries.back().plane->Bytes();
+		this->entries.pop_back();
+	}
+}
+
+std::shared_ptr<const DerivedPlane> DerivedCache::Plane(const FrameData& frame, DerivedKind kind, JSRectangle region) {
+	if (auto found = Find(frame.id, kind, false, region)) {
+		return found;
+	}
+	auto plane = std::make_shared<DerivedPlane>();
+	plane->region = region;
+	plane->values.resize((size_t)region.width * region.height);
+	switch (kind) {
+	case DerivedKind::Luminance: ComputeLuminance(frame, region, plane->values.data()); break;
+	case DerivedKind::LuminanceSquared: ComputeLuminanceSquared(frame, region, plane->values.data()); break;
+	case DerivedKind::EdgeX: ComputeEdgeX(frame, region, plane->values.data()); break;
+	case DerivedKind::EdgeY: ComputeEdgeY(frame, region, plane->values.data()); break;
+	}
+	Insert({ frame.id, kind, false, region, plane });
+	return plane;
+}
+
+std::shared_ptr<const DerivedPlane> DerivedCache::Integral(const FrameData& frame, DerivedKind kind, JSRectangle region) {
+	if (auto found = Find(frame.id, kind, true, region)) {
+		return found;
+	}
+	auto values = Plane(frame, kind, region);
+	auto integral = std::make_shared<DerivedPlane>();
+	integral->region = region;
+	size_t stride = (size_t)region.width + 1;
+	integral->sums.assign(stride * (region.height + 1), 0);
+	for (int y = 0; y < region.height; y++) {
+		const uint16_t* src = values->values.data() + (size_t)y * region.width;
+		const uint64_t* above = integral->sums.data() + y * stride;
+		uint64_t* dst = integral->sums.data() + (y + 1) * stride;
+		uint64_t rowsum = 0;
+		for (int x = 0; x < region.width; x++) {
+			rowsum += src[x];
+			dst[x + 1] = above[x + 1] + rowsum;
+		}
+	}
+	Insert({ frame.id, kind, true, region, integral });
+	return integral;
+}
+
+void DerivedCache::DropFrame(uint64_t frameId) {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	for (auto it = this->entries.begin(); it != this->entries.end();) {
+		if (it->frame == frameId) {
+			this->used -= it->plane->Bytes();
+			it = this->entries.erase(it);
+		} else {
+			it++;
+		}
+	}
+}
+
+void DerivedCache::SetBudget(size_t bytes) {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->budget = bytes;
+	while (this->used > this->budget && !this->entries.empty()) {
+		this->used -= this->entries.back().plane->Bytes();
+		this->entries.pop_back();
+	}
+}
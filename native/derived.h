@@ -0,0 +1,67 @@
+/**
+ * Cache of data derived from frames: luminance, edge strength and integral images of both. Several consumers
+ * tend to analyse the same frame, so every plane is computed lazily on first use and kept until its frame is
+ * released. All frames share one memory budget, the least recently used planes are dropped first when it runs out
+ */
+
+#pragma once
+#include <list>
+#include <mutex>
+#include "frame.h"
+
+enum class DerivedKind {
+	Luminance,
+	// luminance squared, its integral gives window variances
+	LuminanceSquared,
+	// sum of the absolute rgb differences with the next pixel to the right, 0 in the last column
+	EdgeX,
+	// same with the pixel below, 0 in the last row
+	EdgeY
+};
+
+inline uint8_t PixelLuminance(const uint8_t* px) {
+	// integer bt.601 weights
+	return (uint8_t)((px[0] * 77 + px[1] * 150 + px[2] * 29) >> 8);
+}
+
+// Values of one derived plane over region, or its integral image when built with integral set
+struct DerivedPlane {
+	JSRectangle region;
+	// width*height values, row major
+	std::vector<uint16_t> values;
+	// (width+1)*(height+1) sums of all values above and to the left, first row and column are 0
+	std::vector<uint64_t> sums;
+	size_t Bytes() const { return values.size() * sizeof(uint16_t) + sums.size() * sizeof(uint64_t); }
+	// sum of the values in rect, which has to be inside region
+	uint64_t Sum(JSRectangle rect) const;
+};
+
+class DerivedCache {
+public:
+	static DerivedCache& Global();
+
+	// The plane of frame over region, computed on first use. region has to be inside the frame
+	std::shared_ptr<const DerivedPlane> Plane(const FrameData& frame, DerivedKind kind, JSRectangle region);
+	// The integral image of a plane, computed on first use
+	std::shared_ptr<const DerivedPlane> Integral(const FrameData& frame, DerivedKind kind, JSRectangle region);
+	// Drops everything derived from a frame, called when the frame is destroyed
+	void DropFrame(uint64_t frameId);
+	void SetBudget(size_t bytes);
+
+private:
+	struct Entry {
+		uint64_t frame;
+		DerivedKind kind;
+		bool integral;
+		JSRectangle region;
+		std::shared_ptr<const DerivedPlane> plane;
+	};
+	std::shared_ptr<const DerivedPlane> Find(uint64_t frame, DerivedKind kind, bool integral, JSRectangle region);
+	void Insert(Entry entry);
+
+	std::mutex mutex;
+	// most recently used first
+	std::list<Entry> entries;
+	size_t used = 0;
+	size_t budget = 128 * 1024 * 1024;
+};
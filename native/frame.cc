@@ -0,0 +1,528 @@
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include "frame.h"
+#include "templates.h"
+#include "derived.h"
+#include "ncc.h"
+
+static std::atomic<uint64_t> nextFrameId{ 1 };
+
+FrameData::~FrameData() {
+	if (this->id != 0) {
+		DerivedCache::Global().DropFrame(this->id);
+	}
+}
+
+std::shared_ptr<FrameData> CaptureFrame(OSWindow wnd, CaptureMode mode, Napi::Env env) {
+	JSRectangle bounds = wnd.GetClientBounds();
+	if (bounds.width <= 0 || bounds.height <= 0) {
+		throw std::runtime_error("window has no client area");
+	}
+	auto frame = std::make_shared<FrameData>();
+	frame->id = nextFrameId++;
+	frame->width = bounds.width;
+	frame->height = bounds.height;
+	frame->pixels.resize((size_t)bounds.width * bounds.height * 4);
+	std::vector<CaptureRect> capts;
+	capts.emplace_back(frame->pixels.data(), frame->pixels.size(), JSRectangle(0, 0, bounds.width, bounds.height));
+	OSCaptureMulti(wnd, mode, capts, env);
+	return frame;
+}
+
+static inline int PixelDistance(const uint8_t* a, const uint8_t* b) {
+	return std::abs(a[0] - b[0]) + std::abs(a[1] - b[1]) + std::abs(a[2] - b[2]);
+}
+
+std::vector<SubImageMatch> FindSubImage(const FrameData& frame, JSRectangle rect, const uint8_t* needle, int width, int height, int tolerance, size_t maxresults) {
+	return FindSubImage(frame.pixels.data(), frame.width, frame.height, (size_t)frame.width * 4, rect, needle, width, height, tolerance, maxresults);
+}
+
+std::vector<SubImageMatch> FindSubImage(const uint8_t* pixels, int imgwidth, int imgheight, size_t stride, JSRectangle rect, const uint8_t* needle, int width, int height, int tolerance, size_t maxresults) {
+	std::vector<SubImageMatch> matches;
+	int x1 = std::max(0, rect.x);
+	int y1 = std::max(0, rect.y);
+	int x2 = std::min(imgwidth, rect.x + rect.width) - width;
+	int y2 = std::min(imgheight, rect.y + rect.height) - height;
+	auto pixel = [pixels, stride](int x, int y) { return pixels + (size_t)y * stride + (size_t)x * 4; };
+
+	// only the opaque needle pixels are compared, the first one rejects most positions on its own
+	std::vector<int> opaque;
+	for (int i = 0; i < width * height; i++) {
+		if (needle[i * 4 + 3] >= 128) { opaque.push_back(i); }
+	}
+	if (opaque.empty()) {
+		return matches;
+	}
+	int anchorx = opaque[0] % width;
+	int anchory = opaque[0] / width;
+	const uint8_t* anchor = needle + opaque[0] * 4;
+
+	for (int y = y1; y <= y2; y++) {
+		for (int x = x1; x <= x2; x++) {
+			if (PixelDistance(pixel(x + anchorx, y + anchory), anchor) > tolerance) {
+				continue;
+			}
+			bool match = true;
+			for (size_t i = 1; i < opaque.size(); i++) {
+				int nx = opaque[i] % width;
+				int ny = opaque[i] / width;
+				if (PixelDistance(pixel(x + nx, y + ny), needle + opaque[i] * 4) > tolerance) {
+					match = false;
+					break;
+				}
+			}
+			if (match) {
+				matches.push_back({ x, y });
+				if (matches.size() >= maxresults) {
+					return matches;
+				}
+			}
+		}
+	}
+	return matches;
+}
+
+namespace {
+	struct PreparedNeedle {
+		const SubImageNeedle* needle;
+		// byte offsets in the needle and in the image of all opaque pixels except the anchor, the needle offsets
+		// are precomputed for templates
+		const std::vector<int>* sharedOffsets = nullptr;
+		std::vector<int> ownOffsets;
+		std::vector<size_t> imageOffsets;
+		int anchorx;
+		int anchory;
+		const uint8_t* anchor;
+		uint32_t anchorColor;
+		// anchor positions that can start a match
+		int x1, y1, x2, y2;
+
+		const std::vector<int>& Offsets() const { return sharedOffsets ? *sharedOffsets : ownOffsets; }
+	};
+
+	inline uint32_t ColorKey(const uint8_t* px) { return px[0] | (px[1] << 8) | (px[2] << 16); }
+
+	bool PrepareNeedle(const SubImageNeedle& needle, int imgwidth, int imgheight, size_t stride, PreparedNeedle& out) {
+		int anchorIndex = (needle.anchor >= 0 ? needle.anchor : PickNeedleAnchor(needle.data, needle.width, needle.height));
+		if (anchorIndex == -1) {
+			return false;
+		}
+		out.needle = &needle;
+		out.anchorx = anchorIndex % needle.width;
+		out.anchory = anchorIndex / needle.width;
+		out.anchor = needle.data + anchorIndex * 4;
+		out.anchorColor = ColorKey(out.anchor);
+		if (needle.offsets && needle.anchor >= 0) {
+			out.sharedOffsets = needle.offsets;
+		} else {
+			out.ownOffsets = NeedleOffsets(needle.data, needle.width, needle.height, anchorIndex);
+		}
+		const std::vector<int>& offsets = out.Offsets();
+		out.imageOffsets.resize(offsets.size());
+		for (size_t i = 0; i < offsets.size(); i++) {
+			int index = offsets[i] / 4;
+			out.imageOffsets[i] = (size_t)(index / needle.width) * stride + (size_t)(index % needle.width) * 4;
+		}
+		out.x1 = std::max(0, needle.rect.x);
+		out.y1 = std::max(0, needle.rect.y);
+		out.x2 = std::min(imgwidth, needle.rect.x + needle.rect.width) - needle.width;
+		out.y2 = std::min(imgheight, needle.rect.y + needle.rect.height) - needle.height;
+		return out.x1 <= out.x2 && out.y1 <= out.y2;
+	}
+}
+
+int PickNeedleAnchor(const uint8_t* data, int width, int height) {
+	// the rarest color inside the needle is likely also rare in the image and rejects the most positions
+	std::unordered_map<uint32_t, int> counts;
+	int total = width * height;
+	for (int i = 0; i < total; i++) {
+		if (data[i * 4 + 3] >= 128) { counts[ColorKey(data + i * 4)]++; }
+	}
+	int anchor = -1;
+	for (int i = 0; i < total; i++) {
+		if (data[i * 4 + 3] < 128) { continue; }
+		if (anchor == -1 || counts[ColorKey(data + i * 4)] < counts[ColorKey(data + anchor * 4)]) {
+			anchor = i;
+		}
+	}
+	return anchor;
+}
+
+std::vector<int> NeedleOffsets(const uint8_t* data, int width, int height, int anchor) {
+	std::vector<int> offsets;
+	int total = width * height;
+	for (int i = 0; i < total; i++) {
+		if (i != anchor && data[i * 4 + 3] >= 128) { offsets.push_back(i * 4); }
+	}
+	return offsets;
+}
+
+std::vector<std::vector<SubImageMatch>> FindSubImages(const uint8_t* pixels, int imgwidth, int imgheight, size_t stride, const std::vector<SubImageNeedle>& needles) {
+	std::vector<std::vector<SubImageMatch>> results(needles.size());
+	std::vector<PreparedNeedle> prepared;
+	std::vector<size_t> preparedIndex;
+	int rowStart = imgheight;
+	int rowEnd = 0;
+	for (size_t i = 0; i < needles.size(); i++) {
+		PreparedNeedle p;
+		if (PrepareNeedle(needles[i], imgwidth, imgheight, stride, p)) {
+			rowStart = std::min(rowStart, p.y1 + p.anchory);
+			rowEnd = std::max(rowEnd, p.y2 + p.anchory + 1);
+			prepared.push_back(std::move(p));
+			preparedIndex.push_back(i);
+		}
+	}
+	if (prepared.empty()) {
+		return results;
+	}
+
+	// exact needles are looked up by anchor color, the others compared one by one
+	std::unordered_map<uint32_t, std::vector<size_t>> exactAnchors;
+	std::vector<size_t> tolerantNeedles;
+	for (size_t i = 0; i < prepared.size(); i++) {
+		if (prepared[i].needle->tolerance <= 0) {
+			exactAnchors[prepared[i].anchorColor].push_back(i);
+		} else {
+			tolerantNeedles.push_back(i);
+		}
+	}
+
+	// bands of anchor rows, a needle's matches within a band come out in row-major order
+	typedef std::vector<std::vector<SubImageMatch>> BandResult;
+	auto searchBand = [&](int bandStart, int bandEnd, BandResult& out) {
+		out.resize(prepared.size());
+		auto check = [&](size_t n, int ax, int ay) {
+			const PreparedNeedle& p = prepared[n];
+			int x = ax - p.anchorx;
+			int y = ay - p.anchory;
+			if (x < p.x1 || x > p.x2 || y < p.y1 || y > p.y2 || out[n].size() >= p.needle->maxresults) {
+				return;
+			}
+			const uint8_t* origin = pixels + (size_t)y * stride + (size_t)x * 4;
+			int tolerance = p.needle->tolerance;
+			const int* offsets = p.Offsets().data();
+			for (size_t i = 0; i < p.imageOffsets.size(); i++) {
+				if (PixelDistance(origin + p.imageOffsets[i], p.needle->data + offsets[i]) > tolerance) {
+					return;
+				}
+			}
+			out[n].push_back({ x, y });
+		};
+		for (int y = bandStart; y < bandEnd; y++) {
+			const uint8_t* row = pixels + (size_t)y * stride;
+			for (int x = 0; x < imgwidth; x++) {
+				const uint8_t* px = row + x * 4;
+				if (!exactAnchors.empty()) {
+					auto found = exactAnchors.find(ColorKey(px));
+					if (found != exactAnchors.end()) {
+						for (size_t n : found->second) { check(n, x, y); }
+					}
+				}
+				for (size_t n : tolerantNeedles) {
+					if (PixelDistance(px, prepared[n].anchor) <= prepared[n].needle->tolerance) { check(n, x, y); }
+				}
+			}
+		}
+	};
+
+	int rows = rowEnd - rowStart;
+	int bandCount = (int)std::max(1u, std::min(std::thread::hardware_concurrency(), (unsigned)(rows / 64)));
+	std::vector<BandResult> bands(bandCount);
+	if (bandCount == 1) {
+		searchBand(rowStart, rowEnd, bands[0]);
+	} else {
+		std::vector<std::thread> threads;
+		for (int b = 0; b < bandCount; b++) {
+			int start = rowStart + rows * b / bandCount;
+			int end = rowStart + rows * (b + 1) / bandCount;
+			threads.emplace_back([&, b, start, end]() { searchBand(start, end, bands[b]); });
+		}
+		for (auto& thread : threads) { thread.join(); }
+	}
+
+	for (size_t n = 0; n < prepared.size(); n++) {
+		std::vector<SubImageMatch>& matches = results[preparedIndex[n]];
+		for (BandResult& band : bands) {
+			for (const SubImageMatch& match : band[n]) {
+				if (matches.size() >= prepared[n].needle->maxresults) { break; }
+				matches.push_back(match);
+			}
+		}
+	}
+	return results;
+}
+
+std::vector<SubImageNeedle> SubImageNeedlesFromJsValue(Napi::Env env, const Napi::Value& val, int imgwidth, int imgheight) {
+	auto arr = val.As<Napi::Array>();
+	std::vector<SubImageNeedle> needles(arr.Length());
+	for (uint32_t i = 0; i < arr.Length(); i++) {
+		auto obj = arr.Get(i).As<Napi::Object>();
+		SubImageNeedle& needle = needles[i];
+		auto data = obj.Get("data").As<Napi::TypedArray>();
+		needle.width = obj.Get("width").As<Napi::Number>().Int32Value();
+		needle.height = obj.Get("height").As<Napi::Number>().Int32Value();
+		if (needle.width <= 0 || needle.height <= 0 || data.ByteLength() < (size_t)needle.width * needle.height * 4) {
+			throw Napi::TypeError::New(env, "image data does not match size");
+		}
+		needle.data = (const uint8_t*)data.ArrayBuffer().Data() + data.ByteOffset();
+		auto rect = obj.Get("rect");
+		needle.rect = (rect.IsNull() || rect.IsUndefined() ? JSRectangle(0, 0, imgwidth, imgheight) : JSRectangle::FromJsValue(rect));
+		auto tolerance = obj.Get("tolerance");
+		needle.tolerance = (tolerance.IsNumber() ? tolerance.As<Napi::Number>().Int32Value() : 0);
+		auto maxresults = obj.Get("maxresults");
+		needle.maxresults = (maxresults.IsNumber() ? std::max(1u, maxresults.As<Napi::Number>().Uint32Value()) : SIZE_MAX);
+	}
+	return needles;
+}
+
+Napi::Array SubImageMatchesToJs(Napi::Env env, const std::vector<SubImageMatch>& matches) {
+	auto ret = Napi::Array::New(env, matches.size());
+	for (uint32_t i = 0; i < matches.size(); i++) {
+		auto pos = Napi::Object::New(env);
+		pos.Set("x", matches[i].x);
+		pos.Set("y", matches[i].y);
+		ret.Set(i, pos);
+	}
+	return ret;
+}
+
+void NativeFrame::Init(Napi::Env env) {
+	auto cls = DefineClass(env, "NativeFrame", {
+		InstanceAccessor("width", &NativeFrame::GetWidth, nullptr),
+		InstanceAccessor("height", &NativeFrame::GetHeight, nullptr),
+		InstanceMethod("getRegion", &NativeFrame::GetRegion),
+		InstanceMethod("samplePixels", &NativeFrame::SamplePixels),
+		InstanceMethod("findSubImage", &NativeFrame::FindSubImage),
+		InstanceMethod("findSubImages", &NativeFrame::FindSubImages),
+		InstanceMethod("findTemplates", &NativeFrame::FindTemplates),
+		InstanceMethod("findSubImageNcc", &NativeFrame::FindSubImageNcc),
+		InstanceMethod("getDerived", &NativeFrame::GetDerived),
+		InstanceMethod("sumDerived", &NativeFrame::SumDerived),
+		InstanceMethod("release", &NativeFrame::Release)
+	});
+	env.GetInstanceData<PluginInstance>()->frameConstructor = Napi::Persistent(cls);
+}
+
+Napi::Object NativeFrame::New(Napi::Env env, std::shared_ptr<FrameData> data) {
+	auto obj = env.GetInstanceData<PluginInstance>()->frameConstructor.New({});
+	NativeFrame::Unwrap(obj)->data = std::move(data);
+	return obj;
+}
+
+NativeFrame::NativeFrame(const Napi::CallbackInfo& info) : Napi::ObjectWrap<NativeFrame>(info) {}
+
+const FrameData& NativeFrame::Data(Napi::Env env) {
+	if (!this->data) {
+		throw Napi::Error::New(env, "frame was released");
+	}
+	return *this->data;
+}
+
+Napi::Value NativeFrame::GetWidth(const Napi::CallbackInfo& info) {
+	return Napi::Number::New(info.Env(), this->data ? this->data->width : 0);
+}
+
+Napi::Value NativeFrame::GetHeight(const Napi::CallbackInfo& info) {
+	return Napi::Number::New(info.Env(), this->data ? this->data->height : 0);
+}
+
+Napi::Value NativeFrame::GetRegion(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	const FrameData& frame = Data(env);
+	auto rect = JSRectangle::FromJsValue(info[0]);
+	if (rect.x < 0 || rect.y < 0 || rect.width <= 0 || rect.height <= 0 || rect.x + rect.width > frame.width || rect.y + rect.height > frame.height) {
+		throw Napi::RangeError::New(env, "region outside of frame");
+	}
+	size_t stride = (size_t)rect.width * 4;
+	auto buffer = Napi::ArrayBuffer::New(env, stride * rect.height);
+	uint8_t* out = (uint8_t*)buffer.Data();
+	for (int y = 0; y < rect.height; y++) {
+		memcpy(out + y * stride, frame.Pixel(rect.x, rect.y + y), stride);
+	}
+	return Napi::Uint8Array::New(env, buffer.ByteLength(), buffer, 0, napi_uint8_clamped_array);
+}
+
+// same format and out of range convention as the samplePixels export, points outside the frame read as 0
+Napi::Value NativeFrame::SamplePixels(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	const FrameData& frame = Data(env);
+	auto points = info[0].As<Napi::Int32Array>();
+	size_t count = points.ElementLength() / 2;
+	auto ret = Napi::Uint32Array::New(env, count);
+	const int32_t* coords = points.Data();
+	uint32_t* out = ret.Data();
+	for (size_t i = 0; i < count; i++) {
+		int x = coords[i * 2];
+		int y = coords[i * 2 + 1];
+		if (x < 0 || y < 0 || x >= frame.width || y >= frame.height) {
+			out[i] = 0;
+		} else {
+			memcpy(&out[i], frame.Pixel(x, y), 4);
+		}
+	}
+	return ret;
+}
+
+Napi::Value NativeFrame::FindSubImage(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	const FrameData& frame = Data(env);
+	auto data = info[0].As<Napi::TypedArray>();
+	int width = info[1].As<Napi::Number>().Int32Value();
+	int height = info[2].As<Napi::Number>().Int32Value();
+	if (width <= 0 || height <= 0 || data.ByteLength() < (size_t)width * height * 4) {
+		throw Napi::TypeError::New(env, "image data does not match size");
+	}
+	JSRectangle rect(0, 0, frame.width, frame.height);
+	if (!info[3].IsNull() && !info[3].IsUndefined()) {
+		rect = JSRectangle::FromJsValue(info[3]);
+	}
+	int tolerance = (info[4].IsNumber() ? info[4].As<Napi::Number>().Int32Value() : 0);
+	size_t maxresults = (info[5].IsNumber() ? std::max(1u, info[5].As<Napi::Number>().Uint32Value()) : SIZE_MAX);
+
+	auto needle = (const uint8_t*)data.ArrayBuffer().Data() + data.ByteOffset();
+	return SubImageMatchesToJs(env, ::FindSubImage(frame, rect, needle, width, height, tolerance, maxresults));
+}
+
+Napi::Value NativeFrame::FindSubImages(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	const FrameData& frame = Data(env);
+	auto needles = SubImageNeedlesFromJsValue(env, info[0], frame.width, frame.height);
+	auto results = ::FindSubImages(frame.pixels.data(), frame.width, frame.height, (size_t)frame.width * 4, needles);
+	auto ret = Napi::Array::New(env, results.size());
+	for (uint32_t i = 0; i < results.size(); i++) {
+		ret.Set(i, SubImageMatchesToJs(env, results[i]));
+	}
+	return ret;
+}
+
+Napi::Value NativeFrame::FindTemplates(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	const FrameData& frame = Data(env);
+	std::vector<std::shared_ptr<NeedleTemplate>> keep;
+	auto needles = TemplateSearchesFromJsValue(env, info[0], frame.width, frame.height, keep);
+	auto results = ::FindSubImages(frame.pixels.data(), frame.width, frame.height, (size_t)frame.width * 4, needles);
+	auto ret = Napi::Array::New(env, results.size());
+	for (uint32_t i = 0; i < results.size(); i++) {
+		ret.Set(i, SubImageMatchesToJs(env, results[i]));
+	}
+	return ret;
+}
+
+// correlation search that tolerates brightness differences and interface scaling, see ncc.h
+Napi::Value NativeFrame::FindSubImageNcc(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	const FrameData& frame = Data(env);
+	auto data = info[0].As<Napi::TypedArray>();
+	int width = info[1].As<Napi::Number>().Int32Value();
+	int height = info[2].As<Napi::Number>().Int32Value();
+	if (width <= 0 || height <= 0 || data.ByteLength() < (size_t)width * height * 4) {
+		throw Napi::TypeError::New(env, "image data does not match size");
+	}
+	NccOptions options;
+	options.rect = JSRectangle(0, 0, frame.width, frame.height);
+	if (info[3].IsObject()) {
+		auto opts = info[3].As<Napi::Object>();
+		auto rect = opts.Get("rect");
+		if (rect.IsObject()) { options.rect = JSRectangle::FromJsValue(rect); }
+		auto scales = opts.Get("scales");
+		if (scales.IsArray()) {
+			auto arr = scales.As<Napi::Array>();
+			options.scales.clear();
+			for (uint32_t i = 0; i < arr.Length(); i++) {
+				options.scales.push_back(arr.Get(i).As<Napi::Number>().FloatValue());
+			}
+		}
+		auto threshold = opts.Get("threshold");
+		if (threshold.IsNumber()) { options.threshold = threshold.As<Napi::Number>().FloatValue(); }
+		auto maxresults = opts.Get("maxresults");
+		if (maxresults.IsNumber()) { options.maxresults = std::max(1u, maxresults.As<Napi::Number>().Uint32Value()); }
+	}
+
+	auto needle = (const uint8_t*)data.ArrayBuffer().Data() + data.ByteOffset();
+	auto matches = ::FindSubImageNcc(frame, needle, width, height, options);
+	auto ret = Napi::Array::New(env, matches.size());
+	for (uint32_t i = 0; i < matches.size(); i++) {
+		auto match = Napi::Object::New(env);
+		match.Set("x", matches[i].x);
+		match.Set("y", matches[i].y);
+		match.Set("width", matches[i].width);
+		match.Set("height", matches[i].height);
+		match.Set("scale", matches[i].scale);
+		match.Set("score", matches[i].score);
+		ret.Set(i, match);
+	}
+	return ret;
+}
+
+static DerivedKind DerivedKindFromJsValue(const Napi::Value& val) {
+	static const std::map<std::string, DerivedKind> kinds = {
+		{ "luminance", DerivedKind::Luminance },
+		{ "edgex", DerivedKind::EdgeX },
+		{ "edgey", DerivedKind::EdgeY }
+	};
+	auto found = kinds.find(val.As<Napi::String>().Utf8Value());
+	if (found == kinds.end()) {
+		throw Napi::RangeError::New(val.Env(), "unknown derived plane");
+	}
+	return found->second;
+}
+
+static bool RectInside(const JSRectangle& rect, const JSRectangle& outer) {
+	return rect.width >= 0 && rect.height >= 0 && rect.x >= outer.x && rect.y >= outer.y && rect.x + rect.width <= outer.x + outer.width && rect.y + rect.height <= outer.y + outer.height;
+}
+
+// values of a derived plane in rect, planes are cached per frame and region (whole frame if not given)
+Napi::Value NativeFrame::GetDerived(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	const FrameData& frame = Data(env);
+	auto kind = DerivedKindFromJsValue(info[0]);
+	auto rect = JSRectangle::FromJsValue(info[1]);
+	JSRectangle region(0, 0, frame.width, frame.height);
+	if (info[2].IsObject()) { region = JSRectangle::FromJsValue(info[2]); }
+	if (!RectInside(region, JSRectangle(0, 0, frame.width, frame.height)) || !RectInside(rect, region)) {
+		throw Napi::RangeError::New(env, "region outside of frame");
+	}
+	auto plane = DerivedCache::Global().Plane(frame, kind, region);
+	auto ret = Napi::Uint16Array::New(env, (size_t)rect.width * rect.height);
+	for (int y = 0; y < rect.height; y++) {
+		const uint16_t* src = plane->values.data() + (size_t)(rect.y - region.y + y) * region.width + (rect.x - region.x);
+		memcpy(ret.Data() + (size_t)y * rect.width, src, rect.width * sizeof(uint16_t));
+	}
+	return ret;
+}
+
+// sums of a derived plane over many rects (x,y,w,h quads), each one a lookup in the cached integral image
+Napi::Value NativeFrame::SumDerived(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	const FrameData& frame = Data(env);
+	auto kind = DerivedKindFromJsValue(info[0]);
+	auto quads = info[1].As<Napi::Int32Array>();
+	JSRectangle region(0, 0, frame.width, frame.height);
+	if (info[2].IsObject()) { region = JSRectangle::FromJsValue(info[2]); }
+	if (!RectInside(region, JSRectangle(0, 0, frame.width, frame.height))) {
+		throw Napi::RangeError::New(env, "region outside of frame");
+	}
+	size_t count = quads.ElementLength() / 4;
+	const int32_t* q = quads.Data();
+	for (size_t i = 0; i < count; i++) {
+		if (!RectInside(JSRectangle(q[i * 4], q[i * 4 + 1], q[i * 4 + 2], q[i * 4 + 3]), region)) {
+			throw Napi::RangeError::New(env, "rect outside of region");
+		}
+	}
+	auto integral = DerivedCache::Global().Integral(frame, kind, region);
+	auto ret = Napi::Float64Array::New(env, count);
+	for (size_t i = 0; i < count; i++) {
+		ret.Data()[i] = (double)integral->Sum(JSRectangle(q[i * 4], q[i * 4 + 1], q[i * 4 + 2], q[i * 4 + 3]));
+	}
+	return ret;
+}
+
+// drops the pixels right away instead of waiting for gc
+void NativeFrame::Release(const Napi::CallbackInfo& info) {
+	this->data.reset();
+}
@@ -0,0 +1,96 @@
+/**
+ * A frame is a full capture of a window's client area that stays in native memory. Js holds a NativeFrame handle
+ * and pulls regions, pixels or search results out of it lazily, so all readers of one frame see the same snapshot
+ * and only the parts they actually use get copied into js
+ */
+
+#pragma once
+#include <memory>
+#include "os.h"
+
+struct FrameData {
+	// unique per capture, keys the derived data cache
+	uint64_t id = 0;
+	int width = 0;
+	int height = 0;
+	// rgba, same layout as a capture
+	std::vector<uint8_t> pixels;
+	const uint8_t* Pixel(int x, int y) const { return pixels.data() + ((size_t)y * width + x) * 4; }
+	FrameData() = default;
+	FrameData(const FrameData&) = delete;
+	~FrameData();
+};
+
+struct SubImageMatch {
+	int x;
+	int y;
+};
+
+// Captures the full client area of wnd into a new frame
+std::shared_ptr<FrameData> CaptureFrame(OSWindow wnd, CaptureMode mode, Napi::Env env);
+
+/**
+ * Finds the positions in rect of the frame where needle (rgba, width*height*4 bytes) occurs. Needle pixels with
+ * alpha below 128 match anything, other pixels match when the summed absolute rgb difference is at most tolerance
+ */
+std::vector<SubImageMatch> FindSubImage(const FrameData& frame, JSRectangle rect, const uint8_t* needle, int width, int height, int tolerance, size_t maxresults);
+// Same search in any rgba image whose rows are stride bytes apart
+std::vector<SubImageMatch> FindSubImage(const uint8_t* pixels, int imgwidth, int imgheight, size_t stride, JSRectangle rect, const uint8_t* needle, int width, int height, int tolerance, size_t maxresults);
+
+struct SubImageNeedle {
+	// rgba, width*height*4 bytes, has to stay alive during the search
+	const uint8_t* data = nullptr;
+	int width = 0;
+	int height = 0;
+	// area of the image to search in, positions are the top left of the needle
+	JSRectangle rect;
+	int tolerance = 0;
+	size_t maxresults = SIZE_MAX;
+	// pixel index of the anchor if already known, see PickNeedleAnchor
+	int anchor = -1;
+	// NeedleOffsets of the needle and anchor if already known
+	const std::vector<int>* offsets = nullptr;
+};
+
+// Index of the opaque needle pixel with the rarest color, -1 when the needle has no opaque pixels
+int PickNeedleAnchor(const uint8_t* data, int width, int height);
+
+// Byte offsets of the opaque needle pixels other than the anchor, the pixels a match compares after the anchor
+std::vector<int> NeedleOffsets(const uint8_t* data, int width, int height, int anchor);
+
+/**
+ * Searches all needles in one pass over the image, same matching rules and result order as FindSubImage. Each
+ * needle is anchored at its rarest opaque color, every image pixel is only compared against the anchors. Exact
+ * needles are found with a single lookup per pixel. The image is split in bands that are searched in parallel.
+ * Returns one list of matches per needle
+ */
+std::vector<std::vector<SubImageMatch>> FindSubImages(const uint8_t* pixels, int imgwidth, int imgheight, size_t stride, const std::vector<SubImageNeedle>& needles);
+
+// Parses an array of { data, width, height, rect?, tolerance?, maxresults? }, rects default to the whole image
+std::vector<SubImageNeedle> SubImageNeedlesFromJsValue(Napi::Env env, const Napi::Value& val, int imgwidth, int imgheight);
+Napi::Array SubImageMatchesToJs(Napi::Env env, const std::vector<SubImageMatch>& matches);
+
+class NativeFrame : public Napi::ObjectWrap<NativeFrame> {
+public:
+	// registers the js class, new frames are created with New
+	static void Init(Napi::Env env);
+	static Napi::Object New(Napi::Env env, std::shared_ptr<FrameData> data);
+	NativeFrame(const Napi::CallbackInfo& info);
+
+private:
+	Napi::Value GetWidth(const Napi::CallbackInfo& info);
+	Napi::Value GetHeight(const Napi::CallbackInfo& info);
+	Napi::Value GetRegion(const Napi::CallbackInfo& info);
+	Napi::Value SamplePixels(const Napi::CallbackInfo& info);
+	Napi::Value FindSubImage(const Napi::CallbackInfo& info);
+	Napi::Value FindSubImages(const Napi::CallbackInfo& info);
+	Napi::Value FindTemplates(const Napi::CallbackInfo& info);
+	Napi::Value FindSubImageNcc(const Napi::CallbackInfo& info);
+	Napi::Value GetDerived(const Napi::CallbackInfo& info);
+	Napi::Value SumDerived(const Napi::CallbackInfo& info);
+	void Release(const Napi::CallbackInfo& info);
+	const FrameData& Data(Napi::Env env);
+
+	// shared so a frame can also be handed to native consumers that outlive the js handle
+	std::shared_ptr<const FrameData> data;
+};
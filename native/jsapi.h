@@ -1,14 +1,15 @@
 #include <map>
+#include <algorithm>
 #include "os.h"
+#include "watch.h"
+#include "capturescheduler.h"
+#include "frame.h"
+#include "pipeline.h"
+#include "templates.h"
+#include "derived.h"
 #include "../libs/Alt1Native.h"
 
 
-const std::map<CaptureMode, std::string> captureModeText = {
-	{CaptureMode::Desktop,"desktop"},
-	{CaptureMode::Window,"window"},
-	{CaptureMode::OpenGL,"opengl"}
-};
-
 std::map<OSWindow, Alt1Native::HookedProcess*> hookedWindows;
 
 Napi::Value HookWindow(const Napi::CallbackInfo& info) {
@@ -23,29 +24,47 @@ Napi::Value HookWindow(const Napi::CallbackInfo& info) {
 #endif
 }
 
-Napi::Value CaptureWindowMulti(const Napi::CallbackInfo& info) {
-	auto env = info.Env();
-	auto wnd = OSWindow::FromJsValue(info[0]);
+// Run native code that reports errors with c++ exceptions and rethrow those as js errors
+template<typename F>
+auto WithJsErrors(Napi::Env env, F f) -> decltype(f()) {
+	try {
+		return f();
+	} catch (const Napi::Error&) {
+		throw;
+	} catch (const std::exception& e) {
+		throw Napi::Error::New(env, e.what());
+	}
+}
 
-	//convert the capture mode string
-	auto captmodetext = info[1].As<Napi::String>().Utf8Value();
-	bool modematched = false;
-	CaptureMode captmode = CaptureMode::Desktop;
-	for (auto mode : captureModeText) {
-		if (mode.second == captmodetext) {
-			modematched = true;
-			captmode = mode.first;
-			break;
-		}
+static void CheckCaptureSize(Napi::Env env, const JSRectangle& rect) {
+	if (rect.width <= 0 || rect.height <= 0 || rect.width > 1e4 || rect.height > 1e4) {
+		throw Napi::TypeError::New(env, "invalid capture size");
 	}
-	if (!modematched) {
-		throw Napi::RangeError::New(env, "unknown capture mode");
+}
+
+//convert the capture rect object to c++, allocates a js buffer for each rect and returns them with the same keys
+//rects can also be Int32Array quads, the captures are then stored back to back in that order in a single buffer
+Napi::Object CaptureTargetsFromJsValue(Napi::Env env, const Napi::Value& val, vector<CaptureRect>& capts) {
+	if (val.IsTypedArray()) {
+		auto rects = JSRectangle::FromQuads(val);
+		size_t total = 0;
+		for (auto& rect : rects) {
+			CheckCaptureSize(env, rect);
+			total += (size_t)rect.width * rect.height * 4;
+		}
+		auto buffer = Napi::ArrayBuffer::New(env, total);
+		uint8_t* data = (uint8_t*)buffer.Data();
+		capts.reserve(rects.size());
+		for (auto& rect : rects) {
+			size_t size = (size_t)rect.width * rect.height * 4;
+			capts.push_back(CaptureRect(data, size, rect));
+			data += size;
+		}
+		return Napi::Uint8Array::New(env, total, buffer, 0, napi_uint8_clamped_array);
 	}
 
-	//convert the capture rect object to c++
-	auto obj = info[2].As<Napi::Object>();
+	auto obj = val.As<Napi::Object>();
 	auto props = obj.GetPropertyNames();
-	vector<CaptureRect> capts;
 	auto ret = Napi::Object::New(env);
 	for (uint32_t a = 0; a < props.Length(); a++) {
 		auto key = props.Get(a);
@@ -53,10 +72,7 @@ Napi::Value CaptureWindowMulti(const Napi::CallbackInfo& info) {
 		auto val = obj.Get(key);
 		if (val.IsNull() || val.IsUndefined()) { continue; }
 		auto rect = JSRectangle::FromJsValue(val);
-		if (rect.width <= 0 || rect.height <= 0 || rect.width > 1e4 || rect.height > 1e4)
-		{
-			throw Napi::TypeError::New(env, "invalid capture size");
-		}
+		CheckCaptureSize(env, rect);
 
 		size_t size = (size_t)rect.width * rect.height * 4;
 		auto buffer = Napi::ArrayBuffer::New(env, size);
@@ -65,10 +81,192 @@ Napi::Value CaptureWindowMulti(const Napi::CallbackInfo& info) {
 		ret.Set(key, view);
 		capts.push_back(capt);
 	}
-	OSCaptureMulti(wnd, captmode, capts, env);
 	return ret;
 }
 
+Napi::Value CaptureWindowMulti(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto wnd = OSWindow::FromJsValue(info[0]);
+	auto captmode = CaptureModeFromJsValue(info[1]);
+	vector<CaptureRect> capts;
+	auto ret = CaptureTargetsFromJsValue(env, info[2], capts);
+	WithJsErrors(env, [&]() { OSCaptureMulti(wnd, captmode, capts, env); });
+	return ret;
+}
+
+//same as CaptureWindowMulti, but the capture is shared with other requests for the window that arrive within maxdelay ms
+Napi::Value CaptureScheduled(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	CaptureScheduler::Request req;
+	req.wnd = OSWindow::FromJsValue(info[0]);
+	req.mode = CaptureModeFromJsValue(info[1]);
+	auto ret = CaptureTargetsFromJsValue(env, info[2], req.rects);
+	req.priority = (info[3].IsNumber() ? info[3].As<Napi::Number>().Int32Value() : 0);
+	int maxdelay = (info[4].IsNumber() ? info[4].As<Napi::Number>().Int32Value() : 5);
+	req.deadline = CaptureScheduler::clock::now() + std::chrono::milliseconds(std::max(0, maxdelay));
+
+	struct Pending {
+		Napi::Promise::Deferred deferred;
+		//keeps the target buffers alive until the capture is done
+		Napi::ObjectReference result;
+	};
+	auto deferred = Napi::Promise::Deferred::New(env);
+	auto pending = std::make_shared<Pending>(Pending{ deferred, Napi::Persistent(ret) });
+	req.done = [pending](Napi::Env env, const std::string& error) {
+		if (error.empty()) {
+			pending->deferred.Resolve(pending->result.Value());
+		} else {
+			pending->deferred.Reject(Napi::Error::New(env, error).Value());
+		}
+	};
+
+	auto inst = env.GetInstanceData<PluginInstance>();
+	if (!inst->captureScheduler) {
+		inst->captureScheduler = std::make_shared<CaptureScheduler>(env);
+	}
+	inst->captureScheduler->submit(std::move(req));
+	return deferred.Promise();
+}
+
+//captures the whole client area into a NativeFrame handle, regions are only copied to js when asked for
+Napi::Value JSCaptureFrame(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto wnd = OSWindow::FromJsValue(info[0]);
+	auto captmode = CaptureModeFromJsValue(info[1]);
+	auto frame = WithJsErrors(env, [&]() { return CaptureFrame(wnd, captmode, env); });
+	return NativeFrame::New(env, frame);
+}
+
+//compiles chains of image operations that run on a capture in one call, see pipeline.h
+Napi::Value CompileImagePipeline(const Napi::CallbackInfo& info) {
+	return NativeImagePipeline::New(info.Env(), info[0]);
+}
+
+//searches many needles in raw rgba image data in one pass, returns the matches of each needle
+Napi::Value JSFindSubImages(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto data = info[0].As<Napi::TypedArray>();
+	int width = info[1].As<Napi::Number>().Int32Value();
+	int height = info[2].As<Napi::Number>().Int32Value();
+	if (width <= 0 || height <= 0 || data.ByteLength() < (size_t)width * height * 4) {
+		throw Napi::TypeError::New(env, "image data does not match size");
+	}
+	auto pixels = (const uint8_t*)data.ArrayBuffer().Data() + data.ByteOffset();
+	auto needles = SubImageNeedlesFromJsValue(env, info[3], width, height);
+	auto results = FindSubImages(pixels, width, height, (size_t)width * 4, needles);
+	auto ret = Napi::Array::New(env, results.size());
+	for (uint32_t i = 0; i < results.size(); i++) {
+		ret.Set(i, SubImageMatchesToJs(env, results[i]));
+	}
+	return ret;
+}
+
+//stores needle images natively, returns one handle per image for findTemplates
+Napi::Value RegisterTemplates(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto jsimages = info[0].As<Napi::Array>();
+	std::vector<const uint8_t*> images;
+	std::vector<int> widths, heights;
+	for (uint32_t i = 0; i < jsimages.Length(); i++) {
+		auto img = jsimages.Get(i).As<Napi::Object>();
+		auto data = img.Get("data").As<Napi::TypedArray>();
+		int width = img.Get("width").As<Napi::Number>().Int32Value();
+		int height = img.Get("height").As<Napi::Number>().Int32Value();
+		if (width <= 0 || height <= 0 || data.ByteLength() < (size_t)width * height * 4) {
+			throw Napi::TypeError::New(env, "image data does not match size");
+		}
+		images.push_back((const uint8_t*)data.ArrayBuffer().Data() + data.ByteOffset());
+		widths.push_back(width);
+		heights.push_back(height);
+	}
+	auto templates = CreateNeedleTemplates(images, widths, heights);
+	auto inst = env.GetInstanceData<PluginInstance>();
+	auto ret = Napi::Array::New(env, templates.size());
+	//handles of unregistered templates are reused
+	size_t slot = 0;
+	for (uint32_t i = 0; i < templates.size(); i++) {
+		while (slot < inst->templates.size() && inst->templates[slot]) { slot++; }
+		if (slot == inst->templates.size()) { inst->templates.emplace_back(); }
+		inst->templates[slot] = templates[i];
+		ret.Set(i, Napi::Number::New(env, (double)slot));
+	}
+	return ret;
+}
+
+//releases templates, their handles can be given out again by registerTemplates
+void UnregisterTemplates(const Napi::CallbackInfo& info) {
+	auto inst = info.Env().GetInstanceData<PluginInstance>();
+	auto handles = info[0].As<Napi::Array>();
+	for (uint32_t i = 0; i < handles.Length(); i++) {
+		uint32_t id = handles.Get(i).As<Napi::Number>().Uint32Value();
+		if (id < inst->templates.size()) { inst->templates[id].reset(); }
+	}
+	while (!inst->templates.empty() && !inst->templates.back()) { inst->templates.pop_back(); }
+}
+
+//same as findSubImages with registered templates as needles
+Napi::Value FindTemplates(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto data = info[0].As<Napi::TypedArray>();
+	int width = info[1].As<Napi::Number>().Int32Value();
+	int height = info[2].As<Napi::Number>().Int32Value();
+	if (width <= 0 || height <= 0 || data.ByteLength() < (size_t)width * height * 4) {
+		throw Napi::TypeError::New(env, "image data does not match size");
+	}
+	auto pixels = (const uint8_t*)data.ArrayBuffer().Data() + data.ByteOffset();
+	std::vector<std::shared_ptr<NeedleTemplate>> keep;
+	auto needles = TemplateSearchesFromJsValue(env, info[3], width, height, keep);
+	auto results = FindSubImages(pixels, width, height, (size_t)width * 4, needles);
+	auto ret = Napi::Array::New(env, results.size());
+	for (uint32_t i = 0; i < results.size(); i++) {
+		ret.Set(i, SubImageMatchesToJs(env, results[i]));
+	}
+	return ret;
+}
+
+//memory budget in bytes shared by the derived data of all frames
+void SetDerivedCacheBudget(const Napi::CallbackInfo& info) {
+	DerivedCache::Global().SetBudget((size_t)std::max(0.0, info[0].As<Napi::Number>().DoubleValue()));
+}
+
+Napi::Value SamplePixels(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto wnd = OSWindow::FromJsValue(info[0]);
+	auto captmode = CaptureModeFromJsValue(info[1]);
+	auto points = info[2].As<Napi::Int32Array>();
+	size_t count = points.ElementLength() / 2;
+	auto ret = Napi::Uint32Array::New(env, count);
+	if (count != 0) {
+		WithJsErrors(env, [&]() { OSSamplePixels(wnd, captmode, points.Data(), count, ret.Data(), env); });
+	}
+	return ret;
+}
+
+Napi::Value WatchRegions(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto wnd = OSWindow::FromJsValue(info[0]);
+	auto captmode = CaptureModeFromJsValue(info[1]);
+	auto arr = info[2].As<Napi::Array>();
+	std::vector<JSRectangle> rects;
+	for (uint32_t i = 0; i < arr.Length(); i++) {
+		auto rect = JSRectangle::FromJsValue(arr.Get(i));
+		CheckCaptureSize(env, rect);
+		rects.push_back(rect);
+	}
+	int interval = std::max(10, info[3].As<Napi::Number>().Int32Value());
+	auto callback = info[4].As<Napi::Function>();
+
+	auto inst = env.GetInstanceData<PluginInstance>();
+	uint32_t id = inst->nextRegionWatch++;
+	inst->regionWatches[id] = std::make_shared<RegionWatch>(wnd, captmode, rects, interval, callback);
+	return Napi::Number::New(env, id);
+}
+
+void UnwatchRegions(const Napi::CallbackInfo& info) {
+	auto inst = info.Env().GetInstanceData<PluginInstance>();
+	inst->regionWatches.erase(info[0].As<Napi::Number>().Uint32Value());
+}
+
 Napi::Value GetRsHandles(const Napi::CallbackInfo& info) {
 	auto handles = OSGetRsHandles();
 	auto ret = Napi::Array::New(info.Env(), handles.size());
@@ -80,8 +278,95 @@ Napi::Value JSGetActiveWindow(const Napi::CallbackInfo& info) { return OSGetActi
 Napi::Value GetWindowBounds(const Napi::CallbackInfo& info) { return OSWindow::FromJsValue(info[0]).GetBounds().ToJs(info.Env()); }
 Napi::Value GetClientBounds(const Napi::CallbackInfo& info) { return OSWindow::FromJsValue(info[0]).GetClientBounds().ToJs(info.Env()); }
 Napi::Value GetWindowTitle(const Napi::CallbackInfo& info) { return Napi::String::New(info.Env(), OSWindow::FromJsValue(info[0]).GetTitle()); }
+Napi::Value GetWindowVisibility(const Napi::CallbackInfo& info) {
+	auto wnd = OSWindow::FromJsValue(info[0]);
+	auto state = WithJsErrors(info.Env(), [&]() { return OSGetWindowVisibility(wnd); });
+	return Napi::String::New(info.Env(), WindowVisibilityText(state));
+}
 Napi::Value GetMouseState(const Napi::CallbackInfo& info) { return Napi::Boolean::New(info.Env(), OSGetMouseState()); }
 
+uint32_t WindowInfoFieldsFromJsValue(const Napi::Value& val) {
+	auto arr = val.As<Napi::Array>();
+	uint32_t fields = 0;
+	for (uint32_t i = 0; i < arr.Length(); i++) {
+		auto name = arr.Get(i).As<Napi::String>().Utf8Value();
+		auto field = windowInfoFields.find(name);
+		if (field == windowInfoFields.end()) {
+			throw Napi::RangeError::New(val.Env(), "unknown window info field " + name);
+		}
+		fields |= field->second;
+	}
+	return fields;
+}
+
+Napi::Array WindowInfoToJs(Napi::Env env, const std::vector<OSWindowInfo>& infos, uint32_t fields) {
+	auto ret = Napi::Array::New(env, infos.size());
+	for (uint32_t i = 0; i < infos.size(); i++) {
+		const OSWindowInfo& info = infos[i];
+		auto obj = Napi::Object::New(env);
+		obj.Set("valid", info.valid);
+		if (info.valid) {
+			if (fields & WindowInfoField::Title) { obj.Set("title", info.title); }
+			if (fields & WindowInfoField::Class) { obj.Set("class", info.className); }
+			if (fields & WindowInfoField::Bounds) { obj.Set("bounds", info.bounds.ToJs(env)); }
+			if (fields & WindowInfoField::ClientBounds) { obj.Set("clientBounds", info.clientBounds.ToJs(env)); }
+			if (fields & WindowInfoField::MapState) { obj.Set("mapped", info.mapped); }
+			if (fields & WindowInfoField::Pid) { obj.Set("pid", info.pid); }
+			if (fields & WindowInfoField::TransientFor) { obj.Set("transientFor", OSWindow(info.transientFor).ToJS(env)); }
+		}
+		ret.Set(i, obj);
+	}
+	return ret;
+}
+
+std::vector<OSWindow> WindowListFromJsValue(const Napi::Value& val) {
+	auto arr = val.As<Napi::Array>();
+	std::vector<OSWindow> windows;
+	windows.reserve(arr.Length());
+	for (uint32_t i = 0; i < arr.Length(); i++) {
+		windows.push_back(OSWindow::FromJsValue(arr.Get(i)));
+	}
+	return windows;
+}
+
+Napi::Value QueryWindows(const Napi::CallbackInfo& info) {
+	auto windows = WindowListFromJsValue(info[0]);
+	uint32_t fields = WindowInfoFieldsFromJsValue(info[1]);
+	auto infos = WithJsErrors(info.Env(), [&]() { return OSQueryWindows(windows, fields); });
+	return WindowInfoToJs(info.Env(), infos, fields);
+}
+
+class QueryWindowsWorker : public Napi::AsyncWorker {
+public:
+	QueryWindowsWorker(Napi::Env env, std::vector<OSWindow> windows, uint32_t fields)
+		: Napi::AsyncWorker(env), deferred(Napi::Promise::Deferred::New(env)), windows(std::move(windows)), fields(fields) {}
+	Napi::Promise Promise() { return deferred.Promise(); }
+protected:
+	void Execute() override {
+		try {
+			result = OSQueryWindows(windows, fields);
+		} catch (std::exception& e) {
+			SetError(e.what());
+		}
+	}
+	void OnOK() override { deferred.Resolve(WindowInfoToJs(Env(), result, fields)); }
+	void OnError(const Napi::Error& e) override { deferred.Reject(e.Value()); }
+private:
+	Napi::Promise::Deferred deferred;
+	std::vector<OSWindow> windows;
+	uint32_t fields;
+	std::vector<OSWindowInfo> result;
+};
+
+Napi::Value QueryWindowsAsync(const Napi::CallbackInfo& info) {
+	auto windows = WindowListFromJsValue(info[0]);
+	uint32_t fields = WindowInfoFieldsFromJsValue(info[1]);
+	auto worker = new QueryWindowsWorker(info.Env(), std::move(windows), fields);
+	auto promise = worker->Promise();
+	worker->Queue();
+	return promise;
+}
+
 void SetWindowParent(const Napi::CallbackInfo& info) {
 	auto wnd = OSWindow::FromJsValue(info[0]);
 	auto parent = OSWindow::FromJsValue(info[1]);
@@ -90,18 +375,210 @@ void SetWindowParent(const Napi::CallbackInfo& info) {
 
 void SetWindowShape(const Napi::CallbackInfo& info) {
 #ifdef OS_LINUX
-	auto arr = info[1].As<Napi::Array>();
 	std::vector<JSRectangle> rects;
-	rects.reserve(arr.Length());
-	for (uint32_t i = 0; i < arr.Length(); i++) {
-		rects.push_back(JSRectangle::FromJsValue(arr[i]));
+	if (info[1].IsTypedArray()) {
+		rects = JSRectangle::FromQuads(info[1]);
+	} else {
+		auto arr = info[1].As<Napi::Array>();
+		rects.reserve(arr.Length());
+		for (uint32_t i = 0; i < arr.Length(); i++) {
+			rects.push_back(JSRectangle::FromJsValue(arr[i]));
+		}
 	}
-	OSSetWindowShape(OSWindow::FromJsValue(info[0]), rects);
+	auto wnd = OSWindow::FromJsValue(info[0]);
+	WithJsErrors(info.Env(), [&]() { OSSetWindowShape(wnd, rects); });
 #else
 	throw Napi::Error::New(info.Env(), "SetWindowShape is not implemented on this operating system");
 #endif
 }
 
+void SetWindowShapeMask(const Napi::CallbackInfo& info) {
+#ifdef OS_LINUX
+	auto data = info[1].As<Napi::TypedArray>();
+	int width = info[2].As<Napi::Number>().Int32Value();
+	int height = info[3].As<Napi::Number>().Int32Value();
+	if (width <= 0 || height <= 0 || data.ByteLength() < (size_t)width * height * 4) {
+		throw Napi::RangeError::New(info.Env(), "mask data does not match its size");
+	}
+	auto bytes = reinterpret_cast<const uint8_t*>(data.ArrayBuffer().Data()) + data.ByteOffset();
+	auto wnd = OSWindow::FromJsValue(info[0]);
+	WithJsErrors(info.Env(), [&]() { OSSetWindowShapeMask(wnd, bytes, width, height); });
+#else
+	throw Napi::Error::New(info.Env(), "SetWindowShapeMask is not implemented on this operating system");
+#endif
+}
+
+void SetWindowPin(const Napi::CallbackInfo& info) {
+#ifdef OS_LINUX
+	auto wnd = OSWindow::FromJsValue(info[0]);
+	auto parent = OSWindow::FromJsValue(info[1]);
+	if (info[2].IsNull() || info[2].IsUndefined()) {
+		WithJsErrors(info.Env(), [&]() { OSSetWindowPin(wnd, parent, nullptr); });
+		return;
+	}
+	auto obj = info[2].As<Napi::Object>();
+	OSWindowPinConfig config;
+	config.cover = obj.Get("mode").As<Napi::String>().Utf8Value() == "cover";
+	if (!config.cover) {
+		config.pinLeft = obj.Get("pinhor").As<Napi::String>().Utf8Value() == "left";
+		config.pinTop = obj.Get("pinver").As<Napi::String>().Utf8Value() == "top";
+		config.hordist = obj.Get("hordist").As<Napi::Number>().Int32Value();
+		config.verdist = obj.Get("verdist").As<Napi::Number>().Int32Value();
+		config.width = obj.Get("width").As<Napi::Number>().Int32Value();
+		config.height = obj.Get("height").As<Napi::Number>().Int32Value();
+	}
+	WithJsErrors(info.Env(), [&]() { OSSetWindowPin(wnd, parent, &config); });
+#else
+	throw Napi::Error::New(info.Env(), "SetWindowPin is not implemented on this operating system");
+#endif
+}
+
+void SetClickCapture(const Napi::CallbackInfo& info) {
+#ifdef OS_LINUX
+	auto wnd = OSWindow::FromJsValue(info[0]);
+	if (info[1].IsNull() || info[1].IsUndefined()) {
+		OSSetClickCapture(wnd, nullptr);
+		return;
+	}
+	auto obj = info[1].As<Napi::Object>();
+	ClickCaptureConfig config;
+	if (obj.Get("width").IsNumber()) { config.width = obj.Get("width").As<Napi::Number>().Int32Value(); }
+	if (obj.Get("height").IsNumber()) { config.height = obj.Get("height").As<Napi::Number>().Int32Value(); }
+	if (obj.Get("frames").IsNumber()) { config.frames = obj.Get("frames").As<Napi::Number>().Int32Value(); }
+	if (obj.Get("timeout").IsNumber()) { config.timeout = obj.Get("timeout").As<Napi::Number>().Int32Value(); }
+	if (obj.Get("mode").IsString()) { config.mode = CaptureModeFromJsValue(obj.Get("mode")); }
+	if (config.width <= 0 || config.height <= 0 || config.width > 1e4 || config.height > 1e4) {
+		throw Napi::TypeError::New(info.Env(), "invalid capture size");
+	}
+	// the capture thread handles clicks one at a time, don't let a single click hold it up for long
+	config.frames = std::max(0, config.frames);
+	config.timeout = std::min(std::max(0, config.timeout), 1000);
+	OSSetClickCapture(wnd, &config);
+#else
+	throw Napi::Error::New(info.Env(), "SetClickCapture is not implemented on this operating system");
+#endif
+}
+
+void StartFrameTracking(const Napi::CallbackInfo& info) {
+#ifdef OS_LINUX
+	auto wnd = OSWindow::FromJsValue(info[0]);
+	WithJsErrors(info.Env(), [&]() { OSStartFrameTracking(wnd); });
+#else
+	throw Napi::Error::New(info.Env(), "StartFrameTracking is not implemented on this operating system");
+#endif
+}
+
+void StopFrameTracking(const Napi::CallbackInfo& info) {
+#ifdef OS_LINUX
+	OSStopFrameTracking(OSWindow::FromJsValue(info[0]));
+#else
+	throw Napi::Error::New(info.Env(), "StopFrameTracking is not implemented on this operating system");
+#endif
+}
+
+Napi::Value GetFrameStats(const Napi::CallbackInfo& info) {
+#ifdef OS_LINUX
+	auto env = info.Env();
+	OSFrameStats stats = OSGetFrameStats(OSWindow::FromJsValue(info[0]));
+	if (!stats.tracked) {
+		return env.Null();
+	}
+	auto ret = Napi::Object::New(env);
+	ret.Set("fps", stats.fps);
+	ret.Set("frames", (double)stats.frames);
+	ret.Set("sinceLastFrame", stats.sinceLastFrame);
+	ret.Set("samples", stats.samples);
+	auto frametime = Napi::Object::New(env);
+	frametime.Set("mean", stats.mean);
+	frametime.Set("min", stats.min);
+	frametime.Set("p50", stats.p50);
+	frametime.Set("p90", stats.p90);
+	frametime.Set("p99", stats.p99);
+	frametime.Set("max", stats.max);
+	ret.Set("frameTime", frametime);
+	return ret;
+#else
+	throw Napi::Error::New(info.Env(), "GetFrameStats is not implemented on this operating system");
+#endif
+}
+
+void DrawOverlay(const Napi::CallbackInfo& info) {
+#ifdef OS_LINUX
+	auto env = info.Env();
+	auto arr = info[2].As<Napi::Array>();
+	std::vector<OverlayPrimitive> primitives;
+	primitives.reserve(arr.Length());
+	for (uint32_t i = 0; i < arr.Length(); i++) {
+		auto obj = arr.Get(i).As<Napi::Object>();
+		auto type = obj.Get("type").As<Napi::String>().Utf8Value();
+		OverlayPrimitive prim;
+		auto color = obj.Get("color");
+		if (color.IsNumber()) { prim.color = color.As<Napi::Number>().Uint32Value(); }
+		if (type == "line") {
+			prim.type = OverlayPrimitiveType::Line;
+			prim.linewidth = obj.Get("linewidth").As<Napi::Number>().Int32Value();
+			prim.x1 = obj.Get("x1").As<Napi::Number>().Int32Value();
+			prim.y1 = obj.Get("y1").As<Napi::Number>().Int32Value();
+			prim.x2 = obj.Get("x2").As<Napi::Number>().Int32Value();
+			prim.y2 = obj.Get("y2").As<Napi::Number>().Int32Value();
+		} else if (type == "rect") {
+			prim.type = OverlayPrimitiveType::Rect;
+			prim.linewidth = obj.Get("linewidth").As<Napi::Number>().Int32Value();
+			prim.x1 = obj.Get("x").As<Napi::Number>().Int32Value();
+			prim.y1 = obj.Get("y").As<Napi::Number>().Int32Value();
+			prim.x2 = prim.x1 + obj.Get("width").As<Napi::Number>().Int32Value();
+			prim.y2 = prim.y1 + obj.Get("height").As<Napi::Number>().Int32Value();
+		} else if (type == "text") {
+			prim.type = OverlayPrimitiveType::Text;
+			prim.x1 = obj.Get("x").As<Napi::Number>().Int32Value();
+			prim.y1 = obj.Get("y").As<Napi::Number>().Int32Value();
+			prim.text = obj.Get("text").As<Napi::String>().Utf8Value();
+			prim.size = obj.Get("size").As<Napi::Number>().Int32Value();
+			prim.center = obj.Get("center").ToBoolean();
+			prim.shadow = obj.Get("shadow").ToBoolean();
+		} else if (type == "sprite") {
+			prim.type = OverlayPrimitiveType::Sprite;
+			auto sprite = obj.Get("sprite").As<Napi::Object>();
+			auto data = sprite.Get("data").As<Napi::TypedArray>();
+			int width = sprite.Get("width").As<Napi::Number>().Int32Value();
+			int height = sprite.Get("height").As<Napi::Number>().Int32Value();
+			if (width <= 0 || height <= 0 || data.ByteLength() < (size_t)width * height * 4) {
+				throw Napi::TypeError::New(env, "sprite data does not match its size");
+			}
+			prim.x1 = obj.Get("x").As<Napi::Number>().Int32Value();
+			prim.y1 = obj.Get("y").As<Napi::Number>().Int32Value();
+			prim.x2 = prim.x1 + width;
+			prim.y2 = prim.y1 + height;
+			//rgba to the premultiplied argb of the overlay buffers
+			auto rgba = (const uint8_t*)data.ArrayBuffer().Data() + data.ByteOffset();
+			auto pixels = std::make_shared<std::vector<uint32_t>>((size_t)width * height);
+			for (size_t p = 0; p < pixels->size(); p++) {
+				const uint8_t* px = rgba + p * 4;
+				uint32_t a = px[3];
+				(*pixels)[p] = (a << 24) | ((px[0] * a + 127) / 255 << 16) | ((px[1] * a + 127) / 255 << 8) | ((px[2] * a + 127) / 255);
+			}
+			prim.sprite = pixels;
+		} else {
+			throw Napi::RangeError::New(env, "unknown overlay primitive " + type);
+		}
+		primitives.push_back(std::move(prim));
+	}
+	auto wnd = OSWindow::FromJsValue(info[0]);
+	auto bounds = JSRectangle::FromJsValue(info[1]);
+	WithJsErrors(env, [&]() { OSDrawOverlay(wnd, bounds, primitives); });
+#else
+	throw Napi::Error::New(info.Env(), "DrawOverlay is not implemented on this operating system");
+#endif
+}
+
+void CloseOverlay(const Napi::CallbackInfo& info) {
+#ifdef OS_LINUX
+	OSCloseOverlay(OSWindow::FromJsValue(info[0]));
+#else
+	throw Napi::Error::New(info.Env(), "CloseOverlay is not implemented on this operating system");
+#endif
+}
+
 void NewWindowListener(const Napi::CallbackInfo& info) {
 	auto wnd = OSWindow::FromJsValue(info[0]);
 	auto typestring = info[1].As<Napi::String>().Utf8Value();
@@ -123,3 +600,105 @@ void RemoveWindowListener(const Napi::CallbackInfo& info) {
 	}
 	OSRemoveWindowListener(wnd, typefind->second, cb);
 }
+
+Napi::Value LoadFont(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto def = info[0].As<Napi::Object>();
+	auto font = std::make_shared<OCRFont>();
+	font->width = def.Get("width").As<Napi::Number>().Int32Value();
+	font->height = def.Get("height").As<Napi::Number>().Int32Value();
+	font->basey = def.Get("basey").As<Napi::Number>().Int32Value();
+	font->spacewidth = def.Get("spacewidth").As<Napi::Number>().Int32Value();
+	font->shadow = def.Get("shadow").ToBoolean();
+	auto maxspaces = def.Get("maxspaces");
+	if (maxspaces.IsNumber()) { font->maxspaces = maxspaces.As<Napi::Number>().Int32Value(); }
+
+	auto chars = def.Get("chars").As<Napi::Array>();
+	vector<int> pixels;
+	for (uint32_t i = 0; i < chars.Length(); i++) {
+		auto chr = chars.Get(i).As<Napi::Object>();
+		auto jspixels = chr.Get("pixels").As<Napi::Array>();
+		pixels.resize(jspixels.Length());
+		for (uint32_t a = 0; a < jspixels.Length(); a++) {
+			pixels[a] = jspixels.Get(a).As<Napi::Number>().Int32Value();
+		}
+		font->AddGlyph(
+			chr.Get("chr").As<Napi::String>().Utf8Value(),
+			chr.Get("width").As<Napi::Number>().Int32Value(),
+			chr.Get("bonus").As<Napi::Number>().FloatValue(),
+			chr.Get("secondary").ToBoolean(),
+			pixels
+		);
+	}
+
+	auto inst = env.GetInstanceData<PluginInstance>();
+	inst->fonts.push_back(font);
+	return Napi::Number::New(env, (double)(inst->fonts.size() - 1));
+}
+
+Napi::Value FindReadLine(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto data = info[0].As<Napi::TypedArray>();
+	int width = info[1].As<Napi::Number>().Int32Value();
+	int height = info[2].As<Napi::Number>().Int32Value();
+	if (width <= 0 || height <= 0 || data.ByteLength() < (size_t)width * height * 4) {
+		throw Napi::TypeError::New(env, "image data does not match size");
+	}
+	OCRImage img = { (uint8_t*)data.ArrayBuffer().Data() + data.ByteOffset(), width, height };
+
+	auto inst = env.GetInstanceData<PluginInstance>();
+	auto jsfonts = info[3].As<Napi::Array>();
+	vector<std::shared_ptr<OCRFont>> fonts;
+	for (uint32_t i = 0; i < jsfonts.Length(); i++) {
+		uint32_t id = jsfonts.Get(i).As<Napi::Number>().Uint32Value();
+		if (id >= inst->fonts.size()) { throw Napi::RangeError::New(env, "unknown font"); }
+		fonts.push_back(inst->fonts[id]);
+	}
+
+	auto jscolors = info[4].As<Napi::Array>();
+	vector<OCRColor> colors;
+	for (uint32_t i = 0; i < jscolors.Length(); i++) {
+		auto col = jscolors.Get(i).As<Napi::Array>();
+		colors.push_back({
+			(uint8_t)col.Get(0u).As<Napi::Number>().Uint32Value(),
+			(uint8_t)col.Get(1u).As<Napi::Number>().Uint32Value(),
+			(uint8_t)col.Get(2u).As<Napi::Number>().Uint32Value()
+		});
+	}
+
+	int x = info[5].As<Napi::Number>().Int32Value();
+	int y = info[6].As<Napi::Number>().Int32Value();
+	auto lines = OCRFindReadLine(img, fonts, colors, x, y);
+
+	//same shape as the return value of findReadLine in alt1/ocr
+	auto ret = Napi::Array::New(env, lines.size());
+	for (size_t i = 0; i < lines.size(); i++) {
+		auto& line = lines[i];
+		auto area = Napi::Object::New(env);
+		area.Set("x", line.x);
+		area.Set("y", line.y);
+		area.Set("w", line.w);
+		area.Set("h", line.h);
+		auto fragments = Napi::Array::New(env, line.fragments.size());
+		for (size_t a = 0; a < line.fragments.size(); a++) {
+			auto& frag = line.fragments[a];
+			auto color = Napi::Array::New(env, 3);
+			color.Set(0u, Napi::Number::New(env, frag.color.r));
+			color.Set(1u, Napi::Number::New(env, frag.color.g));
+			color.Set(2u, Napi::Number::New(env, frag.color.b));
+			auto jsfrag = Napi::Object::New(env);
+			jsfrag.Set("text", frag.text);
+			jsfrag.Set("color", color);
+			jsfrag.Set("index", (double)a);
+			jsfrag.Set("xstart", frag.xstart);
+			jsfrag.Set("xend", frag.xend);
+			fragments.Set(a, jsfrag);
+		}
+		auto jsline = Napi::Object::New(env);
+		jsline.Set("debugArea", area);
+		jsline.Set("text", line.text);
+		jsline.Set("fragments", fragments);
+		ret.Set(i, jsline);
+	}
+	return ret;
+}
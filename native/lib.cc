@@ -2,20 +2,58 @@
 
 #include "jsapi.h"
 
+//worker threads tear their environment down while the process keeps running, so everything that calls into js from
+//other threads has to stop first. The instance data itself is deleted by node-addon-api after the cleanup hooks
+static void CleanupEnvironment(void* arg) {
+	Napi::Env env((napi_env)arg);
+	auto inst = env.GetInstanceData<PluginInstance>();
+	inst->regionWatches.clear();
+	inst->captureScheduler.reset();
+	OSRemoveEnvironment(env);
+}
+
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
+	//one instance per environment, the main thread and every worker that loads the addon get their own
 	auto inst = new PluginInstance();
-	//TODO need delete destructor to get rid of the mem again?
 	env.SetInstanceData<>(inst);
+	OSAddEnvironment(env);
+	napi_add_env_cleanup_hook(env, CleanupEnvironment, (napi_env)env);
+	NativeFrame::Init(env);
+	NativeImagePipeline::Init(env);
 
 	exports.Set("captureWindowMulti", Napi::Function::New(env, CaptureWindowMulti));
+	exports.Set("captureScheduled", Napi::Function::New(env, CaptureScheduled));
+	exports.Set("captureFrame", Napi::Function::New(env, JSCaptureFrame));
+	exports.Set("compileImagePipeline", Napi::Function::New(env, CompileImagePipeline));
+	exports.Set("findSubImages", Napi::Function::New(env, JSFindSubImages));
+	exports.Set("registerTemplates", Napi::Function::New(env, RegisterTemplates));
+	exports.Set("unregisterTemplates", Napi::Function::New(env, UnregisterTemplates));
+	exports.Set("findTemplates", Napi::Function::New(env, FindTemplates));
+	exports.Set("setDerivedCacheBudget", Napi::Function::New(env, SetDerivedCacheBudget));
+	exports.Set("samplePixels", Napi::Function::New(env, SamplePixels));
+	exports.Set("watchRegions", Napi::Function::New(env, WatchRegions));
+	exports.Set("unwatchRegions", Napi::Function::New(env, UnwatchRegions));
 	exports.Set("getRsHandles", Napi::Function::New(env, GetRsHandles));
 	exports.Set("getWindowBounds", Napi::Function::New(env, GetWindowBounds));
 	exports.Set("getClientBounds", Napi::Function::New(env, GetClientBounds));
 	exports.Set("getWindowTitle", Napi::Function::New(env, GetWindowTitle));
+	exports.Set("queryWindows", Napi::Function::New(env, QueryWindows));
+	exports.Set("queryWindowsAsync", Napi::Function::New(env, QueryWindowsAsync));
 	exports.Set("setWindowParent", Napi::Function::New(env, SetWindowParent));
 	exports.Set("getActiveWindow", Napi::Function::New(env, JSGetActiveWindow));
+	exports.Set("getWindowVisibility", Napi::Function::New(env, GetWindowVisibility));
 	exports.Set("getMouseState", Napi::Function::New(env, GetMouseState));
 	exports.Set("setWindowShape", Napi::Function::New(env, SetWindowShape));
+	exports.Set("setWindowShapeMask", Napi::Function::New(env, SetWindowShapeMask));
+	exports.Set("drawOverlay", Napi::Function::New(env, DrawOverlay));
+	exports.Set("setWindowPin", Napi::Function::New(env, SetWindowPin));
+	exports.Set("setClickCapture", Napi::Function::New(env, SetClickCapture));
+	exports.Set("startFrameTracking", Napi::Function::New(env, StartFrameTracking));
+	exports.Set("stopFrameTracking", Napi::Function::New(env, StopFrameTracking));
+	exports.Set("getFrameStats", Napi::Function::New(env, GetFrameStats));
+	exports.Set("closeOverlay", Napi::Function::New(env, CloseOverlay));
+	exports.Set("loadFont", Napi::Function::New(env, LoadFont));
+	exports.Set("findReadLine", Napi::Function::New(env, FindReadLine));
 
 	exports.Set("newWindowListener", Napi::Function::New(env, NewWindowListener));
 	exports.Set("removeWindowListener", Napi::Function::New(env, RemoveWindowListener));
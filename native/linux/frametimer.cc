@@ -0,0 +1,66 @@
+#include <algorithm>
+#include <vector>
+#include "frametimer.h"
+
+namespace priv_os_x11 {
+	void FrameTimer::addFrame(clock::time_point time) {
+		if (this->count != 0) {
+			clock::time_point last = this->frames[(this->next + historySize - 1) % historySize];
+			if (time - last < minInterval) {
+				return;
+			}
+		}
+		this->frames[this->next] = time;
+		this->next = (this->next + 1) % historySize;
+		this->count = std::min(this->count + 1, historySize);
+		this->total++;
+	}
+
+	OSFrameStats FrameTimer::stats(clock::time_point now) const {
+		OSFrameStats res;
+		res.tracked = true;
+		res.frames = this->total;
+		if (this->count == 0) {
+			return res;
+		}
+		auto ms = [](clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); };
+		auto frame = [this](size_t i) { return this->frames[(this->next + historySize - this->count + i) % historySize]; };
+
+		clock::time_point last = frame(this->count - 1);
+		res.sinceLastFrame = ms(now - last);
+
+		// fps over the frames of the last second
+		size_t first = this->count - 1;
+		while (first > 0 && now - frame(first - 1) <= std::chrono::seconds(1)) {
+			first--;
+		}
+		if (first < this->count - 1) {
+			size_t spanFrames = this->count - 1 - first;
+			double span = ms(last - frame(first));
+			// count the time since the last frame once it is overdue, so the fps drops right away when the client stalls
+			span += std::max(0.0, res.sinceLastFrame - span / spanFrames);
+			res.fps = spanFrames * 1000.0 / span;
+		}
+
+		std::vector<double> intervals;
+		intervals.reserve(this->count);
+		for (size_t i = 1; i < this->count; i++) {
+			intervals.push_back(ms(frame(i) - frame(i - 1)));
+		}
+		if (intervals.empty()) {
+			return res;
+		}
+		std::sort(intervals.begin(), intervals.end());
+		auto percentile = [&intervals](double p) { return intervals[std::min(intervals.size() - 1, (size_t)(p * intervals.size()))]; };
+		double sum = 0;
+		for (double interval : intervals) { sum += interval; }
+		res.samples = (uint32_t)intervals.size();
+		res.mean = sum / intervals.size();
+		res.min = intervals.front();
+		res.p50 = percentile(0.5);
+		res.p90 = percentile(0.9);
+		res.p99 = percentile(0.99);
+		res.max = intervals.back();
+		return res;
+	}
+}
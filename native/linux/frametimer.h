@@ -0,0 +1,28 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include "../os.h"
+
+namespace priv_os_x11 {
+	/**
+	 * Rolling history of the times at which a window presented a frame
+	 */
+	class FrameTimer {
+	public:
+		typedef std::chrono::steady_clock clock;
+
+		void addFrame(clock::time_point time);
+		OSFrameStats stats(clock::time_point now) const;
+		uint64_t totalFrames() const { return total; }
+
+	private:
+		static constexpr size_t historySize = 256;
+		// partial redraws that are reported this close together count as one frame
+		static constexpr std::chrono::microseconds minInterval{ 2000 };
+
+		std::array<clock::time_point, historySize> frames;
+		size_t count = 0;
+		size_t next = 0;
+		uint64_t total = 0;
+	};
+}
@@ -0,0 +1,117 @@
+#include <assert.h>
+#include <algorithm>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <time.h>
+#include "glcapture.h"
+
+namespace priv_os_x11 {
+	// the hook stamps with CLOCK_MONOTONIC, which is also what steady_clock uses on linux
+	static uint64_t MonotonicNs() {
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+	}
+
+	std::unique_ptr<GLHookCapture> GLHookCapture::Open(uint32_t pid) {
+		int fd = shm_open(glshm::shmName(pid).c_str(), O_RDWR, 0);
+		if (fd == -1) {
+			return nullptr;
+		}
+		void* mem = mmap(NULL, glshm::totalSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (mem == MAP_FAILED) {
+			return nullptr;
+		}
+		auto header = reinterpret_cast<glshm::Header*>(mem);
+		if (header->magic != glshm::magic || header->version != glshm::version) {
+			munmap(mem, glshm::totalSize);
+			return nullptr;
+		}
+		return std::unique_ptr<GLHookCapture>(new GLHookCapture(header));
+	}
+
+	GLHookCapture::~GLHookCapture() {
+		munmap(this->header, glshm::totalSize);
+	}
+
+	bool GLHookCapture::acquire(std::chrono::nanoseconds maxAge) {
+		uint64_t now = MonotonicNs();
+		this->header->lastRequest.store(now, std::memory_order_release);
+
+		// newest slot that isn't being written, seq 0 was never written at all
+		const glshm::Slot* best = nullptr;
+		uint32_t bestSeq = 0;
+		for (uint32_t i = 0; i < glshm::slotCount; i++) {
+			const glshm::Slot& slot = this->header->slots[i];
+			uint32_t seq = slot.seq.load(std::memory_order_acquire);
+			if (seq == 0 || seq % 2 != 0) {
+				continue;
+			}
+			if (!best || slot.frame > best->frame) {
+				best = &slot;
+				bestSeq = seq;
+			}
+		}
+		if (!best || now - best->time > (uint64_t)maxAge.count()) {
+			return false;
+		}
+		this->slot = best;
+		this->seq = bestSeq;
+		this->width = std::min(best->width, glshm::maxWidth);
+		this->height = std::min(best->height, glshm::maxHeight);
+		this->pixels = reinterpret_cast<const uint8_t*>(this->header) + glshm::slotOffset(best - this->header->slots);
+		return true;
+	}
+
+	void GLHookCapture::copy(char* target, size_t maxLength, int x, int y, int w, int h) const {
+		size_t expectedSize = (size_t)w * h * 4;
+		if (expectedSize > maxLength) {
+			throw std::invalid_argument("Insufficient buffer size");
+		}
+
+		size_t targetPos = 0;
+		for (int row = y; row < y + h; row++) {
+			// gl rows are stored bottom-up
+			const uint8_t* line = this->pixels + (size_t)(this->height - 1 - row) * this->width * 4;
+			for (int col = x; col < x + w; col++) {
+				if (col >= 0 && row >= 0 && col < this->width && row < this->height) {
+					const uint8_t* px = line + col * 4;
+					target[targetPos++] = px[2];
+					target[targetPos++] = px[1];
+					target[targetPos++] = px[0];
+					target[targetPos++] = 0xFF;
+				} else {
+					target[targetPos++] = 0;
+					target[targetPos++] = 0;
+					target[targetPos++] = 0;
+					target[targetPos++] = 0xFF;
+				}
+			}
+		}
+		assert(targetPos <= expectedSize);
+	}
+
+	uint32_t GLHookCapture::pixel(int x, int y) const {
+		if (x < 0 || y < 0 || x >= this->width || y >= this->height) {
+			return 0;
+		}
+		const uint8_t* px = this->pixels + ((size_t)(this->height - 1 - y) * this->width + x) * 4;
+		return px[2] | (px[1] << 8) | (px[0] << 16) | 0xFF000000;
+	}
+
+	OSFrameStats GLHookCapture::frameStats(FrameTimer::clock::time_point now) const {
+		uint64_t total = this->header->swapCount.load(std::memory_order_acquire);
+		uint64_t count = std::min<uint64_t>(total, glshm::historySize);
+		FrameTimer timer;
+		for (uint64_t i = total - count; i < total; i++) {
+			uint64_t time = this->header->swapTimes[i % glshm::historySize].load(std::memory_order_relaxed);
+			timer.addFrame(FrameTimer::clock::time_point(std::chrono::nanoseconds(time)));
+		}
+		OSFrameStats stats = timer.stats(now);
+		stats.frames = total;
+		return stats;
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <chrono>
+#include <memory>
+#include "glshm.h"
+#include "frametimer.h"
+
+namespace priv_os_x11 {
+	/**
+	 * Reads the frames that the glhook library writes from inside the game process. Same read interface as
+	 * XShmCapture, so the capture callbacks work on either
+	 */
+	class GLHookCapture {
+	public:
+		// Maps the ring of process pid, null when the process doesn't run with the hook
+		static std::unique_ptr<GLHookCapture> Open(uint32_t pid);
+		~GLHookCapture();
+
+		/**
+		 * Calls cb(*this) with the newest frame if it is at most maxAge old. Frames are only read back while they
+		 * are requested, so this also tells the hook to keep going. The hook may overwrite the slot while cb runs,
+		 * in that case cb is called again on a newer frame, so it has to be safe to repeat. Returns false when
+		 * there is no recent frame
+		 */
+		template<typename F>
+		bool read(std::chrono::nanoseconds maxAge, F cb) {
+			for (int attempt = 0; attempt < 3; attempt++) {
+				if (!acquire(maxAge)) {
+					return false;
+				}
+				cb(*this);
+				if (slot->seq.load(std::memory_order_acquire) == seq) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void copy(char* target, size_t maxLength, int x, int y, int w, int h) const;
+		// Single pixel of the current frame in rgba byte order, 0 (transparent) when out of bounds
+		uint32_t pixel(int x, int y) const;
+		// Frame timing from the swap history of the hook, swaps are exact frame times unlike damage events
+		OSFrameStats frameStats(FrameTimer::clock::time_point now) const;
+
+		int width = 0;
+		int height = 0;
+
+	private:
+		GLHookCapture(glshm::Header* header) : header(header) {}
+		bool acquire(std::chrono::nanoseconds maxAge);
+
+		glshm::Header* header;
+		const glshm::Slot* slot = nullptr;
+		const uint8_t* pixels = nullptr;
+		uint32_t seq = 0;
+	};
+}
@@ -0,0 +1,268 @@
+/**
+ * LD_PRELOAD library for the game client that makes CaptureMode::OpenGL work on linux.
+ * It intercepts glXSwapBuffers, records the time of every swap and, while alt1 is asking for frames, reads back the
+ * back buffer into the shared memory ring described in glshm.h. Readback goes through pixel buffer objects so the
+ * game never waits on it, a frame is copied out on a later swap once its fence has signaled.
+ *
+ * Start the client with LD_PRELOAD=/path/to/alt1glhook.so. Clients that look up glXSwapBuffers through dlopen/dlsym
+ * on libGL directly instead of linking it or using glXGetProcAddress are not hooked.
+ */
+
+#include <GL/gl.h>
+#include <GL/glx.h>
+#include <GL/glext.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <time.h>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include "glshm.h"
+
+namespace {
+	typedef void (*SwapBuffersFn)(Display*, GLXDrawable);
+	typedef __GLXextFuncPtr (*GetProcAddressFn)(const GLubyte*);
+
+	SwapBuffersFn realSwapBuffers = nullptr;
+	GetProcAddressFn realGetProcAddress = nullptr;
+
+	PFNGLGENBUFFERSPROC genBuffers;
+	PFNGLBINDBUFFERPROC bindBuffer;
+	PFNGLBUFFERDATAPROC bufferData;
+	PFNGLMAPBUFFERPROC mapBuffer;
+	PFNGLUNMAPBUFFERPROC unmapBuffer;
+	PFNGLBINDFRAMEBUFFERPROC bindFramebuffer;
+	PFNGLFENCESYNCPROC fenceSync;
+	PFNGLCLIENTWAITSYNCPROC clientWaitSync;
+	PFNGLDELETESYNCPROC deleteSync;
+
+	struct Readback {
+		GLuint pbo = 0;
+		size_t capacity = 0;
+		GLsync fence = nullptr;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint64_t frame = 0;
+		uint64_t time = 0;
+	};
+
+	std::mutex mutex;
+	glshm::Header* header = nullptr;
+	uint8_t* shmBase = nullptr;
+	std::string shmName;
+	// set when shm or the gl entry points are missing, swaps are then only passed through
+	bool disabled = false;
+	bool glLoaded = false;
+	// the buffer objects belong to this context
+	GLXContext readbackContext = nullptr;
+	Readback readbacks[glshm::slotCount];
+	uint32_t nextReadback = 0;
+	uint32_t nextSlot = 0;
+
+	uint64_t nowNs() {
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+	}
+
+	void resolveReal() {
+		if (!realSwapBuffers) {
+			realSwapBuffers = (SwapBuffersFn)dlsym(RTLD_NEXT, "glXSwapBuffers");
+			realGetProcAddress = (GetProcAddressFn)dlsym(RTLD_NEXT, "glXGetProcAddressARB");
+		}
+	}
+
+	void removeShm() {
+		if (!shmName.empty()) {
+			shm_unlink(shmName.c_str());
+		}
+	}
+
+	bool openShm() {
+		shmName = glshm::shmName((uint32_t)getpid());
+		int fd = shm_open(shmName.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+		if (fd == -1) {
+			return false;
+		}
+		if (ftruncate(fd, glshm::totalSize) == -1) {
+			close(fd);
+			shm_unlink(shmName.c_str());
+			return false;
+		}
+		void* mem = mmap(NULL, glshm::totalSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (mem == MAP_FAILED) {
+			shm_unlink(shmName.c_str());
+			return false;
+		}
+		shmBase = (uint8_t*)mem;
+		header = (glshm::Header*)mem;
+		// ftruncate zero fills, so all counters and sequences start at 0
+		header->version = glshm::version;
+		std::atomic_thread_fence(std::memory_order_release);
+		header->magic = glshm::magic;
+		atexit(removeShm);
+		return true;
+	}
+
+	template<typename T>
+	bool loadProc(T& target, const char* name) {
+		target = (T)realGetProcAddress((const GLubyte*)name);
+		return target != nullptr;
+	}
+
+	bool loadGL() {
+		return realGetProcAddress
+			&& loadProc(genBuffers, "glGenBuffers")
+			&& loadProc(bindBuffer, "glBindBuffer")
+			&& loadProc(bufferData, "glBufferData")
+			&& loadProc(mapBuffer, "glMapBuffer")
+			&& loadProc(unmapBuffer, "glUnmapBuffer")
+			&& loadProc(bindFramebuffer, "glBindFramebuffer")
+			&& loadProc(fenceSync, "glFenceSync")
+			&& loadProc(clientWaitSync, "glClientWaitSync")
+			&& loadProc(deleteSync, "glDeleteSync");
+	}
+
+	// copy a finished readback into the next ring slot, returns false while the gpu is still busy with it
+	bool finishReadback(Readback& rb, GLuint64 timeout) {
+		GLenum status = clientWaitSync(rb.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+		if (status == GL_TIMEOUT_EXPIRED) {
+			return false;
+		}
+		deleteSync(rb.fence);
+		rb.fence = nullptr;
+		if (status == GL_WAIT_FAILED) {
+			return true;
+		}
+
+		bindBuffer(GL_PIXEL_PACK_BUFFER, rb.pbo);
+		const void* pixels = mapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+		if (pixels) {
+			uint32_t index = nextSlot++ % glshm::slotCount;
+			glshm::Slot& slot = header->slots[index];
+			slot.seq.fetch_add(1, std::memory_order_acq_rel);
+			memcpy(shmBase + glshm::slotOffset(index), pixels, (size_t)rb.width * rb.height * 4);
+			slot.width = rb.width;
+			slot.height = rb.height;
+			slot.frame = rb.frame;
+			slot.time = rb.time;
+			slot.seq.fetch_add(1, std::memory_order_release);
+			unmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		return true;
+	}
+
+	void startReadback(Display* dpy, GLXDrawable drawable, uint64_t frame, uint64_t time) {
+		unsigned int width = 0, height = 0;
+		glXQueryDrawable(dpy, drawable, GLX_WIDTH, &width);
+		glXQueryDrawable(dpy, drawable, GLX_HEIGHT, &height);
+		if (width == 0 || height == 0 || width > glshm::maxWidth || height > glshm::maxHeight) {
+			return;
+		}
+
+		// the oldest readback should be long done by now, skip this frame if the gpu is that far behind
+		Readback& rb = readbacks[nextReadback];
+		if (rb.fence && !finishReadback(rb, 0)) {
+			return;
+		}
+		nextReadback = (nextReadback + 1) % glshm::slotCount;
+
+		// leave the game's state exactly as it was, the pack buffer binding is restored by the caller
+		GLint prevReadFb, prevReadBuffer, prevAlign, prevRowLength;
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &prevReadFb);
+		glGetIntegerv(GL_READ_BUFFER, &prevReadBuffer);
+		glGetIntegerv(GL_PACK_ALIGNMENT, &prevAlign);
+		glGetIntegerv(GL_PACK_ROW_LENGTH, &prevRowLength);
+
+		size_t size = (size_t)width * height * 4;
+		if (!rb.pbo) {
+			genBuffers(1, &rb.pbo);
+		}
+		bindBuffer(GL_PIXEL_PACK_BUFFER, rb.pbo);
+		if (rb.capacity != size) {
+			bufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+			rb.capacity = size;
+		}
+		bindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		glReadBuffer(GL_BACK);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+		glReadPixels(0, 0, width, height, GL_BGRA, GL_UNSIGNED_BYTE, 0);
+		rb.fence = fenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		rb.width = width;
+		rb.height = height;
+		rb.frame = frame;
+		rb.time = time;
+
+		glPixelStorei(GL_PACK_ROW_LENGTH, prevRowLength);
+		glPixelStorei(GL_PACK_ALIGNMENT, prevAlign);
+		glReadBuffer(prevReadBuffer);
+		bindFramebuffer(GL_READ_FRAMEBUFFER, prevReadFb);
+	}
+
+	void onSwap(Display* dpy, GLXDrawable drawable) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (disabled) {
+			return;
+		}
+		if (!header && !openShm()) {
+			disabled = true;
+			return;
+		}
+		uint64_t time = nowNs();
+		uint64_t frame = header->swapCount.load(std::memory_order_relaxed);
+		header->swapTimes[frame % glshm::historySize].store(time, std::memory_order_relaxed);
+		header->swapCount.store(frame + 1, std::memory_order_release);
+
+		if (time - header->lastRequest.load(std::memory_order_acquire) > glshm::requestTimeoutNs) {
+			return;
+		}
+		GLXContext context = glXGetCurrentContext();
+		if (!context) {
+			return;
+		}
+		if (!glLoaded) {
+			if (!loadGL()) {
+				disabled = true;
+				return;
+			}
+			glLoaded = true;
+		}
+		if (context != readbackContext) {
+			// objects of another context can't be used here, start over
+			for (Readback& rb : readbacks) { rb = Readback(); }
+			readbackContext = context;
+		}
+
+		for (Readback& rb : readbacks) {
+			if (rb.fence) { finishReadback(rb, 0); }
+		}
+		GLint prevPack;
+		glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &prevPack);
+		startReadback(dpy, drawable, frame, time);
+		bindBuffer(GL_PIXEL_PACK_BUFFER, prevPack);
+	}
+}
+
+extern "C" {
+	void glXSwapBuffers(Display* dpy, GLXDrawable drawable) {
+		resolveReal();
+		onSwap(dpy, drawable);
+		realSwapBuffers(dpy, drawable);
+	}
+
+	__GLXextFuncPtr glXGetProcAddressARB(const GLubyte* name) {
+		resolveReal();
+		if (strcmp((const char*)name, "glXSwapBuffers") == 0) {
+			return (__GLXextFuncPtr)glXSwapBuffers;
+		}
+		return realGetProcAddress(name);
+	}
+
+	__GLXextFuncPtr glXGetProcAddress(const GLubyte* name) {
+		return glXGetProcAddressARB(name);
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+/**
+ * Layout of the shared memory ring that the glhook library in the game process writes its frames into and that
+ * the addon reads them from. Shared by both sides, so only plain data and lock-free atomics in here.
+ */
+namespace glshm {
+	constexpr uint32_t magic = 0x31474c41; // "ALG1"
+	constexpr uint32_t version = 1;
+	constexpr uint32_t slotCount = 3;
+	constexpr uint32_t historySize = 256;
+	// frames larger than this are not read back, shm pages are only allocated once written
+	constexpr uint32_t maxWidth = 4096;
+	constexpr uint32_t maxHeight = 4096;
+	constexpr size_t slotCapacity = (size_t)maxWidth * maxHeight * 4;
+	// the hook only reads back frames while a reader asked for one this recently
+	constexpr uint64_t requestTimeoutNs = 2000000000ull;
+
+	struct Slot {
+		// odd while the hook writes the slot, readers retry when it changed during their read
+		std::atomic<uint32_t> seq;
+		uint32_t width;
+		uint32_t height;
+		uint32_t padding;
+		// swap counter and CLOCK_MONOTONIC time in ns of the swap that presented this frame
+		uint64_t frame;
+		uint64_t time;
+	};
+
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+		std::atomic<uint64_t> swapCount;
+		// CLOCK_MONOTONIC ns of the last swaps, swap n is at n % historySize
+		std::atomic<uint64_t> swapTimes[historySize];
+		// heartbeat of the reader, CLOCK_MONOTONIC ns
+		std::atomic<uint64_t> lastRequest;
+		Slot slots[slotCount];
+	};
+
+	// slot pixels follow the header, bottom-up rows of bgra like glReadPixels returns them
+	constexpr size_t slotOffset(uint32_t slot) {
+		return ((sizeof(Header) + 4095) & ~(size_t)4095) + slot * slotCapacity;
+	}
+	constexpr size_t totalSize = slotOffset(slotCount);
+
+	inline std::string shmName(uint32_t pid) {
+		char name[64];
+		snprintf(name, sizeof(name), "/alt1-gl-%u", pid);
+		return name;
+	}
+}
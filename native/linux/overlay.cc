@@ -0,0 +1,360 @@
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include "overlay.h"
+
+namespace priv_os_x11 {
+	namespace {
+		bool IsEmpty(const JSRectangle& r) {
+			return r.width <= 0 || r.height <= 0;
+		}
+
+		JSRectangle Intersect(const JSRectangle& a, const JSRectangle& b) {
+			int x1 = std::max(a.x, b.x);
+			int y1 = std::max(a.y, b.y);
+			int x2 = std::min(a.x + a.width, b.x + b.width);
+			int y2 = std::min(a.y + a.height, b.y + b.height);
+			if (x2 <= x1 || y2 <= y1) { return JSRectangle(0, 0, 0, 0); }
+			return JSRectangle(x1, y1, x2 - x1, y2 - y1);
+		}
+
+		JSRectangle Union(const JSRectangle& a, const JSRectangle& b) {
+			if (IsEmpty(a)) { return b; }
+			if (IsEmpty(b)) { return a; }
+			int x1 = std::min(a.x, b.x);
+			int y1 = std::min(a.y, b.y);
+			int x2 = std::max(a.x + a.width, b.x + b.width);
+			int y2 = std::max(a.y + a.height, b.y + b.height);
+			return JSRectangle(x1, y1, x2 - x1, y2 - y1);
+		}
+
+		void FillRect(uint32_t* data, int stride, const JSRectangle& rect, uint32_t color, const JSRectangle& clip) {
+			JSRectangle r = Intersect(rect, clip);
+			for (int y = r.y; y < r.y + r.height; y++) {
+				std::fill_n(data + (size_t)y * stride + r.x, r.width, color);
+			}
+		}
+
+		// Core fonts are addressed with single bytes, which map to the first 256 unicode code points
+		std::string ToLatin1(const std::string& utf8) {
+			std::string out;
+			for (size_t i = 0; i < utf8.size();) {
+				uint8_t c = utf8[i];
+				uint32_t code = '?';
+				size_t len = 1;
+				if (c < 0x80) { code = c; }
+				else if ((c & 0xE0) == 0xC0 && i + 1 < utf8.size()) { code = ((c & 0x1F) << 6) | (utf8[i + 1] & 0x3F); len = 2; }
+				else if ((c & 0xF0) == 0xE0) { len = 3; }
+				else if ((c & 0xF8) == 0xF0) { len = 4; }
+				out.push_back(code < 0x100 ? (char)code : '?');
+				i += len;
+			}
+			return out;
+		}
+	}
+
+	XOverlay::XOverlay(xcb_connection_t* c, xcb_screen_t* screen) : connection(c), screen(screen) {
+		// Transparency needs a 32 bit visual, these are only available when a compositor is running
+		xcb_depth_iterator_t depths = xcb_screen_allowed_depths_iterator(screen);
+		for (; depths.rem && !this->visual; xcb_depth_next(&depths)) {
+			if (depths.data->depth != 32) {
+				continue;
+			}
+			xcb_visualtype_iterator_t visuals = xcb_depth_visuals_iterator(depths.data);
+			for (; visuals.rem; xcb_visualtype_next(&visuals)) {
+				if (visuals.data->_class == XCB_VISUAL_CLASS_TRUE_COLOR) {
+					this->visual = visuals.data->visual_id;
+					break;
+				}
+			}
+		}
+		if (!this->visual) {
+			throw std::runtime_error("No 32 bit visual available for the native overlay");
+		}
+
+		this->colormap = xcb_generate_id(c);
+		xcb_create_colormap(c, XCB_COLORMAP_ALLOC_NONE, this->colormap, screen->root, this->visual);
+
+		this->window = xcb_generate_id(c);
+		const uint32_t values[] = { 0, 0, 1, this->colormap };
+		xcb_create_window(c, 32, this->window, screen->root, 0, 0, 1, 1, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT, this->visual,
+			XCB_CW_BACK_PIXEL | XCB_CW_BORDER_PIXEL | XCB_CW_OVERRIDE_REDIRECT | XCB_CW_COLORMAP, values);
+
+		this->gc = xcb_generate_id(c);
+		xcb_create_gc(c, this->gc, this->window, 0, NULL);
+
+		xcb_shm_query_version_reply_t* version = xcb_shm_query_version_reply(c, xcb_shm_query_version(c), NULL);
+		this->sharedPixmaps = version && version->shared_pixmaps;
+		free(version);
+	}
+
+	XOverlay::~XOverlay() {
+		freeBuffers();
+		for (auto& font : this->fonts) {
+			xcb_close_font(this->connection, font.second.font);
+		}
+		xcb_free_gc(this->connection, this->gc);
+		xcb_destroy_window(this->connection, this->window);
+		xcb_free_colormap(this->connection, this->colormap);
+		xcb_flush(this->connection);
+	}
+
+	void XOverlay::allocBuffers() {
+		size_t size = (size_t)this->bounds.width * this->bounds.height * 4;
+		for (Buffer& buf : this->buffers) {
+			buf.shmId = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+			if (buf.shmId == -1) {
+				throw std::runtime_error("Fail to allocate overlay SHM");
+			}
+			void* data = shmat(buf.shmId, NULL, 0);
+			if (data == (void*)-1) {
+				shmctl(buf.shmId, IPC_RMID, NULL);
+				buf.shmId = -1;
+				throw std::runtime_error("Cannot attach to overlay SHM");
+			}
+			buf.data = reinterpret_cast<uint32_t*>(data);
+			memset(buf.data, 0, size);
+			buf.seg = xcb_generate_id(this->connection);
+			xcb_shm_attach(this->connection, buf.seg, buf.shmId, 0);
+			buf.pixmap = xcb_generate_id(this->connection);
+			if (this->sharedPixmaps) {
+				xcb_shm_create_pixmap(this->connection, buf.pixmap, this->window, this->bounds.width, this->bounds.height, 32, buf.seg, 0);
+			} else {
+				xcb_create_pixmap(this->connection, 32, buf.pixmap, this->window, this->bounds.width, this->bounds.height);
+			}
+			buf.stale = JSRectangle(0, 0, this->bounds.width, this->bounds.height);
+		}
+	}
+
+	void XOverlay::freeBuffers() {
+		for (Buffer& buf : this->buffers) {
+			if (buf.data == NULL) {
+				continue;
+			}
+			waitFence(buf);
+			xcb_free_pixmap(this->connection, buf.pixmap);
+			xcb_shm_detach(this->connection, buf.seg);
+			shmdt(buf.data);
+			shmctl(buf.shmId, IPC_RMID, NULL);
+			buf = Buffer();
+		}
+	}
+
+	void XOverlay::waitFence(Buffer& buf) {
+		if (buf.fencePending) {
+			free(xcb_get_input_focus_reply(this->connection, buf.fence, NULL));
+			buf.fencePending = false;
+		}
+	}
+
+	const XOverlay::FontInfo& XOverlay::getFont(int size) {
+		// pt to px at 96dpi, rounded down to a size that misc-fixed comes in
+		static const int pixelSizes[] = { 6, 7, 8, 9, 10, 12, 13, 14, 15, 18, 20 };
+		int target = size * 4 / 3;
+		int pixels = pixelSizes[0];
+		for (int s : pixelSizes) {
+			if (s <= target) { pixels = s; }
+		}
+		auto cached = this->fonts.find(pixels);
+		if (cached != this->fonts.end()) {
+			return cached->second;
+		}
+
+		char name[64];
+		snprintf(name, sizeof(name), "-misc-fixed-medium-r-*--%d-*-*-*-*-*-iso10646-1", pixels);
+		xcb_font_t font = xcb_generate_id(this->connection);
+		xcb_generic_error_t* error = xcb_request_check(this->connection, xcb_open_font_checked(this->connection, font, strlen(name), name));
+		if (error) {
+			free(error);
+			xcb_open_font(this->connection, font, strlen("fixed"), "fixed");
+		}
+		xcb_query_font_reply_t* query = xcb_query_font_reply(this->connection, xcb_query_font(this->connection, font), NULL);
+		FontInfo info = { font, 10, 3, 6 };
+		if (query) {
+			info.ascent = query->font_ascent;
+			info.descent = query->font_descent;
+			info.charWidth = query->max_bounds.character_width;
+			free(query);
+		}
+		return this->fonts.emplace(pixels, info).first->second;
+	}
+
+	JSRectangle XOverlay::primitiveBounds(const OverlayPrimitive& prim) {
+		switch (prim.type) {
+			case OverlayPrimitiveType::Line: {
+				int lw = std::max(1, prim.linewidth);
+				int x = std::min(prim.x1, prim.x2) - lw;
+				int y = std::min(prim.y1, prim.y2) - lw;
+				return JSRectangle(x, y, std::abs(prim.x2 - prim.x1) + lw * 2 + 1, std::abs(prim.y2 - prim.y1) + lw * 2 + 1);
+			}
+			case OverlayPrimitiveType::Rect:
+			case OverlayPrimitiveType::Sprite:
+				return JSRectangle(prim.x1, prim.y1, prim.x2 - prim.x1, prim.y2 - prim.y1);
+			case OverlayPrimitiveType::Text: {
+				const FontInfo& font = getFont(prim.size);
+				// +1 for the shadow offset
+				int w = font.charWidth * (int)ToLatin1(prim.text).size() + 1;
+				int h = font.ascent + font.descent + 1;
+				if (prim.center) {
+					return JSRectangle(prim.x1 - w / 2, prim.y1 - h / 2, w, h);
+				}
+				return JSRectangle(prim.x1, prim.y1, w, h);
+			}
+		}
+		return JSRectangle(0, 0, 0, 0);
+	}
+
+	void XOverlay::rasterize(Buffer& buf, const OverlayPrimitive& prim, const JSRectangle& clip) {
+		uint32_t color = 0xFF000000 | (prim.color & 0xFFFFFF);
+		int lw = std::max(1, prim.linewidth);
+		int stride = this->bounds.width;
+		if (prim.type == OverlayPrimitiveType::Rect) {
+			// stroke on the inside of the rect, same as the canvas overlay
+			int w = prim.x2 - prim.x1;
+			int h = prim.y2 - prim.y1;
+			FillRect(buf.data, stride, JSRectangle(prim.x1, prim.y1, w, lw), color, clip);
+			FillRect(buf.data, stride, JSRectangle(prim.x1, prim.y2 - lw, w, lw), color, clip);
+			FillRect(buf.data, stride, JSRectangle(prim.x1, prim.y1 + lw, lw, h - lw * 2), color, clip);
+			FillRect(buf.data, stride, JSRectangle(prim.x2 - lw, prim.y1 + lw, lw, h - lw * 2), color, clip);
+		} else if (prim.type == OverlayPrimitiveType::Line) {
+			// bresenham with a square pen
+			int x = prim.x1, y = prim.y1;
+			int dx = std::abs(prim.x2 - prim.x1), sx = (prim.x1 < prim.x2 ? 1 : -1);
+			int dy = -std::abs(prim.y2 - prim.y1), sy = (prim.y1 < prim.y2 ? 1 : -1);
+			int err = dx + dy;
+			while (true) {
+				FillRect(buf.data, stride, JSRectangle(x - lw / 2, y - lw / 2, lw, lw), color, clip);
+				if (x == prim.x2 && y == prim.y2) { break; }
+				int e2 = 2 * err;
+				if (e2 >= dy) { err += dy; x += sx; }
+				if (e2 <= dx) { err += dx; y += sy; }
+			}
+		} else if (prim.type == OverlayPrimitiveType::Sprite && prim.sprite) {
+			// source over, both sides are premultiplied
+			int w = prim.x2 - prim.x1;
+			JSRectangle r = Intersect(primitiveBounds(prim), clip);
+			for (int y = r.y; y < r.y + r.height; y++) {
+				const uint32_t* src = prim.sprite->data() + (size_t)(y - prim.y1) * w + (r.x - prim.x1);
+				uint32_t* dst = buf.data + (size_t)y * stride + r.x;
+				for (int x = 0; x < r.width; x++) {
+					uint32_t s = src[x];
+					uint32_t inv = 255 - (s >> 24);
+					if (inv == 255) { continue; }
+					uint32_t d = dst[x];
+					uint32_t rb = (((d & 0xFF00FF) * inv + 0x800080) >> 8) & 0xFF00FF;
+					uint32_t ag = ((((d >> 8) & 0xFF00FF) * inv + 0x800080) >> 8) & 0xFF00FF;
+					dst[x] = s + (rb | (ag << 8));
+				}
+			}
+		}
+	}
+
+	void XOverlay::drawText(Buffer& buf, const OverlayPrimitive& prim, const JSRectangle& clip) {
+		const FontInfo& font = getFont(prim.size);
+		std::string text = ToLatin1(prim.text);
+		JSRectangle area = primitiveBounds(prim);
+		int baseline = area.y + font.ascent;
+
+		// poly text items hold at most 254 characters each
+		std::vector<uint8_t> items;
+		for (size_t i = 0; i < text.size(); i += 254) {
+			size_t len = std::min<size_t>(254, text.size() - i);
+			items.push_back((uint8_t)len);
+			items.push_back(0);
+			items.insert(items.end(), text.begin() + i, text.begin() + i + len);
+		}
+		if (items.empty()) {
+			return;
+		}
+		auto draw = [&](uint32_t color, int offset) {
+			const uint32_t values[] = { color, font.font };
+			xcb_change_gc(this->connection, this->gc, XCB_GC_FOREGROUND | XCB_GC_FONT, values);
+			xcb_poly_text_8(this->connection, buf.pixmap, this->gc, area.x + offset, baseline + offset, items.size(), items.data());
+		};
+		if (prim.shadow) {
+			draw(0xFF000000, 1);
+		}
+		draw(0xFF000000 | (prim.color & 0xFFFFFF), 0);
+	}
+
+	void XOverlay::setBounds(const JSRectangle& newBounds) {
+		JSRectangle b(newBounds.x, newBounds.y, std::max(1, newBounds.width), std::max(1, newBounds.height));
+		if (b.x == this->bounds.x && b.y == this->bounds.y && b.width == this->bounds.width && b.height == this->bounds.height) {
+			return;
+		}
+		bool resized = b.width != this->bounds.width || b.height != this->bounds.height;
+		if (resized) {
+			freeBuffers();
+		}
+		this->bounds = b;
+		if (resized) {
+			allocBuffers();
+		}
+		const uint32_t values[] = { (uint32_t)b.x, (uint32_t)b.y, (uint32_t)b.width, (uint32_t)b.height };
+		xcb_configure_window(this->connection, this->window, XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y | XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, values);
+	}
+
+	void XOverlay::draw(const std::vector<OverlayPrimitive>& newPrimitives) {
+		if (this->buffers[0].data == NULL) {
+			return;
+		}
+		// Primitives are compared by index, apps mostly redraw the same list with a few changes
+		JSRectangle dirty(0, 0, 0, 0);
+		size_t count = std::max(this->primitives.size(), newPrimitives.size());
+		for (size_t i = 0; i < count; i++) {
+			bool hasOld = i < this->primitives.size();
+			bool hasNew = i < newPrimitives.size();
+			if (hasOld && hasNew && this->primitives[i] == newPrimitives[i]) {
+				continue;
+			}
+			if (hasOld) { dirty = Union(dirty, primitiveBounds(this->primitives[i])); }
+			if (hasNew) { dirty = Union(dirty, primitiveBounds(newPrimitives[i])); }
+		}
+		this->primitives = newPrimitives;
+
+		JSRectangle full(0, 0, this->bounds.width, this->bounds.height);
+		dirty = Intersect(dirty, full);
+		for (Buffer& buf : this->buffers) {
+			buf.stale = Union(buf.stale, dirty);
+		}
+
+		Buffer& buf = this->buffers[this->backBuffer];
+		JSRectangle clip = buf.stale;
+		if (!IsEmpty(clip)) {
+			waitFence(buf);
+			FillRect(buf.data, this->bounds.width, clip, 0, clip);
+			for (const OverlayPrimitive& prim : this->primitives) {
+				if (prim.type != OverlayPrimitiveType::Text && !IsEmpty(Intersect(primitiveBounds(prim), clip))) {
+					rasterize(buf, prim, clip);
+				}
+			}
+			if (!this->sharedPixmaps) {
+				xcb_shm_put_image(this->connection, buf.pixmap, this->gc, this->bounds.width, this->bounds.height, clip.x, clip.y, clip.width, clip.height,
+					clip.x, clip.y, 32, XCB_IMAGE_FORMAT_Z_PIXMAP, 0, buf.seg, 0);
+			}
+			// Text is drawn server side with core fonts, so it ends up on top of the other primitives
+			xcb_rectangle_t cliprect = { (int16_t)clip.x, (int16_t)clip.y, (uint16_t)clip.width, (uint16_t)clip.height };
+			xcb_set_clip_rectangles(this->connection, XCB_CLIP_ORDERING_UNSORTED, this->gc, 0, 0, 1, &cliprect);
+			for (const OverlayPrimitive& prim : this->primitives) {
+				if (prim.type == OverlayPrimitiveType::Text && !IsEmpty(Intersect(primitiveBounds(prim), clip))) {
+					drawText(buf, prim, clip);
+				}
+			}
+			xcb_copy_area(this->connection, buf.pixmap, this->window, this->gc, clip.x, clip.y, clip.x, clip.y, clip.width, clip.height);
+			// Let the server repaint exposed areas from the buffer that is now on screen
+			xcb_change_window_attributes(this->connection, this->window, XCB_CW_BACK_PIXMAP, &buf.pixmap);
+			buf.fence = xcb_get_input_focus(this->connection);
+			buf.fencePending = true;
+			buf.stale = JSRectangle(0, 0, 0, 0);
+			this->backBuffer ^= 1;
+		}
+
+		if (!this->mapped) {
+			xcb_map_window(this->connection, this->window);
+			this->mapped = true;
+		}
+	}
+}
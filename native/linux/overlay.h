@@ -0,0 +1,65 @@
+#pragma once
+#include <map>
+#include <vector>
+#include <xcb/xcb.h>
+#include <xcb/shm.h>
+#include "../os.h"
+
+namespace priv_os_x11 {
+	/**
+	 * Override-redirect ARGB window that primitives are rasterized onto. Drawing happens in two MIT-SHM backed
+	 * pixmaps that are presented alternately, only the area that changed since a buffer was last presented is redrawn.
+	 */
+	class XOverlay {
+		xcb_connection_t* connection;
+	public:
+		XOverlay(xcb_connection_t* c, xcb_screen_t* screen);
+		~XOverlay();
+
+		// Move the overlay, buffers are reallocated and fully redrawn when the size changes
+		void setBounds(const JSRectangle& bounds);
+		// Replace the drawn primitives and present the changed area
+		void draw(const std::vector<OverlayPrimitive>& primitives);
+
+		xcb_window_t window;
+
+	private:
+		struct Buffer {
+			int shmId = -1;
+			uint32_t* data = NULL;
+			xcb_shm_seg_t seg = 0;
+			xcb_pixmap_t pixmap = 0;
+			// area that changed since this buffer was last presented
+			JSRectangle stale = JSRectangle(0, 0, 0, 0);
+			// round-trip issued after the last present, the server is done with the buffer once it is answered
+			xcb_get_input_focus_cookie_t fence = {};
+			bool fencePending = false;
+		};
+		struct FontInfo {
+			xcb_font_t font;
+			int ascent;
+			int descent;
+			int charWidth;
+		};
+
+		void allocBuffers();
+		void freeBuffers();
+		void waitFence(Buffer& buf);
+		const FontInfo& getFont(int size);
+		JSRectangle primitiveBounds(const OverlayPrimitive& prim);
+		void rasterize(Buffer& buf, const OverlayPrimitive& prim, const JSRectangle& clip);
+		void drawText(Buffer& buf, const OverlayPrimitive& prim, const JSRectangle& clip);
+
+		xcb_screen_t* screen;
+		xcb_visualid_t visual = 0;
+		xcb_colormap_t colormap = 0;
+		xcb_gcontext_t gc = 0;
+		bool sharedPixmaps = false;
+		bool mapped = false;
+		JSRectangle bounds = JSRectangle(0, 0, 0, 0);
+		Buffer buffers[2];
+		int backBuffer = 0;
+		std::vector<OverlayPrimitive> primitives;
+		std::map<int, FontInfo> fonts;
+	};
+}
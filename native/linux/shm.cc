@@ -1,59 +1,258 @@
 #include <assert.h>
+#include <algorithm>
 #include <stdexcept>
 #include <cstring>
+#include <deque>
 #include <memory>
 #include <sys/ipc.h>
 #include <sys/shm.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
 #include <xcb/shm.h>
 #include "shm.h"
 
 namespace priv_os_x11 {
-	XShmCapture::XShmCapture(xcb_connection_t* c, xcb_drawable_t d) : connection(c), drawable(d), geometry(NULL, &free) {
-		xcb_get_geometry_cookie_t cookie = xcb_get_geometry_unchecked(c, d);
-		geometry = std::unique_ptr<xcb_get_geometry_reply_t, decltype(&free)> { xcb_get_geometry_reply(c, cookie, NULL), &free };
+	XShmCapture::XShmCapture(xcb_connection_t* c) : connection(c) {}
+
+	XShmCapture::~XShmCapture() {
+		release();
+	}
+
+	// Tiles of a chunked capture are sized for replies of about this many bytes, with a few in flight at once so
+	// the transfer of one overlaps the round trip of the next
+	static constexpr size_t chunkBytes = 256 * 1024;
+	static constexpr size_t maxChunksInFlight = 8;
+
+	// fds can only be passed over a unix socket, libxcb shuts the connection down when it fails
+	static bool IsUnixSocket(int fd) {
+		sockaddr_storage addr;
+		socklen_t len = sizeof(addr);
+		if (getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) == -1) {
+			return false;
+		}
+		return addr.ss_family == AF_UNIX;
+	}
+
+	void XShmCapture::release() {
+		if (this->shm == NULL) {
+			return;
+		}
+		if (this->shmId != -1) {
+			shmdt(this->shm);
+			shmctl(this->shmId, IPC_RMID, NULL);
+		} else {
+			munmap(this->shm, this->shmSize);
+		}
+		xcb_shm_detach(this->connection, this->shmSeg);
+		this->shm = NULL;
+		this->shmId = -1;
+		this->shmSize = 0;
+	}
+
+	void XShmCapture::selectTransport() {
+		this->currentTransport = CaptureTransport::GetImage;
+		const xcb_query_extension_reply_t* ext = xcb_get_extension_data(this->connection, &xcb_shm_id);
+		if (!ext || !ext->present) {
+			return;
+		}
+		xcb_shm_query_version_cookie_t cookie = xcb_shm_query_version(this->connection);
+		std::unique_ptr<xcb_shm_query_version_reply_t, decltype(&free)> version { xcb_shm_query_version_reply(this->connection, cookie, NULL), &free };
+		if (!version) {
+			return;
+		}
+		this->fdShmSupported = (version->major_version > 1 || version->minor_version >= 2) && IsUnixSocket(xcb_get_file_descriptor(this->connection));
+		// the extension being there doesn't mean the server can reach our memory, allocation finds that out
+		this->currentTransport = CaptureTransport::SysVShm;
+	}
+
+	bool XShmCapture::allocateSysV(size_t size) {
+		int id = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+		if (id == -1) {
+			return false;
+		}
+		char* mem = reinterpret_cast<char*>(shmat(id, NULL, SHM_RDONLY));
+		if (mem == (char*)-1) {
+			shmctl(id, IPC_RMID, NULL);
+			return false;
+		}
+		xcb_shm_seg_t seg = xcb_generate_id(this->connection);
+		std::unique_ptr<xcb_generic_error_t, decltype(&free)> error { xcb_request_check(this->connection, xcb_shm_attach_checked(this->connection, seg, id, 0)), &free };
+		if (error) {
+			shmdt(mem);
+			shmctl(id, IPC_RMID, NULL);
+			return false;
+		}
+		this->shmId = id;
+		this->shm = mem;
+		this->shmSize = size;
+		this->shmSeg = seg;
+		return true;
+	}
+
+	bool XShmCapture::allocateFd(size_t size) {
+		int fd = memfd_create("alt1-capture", MFD_CLOEXEC);
+		if (fd == -1) {
+			return false;
+		}
+		if (ftruncate(fd, size) == -1) {
+			close(fd);
+			return false;
+		}
+		void* mem = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		if (mem == MAP_FAILED) {
+			close(fd);
+			return false;
+		}
+		// xcb takes ownership of the fd
+		xcb_shm_seg_t seg = xcb_generate_id(this->connection);
+		std::unique_ptr<xcb_generic_error_t, decltype(&free)> error { xcb_request_check(this->connection, xcb_shm_attach_fd_checked(this->connection, seg, fd, 0)), &free };
+		if (error) {
+			munmap(mem, size);
+			return false;
+		}
+		this->shmId = -1;
+		this->shm = reinterpret_cast<char*>(mem);
+		this->shmSize = size;
+		this->shmSeg = seg;
+		return true;
+	}
+
+	void XShmCapture::ensureSegment(size_t size) {
+		if (size <= this->shmSize) {
+			return;
+		}
+		release();
+		// a failed allocation moves on to the next transport for good, whatever caused it won't go away
+		if (this->currentTransport == CaptureTransport::SysVShm) {
+			if (allocateSysV(size)) {
+				return;
+			}
+			this->currentTransport = (this->fdShmSupported ? CaptureTransport::FdShm : CaptureTransport::GetImage);
+		}
+		if (this->currentTransport == CaptureTransport::FdShm) {
+			if (allocateFd(size)) {
+				return;
+			}
+			this->currentTransport = CaptureTransport::GetImage;
+		}
+	}
+
+	bool XShmCapture::capture(xcb_drawable_t d) {
+		xcb_get_geometry_cookie_t cookie = xcb_get_geometry_unchecked(this->connection, d);
+		std::unique_ptr<xcb_get_geometry_reply_t, decltype(&free)> geometry { xcb_get_geometry_reply(this->connection, cookie, NULL), &free };
 		if (!geometry) {
-			throw new std::runtime_error("Unable to get image size");
+			return false;
+		}
+		return fetch(d, geometry->width, geometry->height, 0, 0, geometry->width, geometry->height);
+	}
+
+	bool XShmCapture::captureArea(xcb_drawable_t d, int x, int y, int w, int h) {
+		xcb_get_geometry_cookie_t cookie = xcb_get_geometry_unchecked(this->connection, d);
+		std::unique_ptr<xcb_get_geometry_reply_t, decltype(&free)> geometry { xcb_get_geometry_reply(this->connection, cookie, NULL), &free };
+		if (!geometry) {
+			return false;
+		}
+		return fetch(d, geometry->width, geometry->height, x, y, w, h);
+	}
+
+	bool XShmCapture::fetch(xcb_drawable_t d, int dwidth, int dheight, int x, int y, int w, int h) {
+		this->width = w;
+		this->height = h;
+		// get_image fails on areas that aren't fully inside the drawable, only fetch the overlap
+		int x1 = std::max(x, 0);
+		int y1 = std::max(y, 0);
+		this->dataX = x1 - x;
+		this->dataY = y1 - y;
+		this->dataWidth = std::max(0, std::min(x + w, dwidth) - x1);
+		this->dataHeight = std::max(0, std::min(y + h, dheight) - y1);
+		if (this->dataWidth == 0 || this->dataHeight == 0) {
+			return true;
 		}
 
-		this->shmId = shmget(IPC_PRIVATE, geometry->width * geometry->height * 4, IPC_CREAT | 0600);
-		if (this->shmId == -1) {
-			throw new std::runtime_error("Fail to allocate SHM");
+		if (this->currentTransport == CaptureTransport::None) {
+			selectTransport();
 		}
-		this->shm = reinterpret_cast<char*>(shmat(this->shmId, NULL, SHM_RDONLY));
-		if (this->shm == (char *) -1) {
-			throw new std::runtime_error("Cannot attach to SHM");
+		if (this->currentTransport != CaptureTransport::GetImage) {
+			ensureSegment((size_t)this->dataWidth * this->dataHeight * 4);
+		}
+		if (this->currentTransport == CaptureTransport::GetImage) {
+			fetchChunked(d, x1, y1);
+			return true;
 		}
 
-		this->shmSeg = reinterpret_cast<xcb_shm_seg_t>(xcb_generate_id(c));
-		xcb_shm_attach(c, this->shmSeg, this->shmId, 0);
-		
-		xcb_shm_get_image_cookie_t imageCookie = xcb_shm_get_image(c, d, 0, 0, geometry->width, geometry->height, 0xFFFFFF, XCB_IMAGE_FORMAT_Z_PIXMAP, this->shmSeg, 0);
-		std::unique_ptr<xcb_shm_get_image_reply_t, decltype(&free)> getImageReply { xcb_shm_get_image_reply(c, imageCookie, NULL), &free };
+		xcb_shm_get_image_cookie_t imageCookie = xcb_shm_get_image(this->connection, d, x1, y1, this->dataWidth, this->dataHeight, 0xFFFFFF, XCB_IMAGE_FORMAT_Z_PIXMAP, this->shmSeg, 0);
+		std::unique_ptr<xcb_shm_get_image_reply_t, decltype(&free)> getImageReply { xcb_shm_get_image_reply(this->connection, imageCookie, NULL), &free };
 		if (!getImageReply) {
-			throw new std::runtime_error("Fail to fetch image");
+			throw std::runtime_error("Fail to fetch image");
 		}
+		this->data = this->shm;
+		return true;
 	}
 
-	XShmCapture::~XShmCapture() {
-		shmdt(this->shm);
-		xcb_shm_detach(this->connection, this->shmSeg);
-		shmctl(this->shmId, IPC_RMID, NULL);
+	// Fetches the data area in bands of full rows with pipelined GetImage requests, each band is copied into
+	// place as soon as its reply is in
+	void XShmCapture::fetchChunked(xcb_drawable_t d, int x, int y) {
+		size_t stride = (size_t)this->dataWidth * 4;
+		this->chunkBuffer.resize(stride * this->dataHeight);
+		int rowsPerChunk = (int)std::max<size_t>(1, chunkBytes / stride);
+
+		struct Chunk {
+			xcb_get_image_cookie_t cookie;
+			int row;
+			int rows;
+		};
+		std::deque<Chunk> inFlight;
+		int nextRow = 0;
+		auto request = [&]() {
+			int rows = std::min(rowsPerChunk, this->dataHeight - nextRow);
+			inFlight.push_back({ xcb_get_image(this->connection, XCB_IMAGE_FORMAT_Z_PIXMAP, d, x, y + nextRow, this->dataWidth, rows, 0xFFFFFF), nextRow, rows });
+			nextRow += rows;
+		};
+		auto discardRest = [&]() {
+			for (Chunk& chunk : inFlight) {
+				xcb_discard_reply(this->connection, chunk.cookie.sequence);
+			}
+		};
+
+		while (nextRow < this->dataHeight && inFlight.size() < maxChunksInFlight) {
+			request();
+		}
+		while (!inFlight.empty()) {
+			Chunk chunk = inFlight.front();
+			inFlight.pop_front();
+			std::unique_ptr<xcb_get_image_reply_t, decltype(&free)> reply { xcb_get_image_reply(this->connection, chunk.cookie, NULL), &free };
+			if (!reply) {
+				discardRest();
+				throw std::runtime_error("Fail to fetch image");
+			}
+			size_t size = stride * chunk.rows;
+			if ((size_t)xcb_get_image_data_length(reply.get()) < size) {
+				discardRest();
+				throw std::runtime_error("Unsupported pixel format");
+			}
+			if (nextRow < this->dataHeight) {
+				request();
+			}
+			memcpy(this->chunkBuffer.data() + stride * chunk.row, xcb_get_image_data(reply.get()), size);
+		}
+		this->data = this->chunkBuffer.data();
 	}
 
 	void XShmCapture::copy(char* target, size_t maxLength, int x, int y, int w, int h) {
 		size_t expectedSize = w * h * 4;
 		if (expectedSize > maxLength) {
-			throw new std::invalid_argument("Insufficient buffer size");
+			throw std::invalid_argument("Insufficient buffer size");
 		}
 
 		size_t targetPos = 0;
-		for (int row = y; row < y + h; row++) {
-			for (int col = x; col < x + w; col++) {
-				if (col >= 0 && row >= 0 && col < this->geometry->width && row < this->geometry->height) {
-					int pos = ((row * this->geometry->width) + col) * 4;
-					target[targetPos++] = this->shm[pos + 2];
-					target[targetPos++] = this->shm[pos + 1];
-					target[targetPos++] = this->shm[pos];
+		for (int row = y - this->dataY; row < y + h - this->dataY; row++) {
+			for (int col = x - this->dataX; col < x + w - this->dataX; col++) {
+				if (col >= 0 && row >= 0 && col < this->dataWidth && row < this->dataHeight) {
+					int pos = ((row * this->dataWidth) + col) * 4;
+					target[targetPos++] = this->data[pos + 2];
+					target[targetPos++] = this->data[pos + 1];
+					target[targetPos++] = this->data[pos];
 					target[targetPos++] = 0xFF; // alpha
 				} else {
 					target[targetPos++] = 0;
@@ -65,4 +264,14 @@ namespace priv_os_x11 {
 		}
 		assert(targetPos <= expectedSize);
 	}
+
+	uint32_t XShmCapture::pixel(int x, int y) const {
+		x -= this->dataX;
+		y -= this->dataY;
+		if (x < 0 || y < 0 || x >= this->dataWidth || y >= this->dataHeight) {
+			return 0;
+		}
+		const uint8_t* px = reinterpret_cast<const uint8_t*>(this->data) + ((size_t)y * this->dataWidth + x) * 4;
+		return px[2] | (px[1] << 8) | (px[0] << 16) | 0xFF000000;
+	}
 }
@@ -1,21 +1,70 @@
 #pragma once
+#include <vector>
 #include <xcb/xcb.h>
 #include <xcb/shm.h>
 
 namespace priv_os_x11 {
+	// How image data gets from the server to us, from fastest to most widely available
+	enum class CaptureTransport {
+		// not picked yet, decided on the first capture
+		None,
+		// MIT-SHM with a SysV segment
+		SysVShm,
+		// MIT-SHM 1.2 with a memfd passed over the socket, for when SysV ipc isn't shared with the server
+		FdShm,
+		// plain GetImage replies over the socket, works on remote and SHM-less servers
+		GetImage
+	};
+
+	/**
+	 * Captures drawables into memory through the fastest transport the server supports. The shm segment is kept
+	 * attached between captures and only reallocated when a larger drawable is captured.
+	 */
 	class XShmCapture {
 		xcb_connection_t* connection;
 	public:
-		XShmCapture(xcb_connection_t* c, xcb_drawable_t d);
+		XShmCapture(xcb_connection_t* c);
 		~XShmCapture();
 
+		// Fetch the full contents of d into the segment, returns false if d has no contents (unmapped or destroyed)
+		bool capture(xcb_drawable_t d);
+		// Fetch the area x,y,w,h of d, copy and pixel coordinates are relative to x,y afterwards. Parts of the
+		// area outside of d read as black
+		bool captureArea(xcb_drawable_t d, int x, int y, int w, int h);
 		void copy(char* target, size_t maxLength, int x, int y, int w, int h);
-	
+		// Single pixel of the last capture in rgba byte order, 0 (transparent) when out of bounds
+		uint32_t pixel(int x, int y) const;
+
+		CaptureTransport transport() const { return this->currentTransport; }
+
+		int width = 0;
+		int height = 0;
+
 	private:
-		xcb_drawable_t drawable;
-		int shmId;
-		char* shm;
-		xcb_shm_seg_t shmSeg;
-		std::unique_ptr<xcb_get_geometry_reply_t, decltype(&free)> geometry;
+		void release();
+		bool fetch(xcb_drawable_t d, int dwidth, int dheight, int x, int y, int w, int h);
+		void selectTransport();
+		bool allocateSysV(size_t size);
+		bool allocateFd(size_t size);
+		// make sure the segment holds size bytes, drops to the next transport when that fails
+		void ensureSegment(size_t size);
+		void fetchChunked(xcb_drawable_t d, int x, int y);
+
+		CaptureTransport currentTransport = CaptureTransport::None;
+		bool fdShmSupported = false;
+
+		// part of the captured area that is backed by data, relative to the area
+		int dataX = 0;
+		int dataY = 0;
+		int dataWidth = 0;
+		int dataHeight = 0;
+		// bgrx rows of dataWidth, points into the segment or into chunkBuffer
+		const char* data = NULL;
+
+		int shmId = -1;
+		char* shm = NULL;
+		size_t shmSize = 0;
+		xcb_shm_seg_t shmSeg = 0;
+		std::vector<char> chunkBuffer;
 	};
 }
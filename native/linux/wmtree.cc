@@ -0,0 +1,246 @@
+/**
+ * Builds a synthetic desktop on an otherwise empty X server (usually Xvfb) for the window management benchmark in
+ * bench/wmbench.ts. Every client is wrapped in nested frames the way reparenting window managers do it, a stack of
+ * unframed shaped windows with a hole covers the target and rs class decoys give OSGetRsHandles something to reject.
+ *
+ * Commands arrive on stdin one per line, every reply is a single line of json on stdout
+ *   click      left click in the middle of the target through XTEST, replies with the CLOCK_MONOTONIC send time
+ *   churn n    create n rs class clients and frame them like a window manager would
+ *   clear      destroy the churned clients again
+ *   quit
+ * churn and clear reply with the send times of their first and last request
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <time.h>
+#include <xcb/xcb.h>
+#include <xcb/shape.h>
+#include <xcb/xtest.h>
+
+namespace {
+	struct Options {
+		int windows = 2000;
+		int depth = 3;
+		int shaped = 100;
+		int decoys = 200;
+	};
+
+	xcb_connection_t* connection;
+	xcb_screen_t* screen;
+
+	// the class part is what IsRsWindow compares, instance and class are both nul terminated
+	const char rsClass[] = "rs2client\0RuneScape";
+	const char fillerClass[] = "wmtree\0WmTree";
+
+	uint64_t MonotonicNs() {
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+	}
+
+	// fixed seed, runs with the same options build the same tree
+	uint32_t randomState = 12345;
+	int Random(int max) {
+		randomState = randomState * 1103515245 + 12345;
+		return (int)((randomState >> 8) % (uint32_t)std::max(1, max));
+	}
+
+	xcb_window_t CreateWindow(xcb_window_t parent, int x, int y, int w, int h) {
+		xcb_window_t window = xcb_generate_id(connection);
+		const uint32_t values[] = { screen->black_pixel };
+		xcb_create_window(connection, XCB_COPY_FROM_PARENT, window, parent, x, y, w, h, 0,
+			XCB_WINDOW_CLASS_INPUT_OUTPUT, screen->root_visual, XCB_CW_BACK_PIXEL, values);
+		return window;
+	}
+
+	void SetClass(xcb_window_t window, const char* cls, size_t length) {
+		xcb_change_property(connection, XCB_PROP_MODE_REPLACE, window, XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, 8, length, cls);
+	}
+
+	// Nested frames like a reparenting window manager creates them, the outer one at x,y. Returns the innermost frame,
+	// a client of w*h goes at 0,0 in it. Both are the root window when levels is 0
+	xcb_window_t CreateFrames(int levels, int x, int y, int w, int h, xcb_window_t* outer = nullptr) {
+		xcb_window_t parent = screen->root;
+		if (outer) { *outer = parent; }
+		for (int level = 0; level < levels; level++) {
+			// every level adds a border and the outer one a title bar
+			int inset = levels - level;
+			int top = (level == 0 ? 20 : 2);
+			xcb_window_t frame = CreateWindow(parent, (level == 0 ? x : 2), (level == 0 ? y : top), w + inset * 4, h + inset * 4 + top);
+			xcb_map_window(connection, frame);
+			if (outer && level == 0) { *outer = frame; }
+			parent = frame;
+		}
+		return parent;
+	}
+
+	// Client of w*h in levels frames, mapped, returns the client
+	xcb_window_t CreateClient(int levels, int x, int y, int w, int h, const char* cls, size_t classLength) {
+		xcb_window_t parent = CreateFrames(levels, x, y, w, h);
+		xcb_window_t client = CreateWindow(parent, 0, 0, w, h);
+		SetClass(client, cls, classLength);
+		xcb_map_window(connection, client);
+		return client;
+	}
+
+	struct Desktop {
+		xcb_window_t target = 0;
+		int clickX = 0;
+		int clickY = 0;
+		int windowCount = 0;
+	};
+
+	Desktop BuildDesktop(const Options& options) {
+		Desktop desktop;
+		int sw = screen->width_in_pixels;
+		int sh = screen->height_in_pixels;
+		int perClient = options.depth + 1;
+
+		// filler clients all over the screen, below everything else
+		for (int i = 0; i < options.windows; i++) {
+			int w = 100 + Random(300);
+			int h = 80 + Random(250);
+			CreateClient(options.depth, Random(sw - w), Random(sh - h), w, h, fillerClass, sizeof(fillerClass));
+			desktop.windowCount += perClient;
+		}
+
+		// decoys with the rs class, popups are rejected by WM_TRANSIENT_FOR and the shallow ones by their depth
+		for (int i = 0; i < options.decoys; i++) {
+			bool popup = i % 2 == 0 || options.depth == 0;
+			int levels = (popup ? options.depth : std::max(0, options.depth - 1));
+			xcb_window_t decoy = CreateClient(levels, Random(sw - 200), Random(sh - 150), 200, 150, rsClass, sizeof(rsClass));
+			if (popup) {
+				xcb_change_property(connection, XCB_PROP_MODE_REPLACE, decoy, XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, 32, 1, &screen->root);
+			}
+			desktop.windowCount += levels + 1;
+		}
+
+		// the rs client in the middle of the screen
+		int tw = std::min(800, sw / 2);
+		int th = std::min(600, sh / 2);
+		desktop.target = CreateClient(options.depth, (sw - tw) / 2, (sh - th) / 2, tw, th, rsClass, sizeof(rsClass));
+		desktop.windowCount += perClient;
+		desktop.clickX = sw / 2;
+		desktop.clickY = sh / 2;
+
+		// shaped windows stacked on top of it, the hole around the click point makes the hit test look at every shape.
+		// They have no frames, like shaped popups and docks, an unshaped frame around them would catch the click
+		for (int i = 0; i < options.shaped; i++) {
+			int size = 200 + Random(200);
+			int x = desktop.clickX - size / 2 + Random(40) - 20;
+			int y = desktop.clickY - size / 2 + Random(40) - 20;
+			xcb_window_t window = CreateClient(0, x, y, size, size, fillerClass, sizeof(fillerClass));
+			int hx = desktop.clickX - x - 10;
+			int hy = desktop.clickY - y - 10;
+			const xcb_rectangle_t ring[] = {
+				{ 0, 0, (uint16_t)size, (uint16_t)hy },
+				{ 0, (int16_t)hy, (uint16_t)hx, 20 },
+				{ (int16_t)(hx + 20), (int16_t)hy, (uint16_t)(size - hx - 20), 20 },
+				{ 0, (int16_t)(hy + 20), (uint16_t)size, (uint16_t)(size - hy - 20) }
+			};
+			xcb_shape_rectangles(connection, XCB_SHAPE_SO_SET, XCB_SHAPE_SK_BOUNDING, XCB_CLIP_ORDERING_UNSORTED, window, 0, 0, 4, ring);
+			xcb_shape_rectangles(connection, XCB_SHAPE_SO_SET, XCB_SHAPE_SK_INPUT, XCB_CLIP_ORDERING_UNSORTED, window, 0, 0, 4, ring);
+			desktop.windowCount += 1;
+		}
+
+		// make sure everything exists before anyone looks at it
+		free(xcb_get_input_focus_reply(connection, xcb_get_input_focus(connection), NULL));
+		return desktop;
+	}
+
+	void Click(const Desktop& desktop) {
+		xcb_test_fake_input(connection, XCB_MOTION_NOTIFY, 0, XCB_CURRENT_TIME, screen->root, desktop.clickX, desktop.clickY, 0);
+		uint64_t time = MonotonicNs();
+		xcb_test_fake_input(connection, XCB_BUTTON_PRESS, 1, XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+		xcb_test_fake_input(connection, XCB_BUTTON_RELEASE, 1, XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+		xcb_flush(connection);
+		printf("{\"clicked\":%llu}\n", (unsigned long long)time);
+	}
+
+	// outer frames of the churned clients, destroying one takes the client with it
+	std::vector<xcb_window_t> churned;
+
+	// Creates clients at the root and reparents them into fresh frames like a window manager does when they map,
+	// every reparent is a new rs window for the window thread
+	void Churn(const Options& options, int count) {
+		uint64_t start = MonotonicNs();
+		for (int i = 0; i < count; i++) {
+			xcb_window_t client = CreateWindow(screen->root, 0, 0, 320, 240);
+			SetClass(client, rsClass, sizeof(rsClass));
+			xcb_window_t outer;
+			xcb_window_t frame = CreateFrames(options.depth, Random(screen->width_in_pixels - 320), Random(screen->height_in_pixels - 240), 320, 240, &outer);
+			xcb_reparent_window(connection, client, frame, 0, 0);
+			xcb_map_window(connection, client);
+			churned.push_back(options.depth == 0 ? client : outer);
+		}
+		xcb_flush(connection);
+		printf("{\"churned\":%d,\"start\":%llu,\"end\":%llu}\n", count, (unsigned long long)start, (unsigned long long)MonotonicNs());
+	}
+
+	void Clear() {
+		uint64_t start = MonotonicNs();
+		for (xcb_window_t frame : churned) {
+			xcb_destroy_window(connection, frame);
+		}
+		xcb_flush(connection);
+		printf("{\"cleared\":%zu,\"start\":%llu,\"end\":%llu}\n", churned.size(), (unsigned long long)start, (unsigned long long)MonotonicNs());
+		churned.clear();
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options) {
+		for (int i = 1; i + 1 < argc; i += 2) {
+			std::string name = argv[i];
+			int value = atoi(argv[i + 1]);
+			if (value < 0) { return false; }
+			if (name == "--windows") { options.windows = value; }
+			else if (name == "--depth") { options.depth = value; }
+			else if (name == "--shaped") { options.shaped = value; }
+			else if (name == "--decoys") { options.decoys = value; }
+			else { return false; }
+		}
+		return argc % 2 == 1;
+	}
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	if (!ParseOptions(argc, argv, options)) {
+		fprintf(stderr, "usage: %s [--windows n] [--depth n] [--shaped n] [--decoys n]\n", argv[0]);
+		return 2;
+	}
+	connection = xcb_connect(NULL, NULL);
+	if (xcb_connection_has_error(connection)) {
+		fprintf(stderr, "wmtree: cannot connect to the X server\n");
+		return 1;
+	}
+	screen = xcb_setup_roots_iterator(xcb_get_setup(connection)).data;
+
+	Desktop desktop = BuildDesktop(options);
+	printf("{\"ready\":true,\"target\":%u,\"clickX\":%d,\"clickY\":%d,\"windows\":%d}\n", desktop.target, desktop.clickX, desktop.clickY, desktop.windowCount);
+	fflush(stdout);
+
+	char line[256];
+	while (fgets(line, sizeof(line), stdin)) {
+		int count = 0;
+		if (strncmp(line, "click", 5) == 0) {
+			Click(desktop);
+		} else if (sscanf(line, "churn %d", &count) == 1) {
+			Churn(options, count);
+		} else if (strncmp(line, "clear", 5) == 0) {
+			Clear();
+		} else if (strncmp(line, "quit", 4) == 0) {
+			break;
+		} else {
+			printf("{\"error\":\"unknown command\"}\n");
+		}
+		fflush(stdout);
+	}
+	xcb_disconnect(connection);
+	return 0;
+}
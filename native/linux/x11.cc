@@ -2,8 +2,15 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <future>
 #include <shared_mutex>
+#include <xcb/shm.h>
+#include <xcb/composite.h>
+#include <xcb/damage.h>
+#include <xcb/shape.h>
+#include <xcb/record.h>
 #include "x11.h"
 
 using namespace std;
@@ -17,48 +24,131 @@ namespace priv_os_x11 {
 	std::map<std::string, xcb_atom_t> atoms;
 	std::shared_mutex atoms_mtx;
 
+	// Result of a connection attempt, only published to the globals by ensureConnection
+	struct PendingConnection {
+		xcb_connection_t* connection = NULL;
+		xcb_window_t rootWindow = 0;
+		xcb_ewmh_connection_t ewmh;
+		std::string error;
+	};
+	// connection set up in the background by startConnection, consumed by the first ensureConnection
+	std::future<PendingConnection> pendingConnection;
+
+	// Extensions that are queried on first use anyway, their replies arrive along with the atoms
+	static xcb_extension_t* const prefetchExtensions[] = { &xcb_shm_id, &xcb_composite_id, &xcb_damage_id, &xcb_shape_id, &xcb_record_id };
+
+	static PendingConnection openConnection() {
+		PendingConnection result;
+		xcb_connection_t* conn = xcb_connect(NULL, NULL);
+		if (xcb_connection_has_error(conn)) {
+			xcb_disconnect(conn);
+			result.error = "Cannot initiate xcb connection";
+			return result;
+		}
+
+		xcb_screen_t *screen = xcb_setup_roots_iterator(xcb_get_setup(conn)).data;
+		if (!screen) {
+			xcb_disconnect(conn);
+			result.error = "Cannot iterate screens";
+			return result;
+		}
+		// all requests go out before the first reply is read, so the setup costs a single round trip
+		xcb_intern_atom_cookie_t* ewmhCookies = xcb_ewmh_init_atoms(conn, &result.ewmh);
+		for (xcb_extension_t* ext : prefetchExtensions) {
+			xcb_prefetch_extension_data(conn, ext);
+		}
+		if (xcb_ewmh_init_atoms_replies(&result.ewmh, ewmhCookies, NULL) == 0) {
+			xcb_disconnect(conn);
+			result.error = "Cannot prepare ewmh atoms";
+			return result;
+		}
+		result.connection = conn;
+		result.rootWindow = screen->root;
+		return result;
+	}
+
+	void startConnection() {
+		std::lock_guard<std::mutex> lock(conn_mtx);
+		if (connection != NULL || pendingConnection.valid()) {
+			return;
+		}
+		pendingConnection = std::async(std::launch::async, openConnection);
+	}
+
 	void ensureConnection() {
 		std::lock_guard<std::mutex> lock(conn_mtx);
 		if (connection != NULL) {
 			return;
 		}
 
-		connection = xcb_connect(NULL, NULL);
-		if (xcb_connection_has_error(connection)) {
-			throw new std::runtime_error("Cannot initiate xcb connection");
+		// only publish the connection once it is fully set up, so a failed attempt is retried on the next call
+		PendingConnection result = (pendingConnection.valid() ? pendingConnection.get() : openConnection());
+		if (!result.error.empty()) {
+			throw std::runtime_error(result.error);
 		}
-	
-		xcb_screen_t *screen = xcb_setup_roots_iterator(xcb_get_setup(connection)).data;
-		if (!screen) {
-			throw new std::runtime_error("Cannot iterate screens");
+		ewmhConnection = result.ewmh;
+		rootWindow = result.rootWindow;
+		connection = result.connection;
+	}
+
+	void closeConnection() {
+		std::lock_guard<std::mutex> lock(conn_mtx);
+		if (pendingConnection.valid()) {
+			PendingConnection result = pendingConnection.get();
+			if (result.connection != NULL) {
+				xcb_ewmh_connection_wipe(&result.ewmh);
+				xcb_disconnect(result.connection);
+			}
 		}
-		rootWindow = screen->root;
-		if (xcb_ewmh_init_atoms_replies(&ewmhConnection, xcb_ewmh_init_atoms(connection, &ewmhConnection), NULL) == 0) {
-			throw new std::runtime_error("Cannot prepare ewmh atoms");
+		if (connection == NULL) {
+			return;
 		}
+		xcb_ewmh_connection_wipe(&ewmhConnection);
+		xcb_disconnect(connection);
+		connection = NULL;
+		// the next connection might go to another display
+		std::lock_guard<std::shared_mutex> atomsLock(atoms_mtx);
+		atoms.clear();
 	}
 
-	xcb_atom_t getAtom(const char* name) { // FIXME: Unused?
-		std::string nameStr = std::string(name);
-
-		std::shared_lock<std::shared_mutex> slock(atoms_mtx);
-		if (atoms.find(nameStr) != atoms.end()) {
-			xcb_atom_t out = atoms[nameStr];
+	std::vector<xcb_atom_t> getAtoms(const std::vector<const char*>& names) {
+		std::vector<xcb_atom_t> out(names.size(), XCB_ATOM_NONE);
+		std::vector<size_t> missing;
+		{
+			std::shared_lock<std::shared_mutex> slock(atoms_mtx);
+			for (size_t i = 0; i < names.size(); i++) {
+				auto it = atoms.find(names[i]);
+				if (it != atoms.end()) {
+					out[i] = it->second;
+				} else {
+					missing.push_back(i);
+				}
+			}
+		}
+		if (missing.empty()) {
 			return out;
 		}
 
-		slock.unlock();
 		ensureConnection();
-		
+		// send every request before waiting on any reply, interning n atoms costs one round trip instead of n
+		std::vector<xcb_intern_atom_cookie_t> cookies;
+		cookies.reserve(missing.size());
+		for (size_t i : missing) {
+			cookies.push_back(xcb_intern_atom(connection, true, strlen(names[i]), names[i]));
+		}
 		std::lock_guard<std::shared_mutex> lock(atoms_mtx);
-		xcb_intern_atom_cookie_t cookie = xcb_intern_atom(connection, true, strlen(name), name);
-		std::unique_ptr<xcb_intern_atom_reply_t, decltype(&free)> reply { xcb_intern_atom_reply(connection, cookie, NULL), &free };
-		if (!reply) {
-			throw std::runtime_error("fail to get atom");
+		for (size_t j = 0; j < missing.size(); j++) {
+			std::unique_ptr<xcb_intern_atom_reply_t, decltype(&free)> reply { xcb_intern_atom_reply(connection, cookies[j], NULL), &free };
+			if (!reply) {
+				throw std::runtime_error("fail to get atom");
+			}
+			atoms[names[missing[j]]] = reply->atom;
+			out[missing[j]] = reply->atom;
 		}
+		return out;
+	}
 
-		atoms[nameStr] = reply->atom;
-
-		return reply->atom;
+	xcb_atom_t getAtom(const char* name) {
+		return getAtoms({ name })[0];
 	}
 }
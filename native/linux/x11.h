@@ -9,10 +9,24 @@ namespace priv_os_x11 {
 	extern xcb_window_t rootWindow;
 	extern xcb_ewmh_connection_t ewmhConnection;
 
+	/**
+	 * Start connecting in the background, the connection, ewmh atoms and extension info are requested in one
+	 * pipelined batch. Doesn't block, ensureConnection waits for it when it is first needed
+	 */
+	void startConnection();
+
 	/**
 	 * Ensure that we have connection to X11
 	 */
 	void ensureConnection();
 
+	/**
+	 * Close the connection if it is open, ensureConnection opens a new one afterwards. Nothing may still be using
+	 * the old connection, including the event threads
+	 */
+	void closeConnection();
+
+	// Intern atoms by name, all uncached names are requested before any reply is awaited
+	std::vector<xcb_atom_t> getAtoms(const std::vector<const char*>& names);
 	xcb_atom_t getAtom(const char* name);
 }
@@ -0,0 +1,297 @@
+#include <algorithm>
+#include <cmath>
+#include "ncc.h"
+#include "derived.h"
+
+namespace {
+	// luminance with integral images of its values and squares
+	struct GrayLevel {
+		int width = 0;
+		int height = 0;
+		const uint16_t* values = nullptr;
+		const uint64_t* sums = nullptr;
+		const uint64_t* sqsums = nullptr;
+
+		uint64_t Window(const uint64_t* table, int x, int y, int w, int h) const {
+			size_t stride = (size_t)this->width + 1;
+			return table[(y + h) * stride + x + w] - table[y * stride + x + w] - table[(y + h) * stride + x] + table[y * stride + x];
+		}
+	};
+
+	// storage of a level that isn't in the derived cache
+	struct OwnedGrayLevel {
+		std::vector<uint16_t> values;
+		std::vector<uint64_t> sums;
+		std::vector<uint64_t> sqsums;
+		GrayLevel level;
+	};
+
+	void BuildIntegrals(OwnedGrayLevel& out) {
+		int w = out.level.width;
+		int h = out.level.height;
+		size_t stride = (size_t)w + 1;
+		out.sums.assign(stride * (h + 1), 0);
+		out.sqsums.assign(stride * (h + 1), 0);
+		for (int y = 0; y < h; y++) {
+			const uint16_t* src = out.values.data() + (size_t)y * w;
+			uint64_t rowsum = 0;
+			uint64_t rowsq = 0;
+			for (int x = 0; x < w; x++) {
+				rowsum += src[x];
+				rowsq += (uint64_t)src[x] * src[x];
+				out.sums[(y + 1) * stride + x + 1] = out.sums[y * stride + x + 1] + rowsum;
+				out.sqsums[(y + 1) * stride + x + 1] = out.sqsums[y * stride + x + 1] + rowsq;
+			}
+		}
+		out.level.values = out.values.data();
+		out.level.sums = out.sums.data();
+		out.level.sqsums = out.sqsums.data();
+	}
+
+	void HalveLevel(const GrayLevel& src, OwnedGrayLevel& out) {
+		int w = src.width / 2;
+		int h = src.height / 2;
+		out.level.width = w;
+		out.level.height = h;
+		out.values.resize((size_t)w * h);
+		for (int y = 0; y < h; y++) {
+			const uint16_t* row1 = src.values + (size_t)(y * 2) * src.width;
+			const uint16_t* row2 = row1 + src.width;
+			uint16_t* dst = out.values.data() + (size_t)y * w;
+			for (int x = 0; x < w; x++) {
+				dst[x] = (row1[x * 2] + row1[x * 2 + 1] + row2[x * 2] + row2[x * 2 + 1] + 2) / 4;
+			}
+		}
+		BuildIntegrals(out);
+	}
+
+	// needle resampled to one scale and level, zero mean over its opaque pixels
+	struct Template {
+		int width = 0;
+		int height = 0;
+		std::vector<float> values;
+		double energy = 0;
+		// opaque pixels, only filled when some are transparent
+		std::vector<uint8_t> mask;
+		size_t opaqueCount = 0;
+	};
+
+	bool BuildTemplate(const uint8_t* needle, int width, int height, float scale, Template& out) {
+		out.width = (int)std::lround(width * scale);
+		out.height = (int)std::lround(height * scale);
+		if (out.width < 2 || out.height < 2) {
+			return false;
+		}
+		// bilinear sampling of luminance and alpha
+		auto sample = [&](float fx, float fy, int channel) {
+			fx = std::min(std::max(fx, 0.0f), (float)(width - 1));
+			fy = std::min(std::max(fy, 0.0f), (float)(height - 1));
+			int x0 = (int)fx, y0 = (int)fy;
+			int x1 = std::min(x0 + 1, width - 1), y1 = std::min(y0 + 1, height - 1);
+			float ax = fx - x0, ay = fy - y0;
+			auto value = [&](int x, int y) {
+				const uint8_t* px = needle + ((size_t)y * width + x) * 4;
+				return (float)(channel == 3 ? px[3] : PixelLuminance(px));
+			};
+			return (value(x0, y0) * (1 - ax) + value(x1, y0) * ax) * (1 - ay) + (value(x0, y1) * (1 - ax) + value(x1, y1) * ax) * ay;
+		};
+		std::vector<float> lum((size_t)out.width * out.height);
+		std::vector<bool> opaque(lum.size());
+		double sum = 0;
+		size_t count = 0;
+		for (int y = 0; y < out.height; y++) {
+			for (int x = 0; x < out.width; x++) {
+				float sx = (x + 0.5f) * width / out.width - 0.5f;
+				float sy = (y + 0.5f) * height / out.height - 0.5f;
+				size_t i = (size_t)y * out.width + x;
+				lum[i] = sample(sx, sy, 0);
+				opaque[i] = sample(sx, sy, 3) >= 128;
+				if (opaque[i]) {
+					sum += lum[i];
+					count++;
+				}
+			}
+		}
+		if (count == 0) {
+			return false;
+		}
+		float mean = (float)(sum / count);
+		out.opaqueCount = count;
+		out.mask.clear();
+		if (count != lum.size()) {
+			out.mask.assign(opaque.begin(), opaque.end());
+		}
+		out.values.resize(lum.size());
+		out.energy = 0;
+		for (size_t i = 0; i < lum.size(); i++) {
+			out.values[i] = (opaque[i] ? lum[i] - mean : 0.0f);
+			out.energy += (double)out.values[i] * out.values[i];
+		}
+		// a flat needle has no shape to correlate with
+		return out.energy > 1e-3;
+	}
+
+	// window statistics over the opaque pixels of a needle with transparency, the integrals only cover full rects
+	float MaskedScore(const GrayLevel& img, const Template& tmpl, int x, int y) {
+		double n = (double)tmpl.opaqueCount;
+		double dot = 0;
+		uint64_t sum = 0;
+		uint64_t sqsum = 0;
+		for (int ty = 0; ty < tmpl.height; ty++) {
+			const uint16_t* row = img.values + (size_t)(y + ty) * img.width + x;
+			const float* trow = tmpl.values.data() + (size_t)ty * tmpl.width;
+			const uint8_t* mrow = tmpl.mask.data() + (size_t)ty * tmpl.width;
+			float rowdot = 0;
+			for (int tx = 0; tx < tmpl.width; tx++) {
+				rowdot += row[tx] * trow[tx];
+				uint32_t v = mrow[tx] ? row[tx] : 0;
+				sum += v;
+				sqsum += v * v;
+			}
+			dot += rowdot;
+		}
+		double variance = (double)sqsum - (double)sum * sum / n;
+		if (variance < n * 0.5) {
+			return 0;
+		}
+		return (float)(dot / std::sqrt(variance * tmpl.energy));
+	}
+
+	float Score(const GrayLevel& img, const Template& tmpl, int x, int y) {
+		if (!tmpl.mask.empty()) {
+			return MaskedScore(img, tmpl, x, y);
+		}
+		double n = (double)tmpl.width * tmpl.height;
+		double sum = (double)img.Window(img.sums, x, y, tmpl.width, tmpl.height);
+		double sqsum = (double)img.Window(img.sqsums, x, y, tmpl.width, tmpl.height);
+		double variance = sqsum - sum * sum / n;
+		if (variance < n * 0.5) {
+			return 0;
+		}
+		// the needle is zero mean, so the window mean drops out of the numerator
+		double dot = 0;
+		for (int ty = 0; ty < tmpl.height; ty++) {
+			const uint16_t* row = img.values + (size_t)(y + ty) * img.width + x;
+			const float* trow = tmpl.values.data() + (size_t)ty * tmpl.width;
+			float rowdot = 0;
+			for (int tx = 0; tx < tmpl.width; tx++) {
+				rowdot += row[tx] * trow[tx];
+			}
+			dot += rowdot;
+		}
+		return (float)(dot / std::sqrt(variance * tmpl.energy));
+	}
+
+	struct Candidate {
+		int x;
+		int y;
+		float score;
+	};
+}
+
+// coarse scores are noisier, keep everything that could still reach the threshold at full resolution
+static constexpr float coarseMargin = 0.15f;
+static constexpr size_t maxCoarseCandidates = 4096;
+// below this coarse needle size the half resolution level says too little, search full resolution directly
+static constexpr int minCoarseSize = 6;
+
+std::vector<NccMatch> FindSubImageNcc(const FrameData& frame, const uint8_t* needle, int width, int height, const NccOptions& options) {
+	JSRectangle full(0, 0, frame.width, frame.height);
+	auto& cache = DerivedCache::Global();
+	auto values = cache.Plane(frame, DerivedKind::Luminance, full);
+	auto sums = cache.Integral(frame, DerivedKind::Luminance, full);
+	auto sqsums = cache.Integral(frame, DerivedKind::LuminanceSquared, full);
+	GrayLevel level0;
+	level0.width = frame.width;
+	level0.height = frame.height;
+	level0.values = values->values.data();
+	level0.sums = sums->sums.data();
+	level0.sqsums = sqsums->sums.data();
+	OwnedGrayLevel level1;
+	bool haveLevel1 = false;
+
+	int rx1 = std::max(0, options.rect.x);
+	int ry1 = std::max(0, options.rect.y);
+	int rx2 = std::min(frame.width, options.rect.x + options.rect.width);
+	int ry2 = std::min(frame.height, options.rect.y + options.rect.height);
+
+	std::vector<NccMatch> matches;
+	for (float scale : options.scales) {
+		Template tmpl;
+		if (scale <= 0 || !BuildTemplate(needle, width, height, scale, tmpl)) {
+			continue;
+		}
+		int xmax = rx2 - tmpl.width;
+		int ymax = ry2 - tmpl.height;
+		if (xmax < rx1 || ymax < ry1) {
+			continue;
+		}
+
+		std::vector<Candidate> found;
+		Template coarse;
+		if (BuildTemplate(needle, width, height, scale / 2, coarse) && coarse.width >= minCoarseSize && coarse.height >= minCoarseSize) {
+			if (!haveLevel1) {
+				HalveLevel(level0, level1);
+				haveLevel1 = true;
+			}
+			std::vector<Candidate> candidates;
+			int cx2 = std::min(xmax / 2, level1.level.width - coarse.width);
+			int cy2 = std::min(ymax / 2, level1.level.height - coarse.height);
+			for (int y = ry1 / 2; y <= cy2; y++) {
+				for (int x = rx1 / 2; x <= cx2; x++) {
+					float score = Score(level1.level, coarse, x, y);
+					if (score >= options.threshold - coarseMargin) {
+						candidates.push_back({ x, y, score });
+					}
+				}
+			}
+			if (candidates.size() > maxCoarseCandidates) {
+				std::partial_sort(candidates.begin(), candidates.begin() + maxCoarseCandidates, candidates.end(), [](const Candidate& a, const Candidate& b) { return a.score > b.score; });
+				candidates.resize(maxCoarseCandidates);
+			}
+			// refine around each coarse hit, neighbouring hits share most of their window so remember what was scored
+			std::vector<uint8_t> scored((size_t)(xmax - rx1 + 1) * (ymax - ry1 + 1), 0);
+			for (const Candidate& c : candidates) {
+				for (int y = std::max(ry1, c.y * 2 - 2); y <= std::min(ymax, c.y * 2 + 2); y++) {
+					for (int x = std::max(rx1, c.x * 2 - 2); x <= std::min(xmax, c.x * 2 + 2); x++) {
+						uint8_t& seen = scored[(size_t)(y - ry1) * (xmax - rx1 + 1) + (x - rx1)];
+						if (seen) { continue; }
+						seen = 1;
+						float score = Score(level0, tmpl, x, y);
+						if (score >= options.threshold) { found.push_back({ x, y, score }); }
+					}
+				}
+			}
+		} else {
+			for (int y = ry1; y <= ymax; y++) {
+				for (int x = rx1; x <= xmax; x++) {
+					float score = Score(level0, tmpl, x, y);
+					if (score >= options.threshold) { found.push_back({ x, y, score }); }
+				}
+			}
+		}
+		for (const Candidate& c : found) {
+			matches.push_back({ c.x, c.y, tmpl.width, tmpl.height, scale, c.score });
+		}
+	}
+
+	// strongest first, then drop anything that overlaps a stronger match by more than half
+	std::sort(matches.begin(), matches.end(), [](const NccMatch& a, const NccMatch& b) { return a.score > b.score; });
+	std::vector<NccMatch> kept;
+	for (const NccMatch& m : matches) {
+		bool overlaps = false;
+		for (const NccMatch& k : kept) {
+			int ox = std::min(m.x + m.width, k.x + k.width) - std::max(m.x, k.x);
+			int oy = std::min(m.y + m.height, k.y + k.height) - std::max(m.y, k.y);
+			if (ox > 0 && oy > 0 && (size_t)ox * oy * 2 > (size_t)std::min(m.width * m.height, k.width * k.height)) {
+				overlaps = true;
+				break;
+			}
+		}
+		if (!overlaps) {
+			kept.push_back(m);
+			if (kept.size() >= options.maxresults) { break; }
+		}
+	}
+	return kept;
+}
@@ -0,0 +1,38 @@
+/**
+ * Normalized cross-correlation matching on luminance. Unlike FindSubImage it scores how well the shape of the
+ * needle matches rather than exact colors, so it keeps working under brightness/gamma differences, and the needle
+ * is tried at several scale factors to find interface elements at non-100% interface scaling
+ */
+
+#pragma once
+#include "frame.h"
+
+struct NccOptions {
+	// area of the frame to search in
+	JSRectangle rect;
+	// needle scale factors to try, 1 is the original size
+	std::vector<float> scales = { 1.0f };
+	// minimum correlation of a match, -1 to 1
+	float threshold = 0.9f;
+	size_t maxresults = SIZE_MAX;
+};
+
+struct NccMatch {
+	// top left of the scaled needle in the frame
+	int x;
+	int y;
+	int width;
+	int height;
+	float scale;
+	float score;
+};
+
+/**
+ * Finds needle (rgba, width*height*4) in the frame. Window means and variances come from integral images, so the
+ * cost per position is a single dot product with the zero-mean needle. Every scale is first searched on a half
+ * resolution pyramid level and only the promising positions are scored at full resolution. Transparent needle
+ * pixels (alpha < 128) are left out of the correlation and of the window statistics, those needles can't use the
+ * integral images and cost a few more operations per pixel. Matches are sorted by score, overlapping weaker
+ * matches are dropped
+ */
+std::vector<NccMatch> FindSubImageNcc(const FrameData& frame, const uint8_t* needle, int width, int height, const NccOptions& options);
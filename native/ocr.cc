@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <thread>
+#include <cmath>
+#include "ocr.h"
+
+namespace {
+	struct CharMatch {
+		const OCRGlyph* glyph = nullptr;
+		size_t color = 0;
+		int x = 0;
+		int y = 0;
+		float score = 0;
+		float sizescore = 0;
+	};
+
+	struct LineChar {
+		CharMatch match;
+		int spacesBefore;
+	};
+
+	// Gathered pixel values of the glyph currently being scored, reused between calls
+	struct Scratch {
+		std::vector<float> r, g, b;
+	};
+	thread_local Scratch scratch;
+
+	// Number of independent accumulators, keeps the score reduction vectorizable without -ffast-math
+	constexpr int scoreLanes = 8;
+
+	inline float BlendPenalty(float measured, float col, float blend) {
+		// background color that would be needed to end up at the measured color when blending in the text color
+		float bg = measured + (measured - col) * blend;
+		return std::max(0.0f, std::max(-bg, bg - 255.0f));
+	}
+
+	// Same as canblend in alt1/ocr, summed over all glyph pixels
+	float ScoreGlyph(const OCRImage& img, const OCRFont& font, const OCRGlyph& glyph, const OCRColor& col, int x, int y) {
+		uint32_t count = glyph.pixelCount;
+		uint32_t padded = (count + scoreLanes - 1) / scoreLanes * scoreLanes;
+		if (scratch.r.size() < padded) {
+			scratch.r.resize(padded);
+			scratch.g.resize(padded);
+			scratch.b.resize(padded);
+		}
+		float* r = scratch.r.data();
+		float* g = scratch.g.data();
+		float* b = scratch.b.data();
+		const int16_t* px = font.px.data() + glyph.pixelStart;
+		const int16_t* py = font.py.data() + glyph.pixelStart;
+		const float* blend = font.blend.data() + glyph.pixelStart;
+		const float* lum = font.lum.data() + glyph.pixelStart;
+
+		size_t stride = (size_t)img.width * 4;
+		const uint8_t* origin = img.data + y * stride + x * 4;
+		for (uint32_t i = 0; i < count; i++) {
+			const uint8_t* pixel = origin + py[i] * stride + px[i] * 4;
+			r[i] = pixel[0];
+			g[i] = pixel[1];
+			b[i] = pixel[2];
+		}
+
+		float acc[scoreLanes] = { 0 };
+		uint32_t i = 0;
+		for (; i + scoreLanes <= count; i += scoreLanes) {
+			for (int lane = 0; lane < scoreLanes; lane++) {
+				uint32_t k = i + lane;
+				float p = BlendPenalty(r[k], col.r * lum[k], blend[k]);
+				p = std::max(p, BlendPenalty(g[k], col.g * lum[k], blend[k]));
+				p = std::max(p, BlendPenalty(b[k], col.b * lum[k], blend[k]));
+				acc[lane] += p;
+			}
+		}
+		for (; i < count; i++) {
+			float p = BlendPenalty(r[i], col.r * lum[i], blend[i]);
+			p = std::max(p, BlendPenalty(g[i], col.g * lum[i], blend[i]));
+			p = std::max(p, BlendPenalty(b[i], col.b * lum[i], blend[i]));
+			acc[0] += p;
+		}
+		float score = 0;
+		for (int lane = 0; lane < scoreLanes; lane++) { score += acc[lane]; }
+		return score;
+	}
+
+	// Read the best matching glyph with its baseline at x,y. When rightAligned is set the glyph ends at x instead of starting there
+	bool ReadChar(const OCRImage& img, const OCRFont& font, const std::vector<OCRColor>& colors, int x, int y, bool allowSecondary, bool rightAligned, CharMatch& out) {
+		int top = y - font.basey;
+		if (top < 0 || top + font.height >= img.height) { return false; }
+		CharMatch best;
+		for (const OCRGlyph& glyph : font.glyphs) {
+			if (glyph.secondary && !allowSecondary) { continue; }
+			int gx = (rightAligned ? x - glyph.width : x);
+			if (gx < 0 || gx + font.width >= img.width) { continue; }
+			for (size_t c = 0; c < colors.size(); c++) {
+				float score = ScoreGlyph(img, font, glyph, colors[c], gx, top);
+				float sizescore = score - glyph.bonus;
+				if (!best.glyph || sizescore < best.sizescore) {
+					best.glyph = &glyph;
+					best.color = c;
+					best.x = gx;
+					best.y = y;
+					best.score = score;
+					best.sizescore = sizescore;
+				}
+			}
+		}
+		if (!best.glyph || best.score > font.maxscore) { return false; }
+		out = best;
+		return true;
+	}
+
+	bool FindChar(const OCRImage& img, const OCRFont& font, const std::vector<OCRColor>& colors, int x, int y, int w, int h, CharMatch& out) {
+		if (x < 0 || y - font.basey < 0) { return false; }
+		if (x + w + font.width > img.width || y + h - font.basey + font.height > img.height) { return false; }
+		//TODO finetune score constants, same as js version
+		float best = 1000;
+		bool found = false;
+		for (int cx = x; cx < x + w; cx++) {
+			for (int cy = y; cy < y + h; cy++) {
+				CharMatch chr;
+				if (ReadChar(img, font, colors, cx, cy, false, false, chr) && chr.sizescore < best) {
+					best = chr.sizescore;
+					out = chr;
+					found = true;
+				}
+			}
+		}
+		return found;
+	}
+
+	void ReadDirection(const OCRImage& img, const OCRFont& font, const std::vector<OCRColor>& colors, int x, int y, bool forward, std::vector<LineChar>& out) {
+		int dir = (forward ? 1 : -1);
+		int dx = 0;
+		int triedspaces = 0;
+		while (true) {
+			CharMatch chr;
+			if (!ReadChar(img, font, colors, x + dx, y, true, !forward, chr)) {
+				if (triedspaces < font.maxspaces) {
+					dx += dir * font.spacewidth;
+					triedspaces++;
+					continue;
+				}
+				break;
+			}
+			out.push_back({ chr, triedspaces });
+			triedspaces = 0;
+			dx += dir * chr.glyph->width;
+		}
+	}
+
+	OCRLineResult ReadLine(const OCRImage& img, const OCRFont& font, const std::vector<OCRColor>& colors, int x, int y) {
+		std::vector<LineChar> backward;
+		std::vector<LineChar> forward;
+		ReadDirection(img, font, colors, x, y, false, backward);
+		ReadDirection(img, font, colors, x, y, true, forward);
+
+		// Backward chars store the spaces between them and their right neighbour, shift them while reversing
+		std::vector<LineChar> chars;
+		chars.reserve(backward.size() + forward.size());
+		int pendingspaces = 0;
+		for (auto it = backward.rbegin(); it != backward.rend(); it++) {
+			chars.push_back({ it->match, pendingspaces });
+			pendingspaces = it->spacesBefore;
+		}
+		for (size_t i = 0; i < forward.size(); i++) {
+			chars.push_back({ forward[i].match, i == 0 ? pendingspaces : forward[i].spacesBefore });
+		}
+
+		OCRLineResult res;
+		if (chars.empty()) {
+			res.x = x;
+			res.y = y - 9;
+			res.w = 0;
+			res.h = 10;
+			return res;
+		}
+		for (const LineChar& chr : chars) {
+			const OCRColor& col = colors[chr.match.color];
+			if (res.fragments.empty() || !(res.fragments.back().color == col)) {
+				res.fragments.push_back({ std::string(), col, chr.match.x, chr.match.x });
+			}
+			OCRFragment& frag = res.fragments.back();
+			frag.text.append(chr.spacesBefore, ' ');
+			frag.text += chr.match.glyph->chr;
+			frag.xend = chr.match.x + chr.match.glyph->width;
+		}
+		for (const OCRFragment& frag : res.fragments) { res.text += frag.text; }
+		res.x = res.fragments.front().xstart;
+		res.y = y - 9;
+		res.w = res.fragments.back().xend - res.x;
+		res.h = 10;
+		return res;
+	}
+
+	OCRLineResult FindReadLine(const OCRImage& img, const OCRFont& font, const std::vector<OCRColor>& colors, int x, int y) {
+		int w = font.width + font.spacewidth;
+		x -= (w + 1) / 2;
+		int h = 7;
+		y -= 1;
+		CharMatch chr;
+		if (!FindChar(img, font, colors, x, y, w, h, chr)) {
+			OCRLineResult res;
+			res.x = x;
+			res.y = y;
+			res.w = w;
+			res.h = h;
+			return res;
+		}
+		return ReadLine(img, font, colors, chr.x, chr.y);
+	}
+}
+
+void OCRFont::AddGlyph(const std::string& chr, int width, float bonus, bool secondary, const std::vector<int>& pixels) {
+	OCRGlyph glyph;
+	glyph.chr = chr;
+	// zero width glyphs would make the line reader loop in place
+	glyph.width = std::max(1, width);
+	glyph.bonus = bonus;
+	glyph.secondary = secondary;
+	glyph.pixelStart = (uint32_t)px.size();
+	size_t step = (shadow ? 4 : 3);
+	for (size_t i = 0; i + step <= pixels.size(); i += step) {
+		px.push_back((int16_t)pixels[i]);
+		py.push_back((int16_t)pixels[i + 1]);
+		float a = pixels[i + 2] / 255.0f;
+		blend.push_back(a >= 1 ? 50.0f : std::min(50.0f, a / (1 - a)));
+		lum.push_back(shadow ? pixels[i + 3] / 255.0f : 1.0f);
+	}
+	glyph.pixelCount = (uint32_t)px.size() - glyph.pixelStart;
+	glyphs.push_back(std::move(glyph));
+}
+
+std::vector<OCRLineResult> OCRFindReadLine(const OCRImage& img, const std::vector<std::shared_ptr<OCRFont>>& fonts, const std::vector<OCRColor>& colors, int x, int y) {
+	std::vector<OCRLineResult> results(fonts.size());
+	if (fonts.empty() || colors.empty()) { return results; }
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < fonts.size(); i++) {
+		threads.emplace_back([&, i]() { results[i] = FindReadLine(img, *fonts[i], colors, x, y); });
+	}
+	results[0] = FindReadLine(img, *fonts[0], colors, x, y);
+	for (auto& thread : threads) { thread.join(); }
+	return results;
+}
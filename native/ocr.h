@@ -0,0 +1,75 @@
+/**
+ * Native glyph matching text reader, port of the findReadLine/readLine logic in alt1/ocr
+ *
+ * Fonts are converted once from their js FontDefinition into a packed glyph table, reading a line
+ * then only touches native memory. Multiple fonts can be tried at the same point in parallel.
+ */
+
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+
+struct OCRGlyph {
+	std::string chr;
+	int width = 0;
+	float bonus = 0;
+	bool secondary = false;
+	// range in the pixel arrays of the font
+	uint32_t pixelStart = 0;
+	uint32_t pixelCount = 0;
+};
+
+struct OCRFont {
+	int width = 0;
+	int height = 0;
+	int basey = 0;
+	int spacewidth = 0;
+	int maxspaces = 1;
+	bool shadow = false;
+	// highest score a glyph can have and still be accepted
+	float maxscore = 400;
+	std::vector<OCRGlyph> glyphs;
+	// glyph pixels of all glyphs in structure-of-arrays layout so the scoring loops vectorize
+	std::vector<int16_t> px;
+	std::vector<int16_t> py;
+	// blend factor a/(1-a) of the glyph pixel coverage, capped at 50
+	std::vector<float> blend;
+	// fraction of the text color at this pixel, only differs from 1 for fonts with shadow
+	std::vector<float> lum;
+
+	// Add a glyph from the flat pixel list of the js font format, [x,y,a] or [x,y,a,lum] for shadow fonts
+	void AddGlyph(const std::string& chr, int width, float bonus, bool secondary, const std::vector<int>& pixels);
+};
+
+struct OCRColor {
+	uint8_t r, g, b;
+	bool operator==(const OCRColor& other) const { return r == other.r && g == other.g && b == other.b; }
+};
+
+// Non-owning view of rgba pixel data
+struct OCRImage {
+	const uint8_t* data;
+	int width;
+	int height;
+};
+
+struct OCRFragment {
+	std::string text;
+	OCRColor color;
+	int xstart;
+	int xend;
+};
+
+struct OCRLineResult {
+	std::string text;
+	int x, y, w, h;
+	std::vector<OCRFragment> fragments;
+};
+
+/**
+ * Find a line of text around x,y and read it in both directions, same as findReadLine in alt1/ocr
+ * Returns one result for each font, fonts are read in parallel
+ */
+std::vector<OCRLineResult> OCRFindReadLine(const OCRImage& img, const std::vector<std::shared_ptr<OCRFont>>& fonts, const std::vector<OCRColor>& colors, int x, int y);
@@ -29,6 +29,29 @@ struct CaptureRect {
 	CaptureRect(void* data, size_t size, JSRectangle rect) :rect(rect), data(data), size(size) {}
 };
 
+enum class OverlayPrimitiveType { Line, Rect, Text, Sprite };
+
+// Single draw action of the overlay api, see OverlayPrimitive in shared.ts
+struct OverlayPrimitive {
+	OverlayPrimitiveType type = OverlayPrimitiveType::Rect;
+	// argb, alpha is ignored like in the overlay window
+	uint32_t color = 0;
+	int linewidth = 1;
+	// end points of a line, top-left and bottom-right corner of a rect or sprite, or the position of text
+	int x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+	string text;
+	int size = 0;
+	bool center = false;
+	bool shadow = false;
+	// premultiplied argb pixels of a sprite, (x2-x1)*(y2-y1) of them
+	std::shared_ptr<const vector<uint32_t>> sprite;
+	bool operator==(const OverlayPrimitive& other) const {
+		return type == other.type && color == other.color && linewidth == other.linewidth && x1 == other.x1 && y1 == other.y1
+			&& x2 == other.x2 && y2 == other.y2 && text == other.text && size == other.size && center == other.center && shadow == other.shadow
+			&& (sprite == other.sprite || (sprite && other.sprite && *sprite == *other.sprite));
+	}
+};
+
 
 //TODO parameter type of objectwrap
 struct OSWindow {
@@ -74,8 +97,16 @@ std::vector<OSWindow> OSGetRsHandles();
  */
 void OSCaptureMulti(OSWindow wnd, CaptureMode mode, vector<CaptureRect> rects, Napi::Env env);
 
+/**
+ * Sample single pixels of the target wnd, points contains count x,y pairs. All points are sampled from the same frame,
+ * out receives one pixel per point in the same rgba byte order as a capture. Points outside the client area are 0,
+ * which no captured pixel is since captures are opaque. NativeFrame.samplePixels uses the same convention
+ */
+void OSSamplePixels(OSWindow wnd, CaptureMode mode, const int32_t* points, size_t count, uint32_t* out, Napi::Env env);
+
 /**
  * Get the currently active window on the desktop
+ * On X11 this is a cached value while the window thread runs, it is updated from root window property changes
  */
 OSWindow OSGetActiveWindow();
 
@@ -85,14 +116,73 @@ OSWindow OSGetActiveWindow();
 bool OSGetMouseState();
 
 
-enum class WindowEventType { Move, Close, Show, Click };
+enum class WindowEventType { Move, Close, Show, Click, ActiveChange, Visibility };
 const std::map<std::string, WindowEventType> windowEventTypes = {
 	{"move",WindowEventType::Move},
 	{"close",WindowEventType::Close},
 	{"show",WindowEventType::Show},
-	{"click",WindowEventType::Click}
+	{"click",WindowEventType::Click},
+	// desktop-wide, listen on the null window, called with the handle of the new active window
+	{"activechange",WindowEventType::ActiveChange},
+	// called with the visibility text when the window gets hidden, shown or covered
+	{"visibility",WindowEventType::Visibility}
+};
+
+enum class OSWindowVisibility { Visible, Obscured, Hidden };
+
+inline const char* WindowVisibilityText(OSWindowVisibility visibility) {
+	switch (visibility) {
+	case OSWindowVisibility::Obscured: return "obscured";
+	case OSWindowVisibility::Hidden: return "hidden";
+	default: return "visible";
+	}
+}
+
+/**
+ * Hidden means minimized, unmapped or hidden by the window manager, for example on another workspace.
+ * Obscured means fully covered by other windows, only X11 without a compositor reports this.
+ * On X11 captures of a hidden window fail with a "window not visible" error while it has a visibility listener
+ */
+OSWindowVisibility OSGetWindowVisibility(OSWindow wnd);
+
+enum WindowInfoField : uint32_t {
+	Title = 1 << 0,
+	Class = 1 << 1,
+	Bounds = 1 << 2,
+	ClientBounds = 1 << 3,
+	MapState = 1 << 4,
+	Pid = 1 << 5,
+	TransientFor = 1 << 6
+};
+
+const std::map<std::string, WindowInfoField> windowInfoFields = {
+	{"title", WindowInfoField::Title},
+	{"class", WindowInfoField::Class},
+	{"bounds", WindowInfoField::Bounds},
+	{"clientBounds", WindowInfoField::ClientBounds},
+	{"mapped", WindowInfoField::MapState},
+	{"pid", WindowInfoField::Pid},
+	{"transientFor", WindowInfoField::TransientFor}
 };
 
+struct OSWindowInfo {
+	// false if the window no longer exists, other fields are left empty in that case
+	bool valid = false;
+	string title;
+	string className;
+	JSRectangle bounds = JSRectangle(0, 0, 0, 0);
+	JSRectangle clientBounds = JSRectangle(0, 0, 0, 0);
+	bool mapped = false;
+	uint32_t pid = 0;
+	OSWindow transientFor;
+};
+
+/**
+ * Query the fields (combination of WindowInfoField) of many windows at once. Only requested fields are filled in.
+ * Safe to call from any thread
+ */
+std::vector<OSWindowInfo> OSQueryWindows(const std::vector<OSWindow>& windows, uint32_t fields);
+
 /**
  * Listen for window events in windows owned by another process or the desktop.
  * @param wnd the window to listen for or the null window to listen for all windows/the desktop
@@ -109,3 +199,89 @@ void OSRemoveWindowListener(OSWindow wnd, WindowEventType type, Napi::Function c
  * Implemented only on X11 Linux as a replacement for electron's setIgnoreMouseEvents()
  */
 void OSSetWindowShape(OSWindow wnd, vector<JSRectangle> rects);
+
+/**
+ * Defines the clickable region of a window with a bitmap, pixels with an alpha of 128 or more can be clicked
+ * rgba is width*height pixels in rgba byte order. Implemented only on X11 Linux
+ */
+void OSSetWindowShapeMask(OSWindow wnd, const uint8_t* rgba, int width, int height);
+
+// Placement of a window relative to the client area of its pin parent, same rules as OSWindowPin in native.ts
+struct OSWindowPinConfig {
+	// cover places the window over the whole client area and ignores the other fields
+	bool cover = false;
+	// which edges the distances are measured from
+	bool pinLeft = true;
+	bool pinTop = true;
+	int hordist = 0;
+	int verdist = 0;
+	int width = 0;
+	int height = 0;
+};
+
+/**
+ * Keep wnd positioned according to config whenever parent moves or resizes. The window is moved from the event
+ * thread as soon as the parent's configure event arrives, move listeners of parent are called afterwards.
+ * Pass null to stop following. Implemented only on X11 Linux, parent needs a move listener for events to arrive
+ */
+void OSSetWindowPin(OSWindow wnd, OSWindow parent, const OSWindowPinConfig* config);
+
+struct ClickCaptureConfig {
+	// size of the captured area, centered on the click and clamped to the client area
+	int width = 600;
+	int height = 600;
+	// number of frames the window has to present after the click before it is captured
+	int frames = 2;
+	// ms after which the capture happens anyway if those frames don't arrive
+	int timeout = 100;
+	CaptureMode mode = CaptureMode::Window;
+};
+
+/**
+ * Attach a capture around the cursor to click events of wnd, the click listeners are then called with
+ * { x, y, rect, data } once the capture is done instead of right away. Pass null to detach again.
+ * Implemented only on X11 Linux, frames are counted when frame tracking is started for wnd
+ */
+void OSSetClickCapture(OSWindow wnd, const ClickCaptureConfig* config);
+
+struct OSFrameStats {
+	// false if frame tracking was not started for the window
+	bool tracked = false;
+	double fps = 0;
+	// total number of frames seen since tracking started
+	uint64_t frames = 0;
+	// ms since the last frame was presented
+	double sinceLastFrame = 0;
+	// number of frame intervals the distribution below is computed from
+	uint32_t samples = 0;
+	// frame interval distribution in ms
+	double mean = 0, min = 0, p50 = 0, p90 = 0, p99 = 0, max = 0;
+};
+
+/**
+ * Start/stop measuring the frame rate of wnd, calls are counted so every start needs a matching stop
+ * Implemented only on X11 Linux using damage notifications, on windows the opengl hook already knows frame times
+ */
+void OSStartFrameTracking(OSWindow wnd);
+void OSStopFrameTracking(OSWindow wnd);
+OSFrameStats OSGetFrameStats(OSWindow wnd);
+
+/**
+ * Every environment (main thread or worker) registers itself when it loads the addon. Shared os resources like the
+ * X connection and event threads stay alive while any environment is left, removing an environment drops its
+ * listeners and unblocks threads waiting on its callbacks. Safe to call from any js thread
+ */
+void OSAddEnvironment(Napi::Env env);
+void OSRemoveEnvironment(Napi::Env env);
+
+/**
+ * Draws primitives on a native input-transparent overlay window at bounds (screen coordinates), replacing everything
+ * drawn before. The overlay belongs to wnd and is created on first use, only the changed area is redrawn.
+ * Implemented only on X11 Linux as a lightweight replacement for the overlay browser window
+ */
+void OSDrawOverlay(OSWindow wnd, JSRectangle bounds, const vector<OverlayPrimitive>& primitives);
+
+/**
+ * Destroys the native overlay of wnd if there is one
+ */
+void OSCloseOverlay(OSWindow wnd);
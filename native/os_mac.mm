@@ -138,3 +138,11 @@ void OSRemoveWindowListener(OSWindow wnd, WindowEventType type, Napi::Function c
 
 }
 
+void OSAddEnvironment(Napi::Env env) {
+
+}
+
+void OSRemoveEnvironment(Napi::Env env) {
+
+}
+
@@ -1,7 +1,13 @@
 
 #include "os.h"
 #include <TlHelp32.h>
+#include <algorithm>
+#include <climits>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
 #include "../libs/Alt1Native.h"
 
 /*
@@ -16,6 +22,12 @@ OSWindow OSGetActiveWindow() {
 	return OSWindow(GetForegroundWindow());
 }
 
+//covered windows aren't detected, with dwm they still render and can be captured
+OSWindowVisibility OSGetWindowVisibility(OSWindow wnd) {
+	if (!IsWindowVisible(wnd.handle) || IsIconic(wnd.handle)) { return OSWindowVisibility::Hidden; }
+	return OSWindowVisibility::Visible;
+}
+
 Napi::Value OSWindow::ToJS(Napi::Env env) {
 	return Napi::BigInt::New(env, (uint64_t)this->handle);
 }
@@ -59,6 +71,32 @@ bool OSWindow::operator<(const OSWindow& other) const {
 	return this->handle < other.handle;
 }
 
+std::vector<OSWindowInfo> OSQueryWindows(const std::vector<OSWindow>& windows, uint32_t fields) {
+	//winapi window queries don't round-trip to another process, so there is nothing to batch here
+	std::vector<OSWindowInfo> result(windows.size());
+	for (size_t i = 0; i < windows.size(); i++) {
+		OSWindow wnd = windows[i];
+		OSWindowInfo& info = result[i];
+		info.valid = wnd.IsValid();
+		if (!info.valid) { continue; }
+		if (fields & WindowInfoField::Title) { info.title = wnd.GetTitle(); }
+		if (fields & WindowInfoField::Class) {
+			char name[256];
+			if (GetClassNameA(wnd.handle, name, sizeof(name)) != 0) { info.className = name; }
+		}
+		if (fields & WindowInfoField::Bounds) { info.bounds = wnd.GetBounds(); }
+		if (fields & WindowInfoField::ClientBounds) { info.clientBounds = wnd.GetClientBounds(); }
+		if (fields & WindowInfoField::MapState) { info.mapped = IsWindowVisible(wnd.handle); }
+		if (fields & WindowInfoField::Pid) {
+			DWORD pid = 0;
+			GetWindowThreadProcessId(wnd.handle, &pid);
+			info.pid = pid;
+		}
+		if (fields & WindowInfoField::TransientFor) { info.transientFor = OSWindow(GetWindow(wnd.handle, GW_OWNER)); }
+	}
+	return result;
+}
+
 struct WinFindMainWindow_data
 {
 	unsigned long process_id;
@@ -187,7 +225,7 @@ void OSCaptureOpenGLMulti(OSWindow wnd, vector<CaptureRect> rects, Napi::Env env
 	if (!pixeldata) {
 		char errtext[200] = { 0 };
 		int len = Alt1Native::GetDebug(errtext, sizeof(errtext) - 1);
-		throw Napi::Error::New(env, string() + "Failed to capture, native error: " + errtext);
+		throw std::runtime_error(string() + "Failed to capture, native error: " + errtext);
 	}
 	//TODO get rid of copy somehow? (src memory is shared ipc memory so not trivial)
 	size_t offset = 0;
@@ -220,7 +258,65 @@ void OSCaptureMulti(OSWindow wnd, CaptureMode mode, vector<CaptureRect> rects, N
 		break;
 	}
 	default:
-		throw Napi::RangeError::New(env, "Capture mode not supported");
+		throw std::invalid_argument("Capture mode not supported");
+	}
+}
+
+void OSSamplePixels(OSWindow wnd, CaptureMode mode, const int32_t* points, size_t count, uint32_t* out, Napi::Env env) {
+	//points outside the client area read as 0 (transparent) like in NativeFrame, so no box can overflow
+	auto client = wnd.GetClientBounds();
+	auto inside = [&](size_t i) { return points[i * 2] >= 0 && points[i * 2 + 1] >= 0 && points[i * 2] < client.width && points[i * 2 + 1] < client.height; };
+
+	//capture the bounding box of all points in one go, gdi and the opengl hook both have a high per-call overhead
+	//spread out points would make that box huge, those are captured as the boxes of the tiles they fall in instead
+	const int tileSize = 256;
+	const size_t maxBoxPixels = 1024 * 1024;
+	struct Box { int minx = INT_MAX, miny = INT_MAX, maxx = INT_MIN, maxy = INT_MIN; vector<uint32_t> buffer; };
+	std::map<int, Box> boxes;
+	Box all;
+	for (size_t i = 0; i < count; i++) {
+		if (!inside(i)) { continue; }
+		all.minx = min(all.minx, points[i * 2]);
+		all.miny = min(all.miny, points[i * 2 + 1]);
+		all.maxx = max(all.maxx, points[i * 2]);
+		all.maxy = max(all.maxy, points[i * 2 + 1]);
+	}
+	if (all.minx == INT_MAX) {
+		std::fill(out, out + count, 0);
+		return;
+	}
+	bool tiled = (size_t)(all.maxx - all.minx + 1) * (all.maxy - all.miny + 1) > maxBoxPixels;
+	int tilesPerRow = (client.width + tileSize - 1) / tileSize;
+	auto tileOf = [&](size_t i) { return tiled ? points[i * 2 + 1] / tileSize * tilesPerRow + points[i * 2] / tileSize : 0; };
+	if (tiled) {
+		for (size_t i = 0; i < count; i++) {
+			if (!inside(i)) { continue; }
+			auto& box = boxes[tileOf(i)];
+			box.minx = min(box.minx, points[i * 2]);
+			box.miny = min(box.miny, points[i * 2 + 1]);
+			box.maxx = max(box.maxx, points[i * 2]);
+			box.maxy = max(box.maxy, points[i * 2 + 1]);
+		}
+	} else {
+		boxes[0] = std::move(all);
+	}
+
+	vector<CaptureRect> capts;
+	capts.reserve(boxes.size());
+	for (auto& entry : boxes) {
+		auto& box = entry.second;
+		JSRectangle rect(box.minx, box.miny, box.maxx - box.minx + 1, box.maxy - box.miny + 1);
+		box.buffer.resize((size_t)rect.width * rect.height);
+		capts.push_back(CaptureRect(box.buffer.data(), box.buffer.size() * 4, rect));
+	}
+	OSCaptureMulti(wnd, mode, capts, env);
+	for (size_t i = 0; i < count; i++) {
+		if (!inside(i)) {
+			out[i] = 0;
+			continue;
+		}
+		auto& box = boxes[tileOf(i)];
+		out[i] = box.buffer[(size_t)(points[i * 2 + 1] - box.miny) * (box.maxx - box.minx + 1) + (points[i * 2] - box.minx)];
 	}
 }
 
@@ -258,6 +354,9 @@ struct TrackedEvent {
 	WindowEventType type;
 	int lastCalledId = 0;//used to determine if this callback was called already
 	std::shared_ptr<Napi::FunctionReference> callback;
+	//out-of-context hooks deliver to the thread that set them, which is also the js thread of the callback
+	napi_env env;
+	std::thread::id thread;
 	std::vector<std::shared_ptr<WindowsEventHook>> hooks;
 	TrackedEvent(OSWindow wnd, WindowEventType type, Napi::Function cb);
 	//allow move assign
@@ -268,6 +367,8 @@ struct TrackedEvent {
 		this->hooks = other.hooks;
 		this->type = other.type;
 		this->wnd = other.wnd;
+		this->env = other.env;
+		this->thread = other.thread;
 		callback = std::move(other.callback);
 		return *this;
 	}
@@ -278,9 +379,15 @@ struct TrackedEvent {
 
 
 std::vector<TrackedEvent> windowHandlers;
+//workers add and remove listeners from their own threads
+std::mutex handlersMutex;
 
+//must be called with handlersMutex held, hooks are only shared between handlers of the same thread
 std::shared_ptr<WindowsEventHook> WindowsEventHook::GetHook(HWND hwnd, WindowsEventGroup group) {
 	for (auto& handler : windowHandlers) {
+		if (handler.thread != std::this_thread::get_id()) {
+			continue;
+		}
 		for (auto& hook : handler.hooks) {
 			if (hook->hwnd == hwnd && hook->group == group) {
 				return hook;
@@ -291,11 +398,13 @@ std::shared_ptr<WindowsEventHook> WindowsEventHook::GetHook(HWND hwnd, WindowsEv
 }
 
 void OSNewWindowListener(OSWindow wnd, WindowEventType type, Napi::Function cb) {
+	std::lock_guard<std::mutex> lock(handlersMutex);
 	auto ev = TrackedEvent(wnd, type, cb);
 	windowHandlers.push_back(std::move(ev));
 }
 
 void OSRemoveWindowListener(OSWindow wnd, WindowEventType type, Napi::Function cb) {
+	std::lock_guard<std::mutex> lock(handlersMutex);
 	for (auto it = windowHandlers.begin(); it != windowHandlers.end(); it++) {
 		if (it->type == type && it->wnd == wnd && (*it->callback) == Napi::Persistent(cb)) {
 			windowHandlers.erase(it);
@@ -304,6 +413,18 @@ void OSRemoveWindowListener(OSWindow wnd, WindowEventType type, Napi::Function c
 	}
 }
 
+void OSAddEnvironment(Napi::Env env) {
+}
+
+void OSRemoveEnvironment(Napi::Env env) {
+	std::lock_guard<std::mutex> lock(handlersMutex);
+	napi_env handle = env;
+	windowHandlers.erase(
+		std::remove_if(windowHandlers.begin(), windowHandlers.end(), [handle](const TrackedEvent& h) { return h.env == handle; }),
+		windowHandlers.end()
+	);
+}
+
 //need this weird function to deal with the possibility of the list being modified from the js callback
 //return true from cond if the handler matches and should be called
 template<typename F, typename COND>
@@ -312,10 +433,14 @@ void iterateHandlers(COND cond, F tracker) {
 	constexpr size_t max_callbacks = 64;
 	std::shared_ptr<Napi::FunctionReference> callbacks[max_callbacks];
 	size_t count = 0;
-	for (auto it = windowHandlers.begin(); it != windowHandlers.end(); it++) {
-		if (cond(*it) && count < max_callbacks) {
-			callbacks[count] = it->callback;
-			count += 1;
+	{
+		// the hook fired on this thread, handlers of other workers get their own copy of the event
+		std::lock_guard<std::mutex> lock(handlersMutex);
+		for (auto it = windowHandlers.begin(); it != windowHandlers.end(); it++) {
+			if (it->thread == std::this_thread::get_id() && cond(*it) && count < max_callbacks) {
+				callbacks[count] = it->callback;
+				count += 1;
+			}
 		}
 	}
 	for (size_t i = 0; i < count; i += 1) {
@@ -366,6 +491,33 @@ void HookProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd, LONG idObject
 				});
 			break;
 		}
+		case EVENT_SYSTEM_MINIMIZESTART:
+		case EVENT_SYSTEM_MINIMIZEEND:
+		case EVENT_OBJECT_SHOW:
+		case EVENT_OBJECT_HIDE: {
+			if (idObject != OBJID_WINDOW) { break; }
+			const char* visibility = WindowVisibilityText(OSGetWindowVisibility(wnd));
+			iterateHandlers(
+				[hwnd](const TrackedEvent& h) {return hwnd == h.wnd.handle && h.type == WindowEventType::Visibility; },
+				[visibility](const std::shared_ptr<Napi::FunctionReference>& h) {
+					auto env = h->Env();
+					Napi::HandleScope scope(env);
+					try { h->MakeCallback(env.Global(), { Napi::String::New(env, visibility) }); }
+					catch (...) {}
+				});
+			break;
+		}
+		case EVENT_SYSTEM_FOREGROUND: {
+			iterateHandlers(
+				[](const TrackedEvent& h) {return h.wnd.handle == 0 && h.type == WindowEventType::ActiveChange; },
+				[hwnd](const std::shared_ptr<Napi::FunctionReference>& h) {
+					auto env = h->Env();
+					Napi::HandleScope scope(env);
+					try { h->MakeCallback(env.Global(), { Napi::BigInt::New(env,(uint64_t)hwnd) }); }
+					catch (...) {}
+				});
+			break;
+		}
 		case EVENT_OBJECT_CREATE: {
 			if (IsRsWindow(hwnd)) {
 				iterateHandlers(
@@ -386,6 +538,8 @@ TrackedEvent::TrackedEvent(OSWindow wnd, WindowEventType type, Napi::Function cb
 	this->wnd = wnd;
 	this->type = type;
 	this->callback = std::make_shared<Napi::FunctionReference>(Napi::Persistent(cb));
+	this->env = cb.Env();
+	this->thread = std::this_thread::get_id();
 	DWORD pid;
 	//TODO error handling
 	GetWindowThreadProcessId(wnd.handle, &pid);
@@ -411,6 +565,18 @@ TrackedEvent::TrackedEvent(OSWindow wnd, WindowEventType type, Napi::Function cb
 			WindowsEventHook::GetHook(wnd.handle,WindowsEventGroup::Object),
 		};
 		break;
+	case WindowEventType::Visibility:
+		this->hooks = {
+			WindowsEventHook::GetHook(wnd.handle,WindowsEventGroup::Object),
+			WindowsEventHook::GetHook(wnd.handle,WindowsEventGroup::System)
+		};
+		break;
+	case WindowEventType::ActiveChange:
+		//foreground changes are a desktop-wide system event
+		this->hooks = {
+			WindowsEventHook::GetHook(0,WindowsEventGroup::System)
+		};
+		break;
 	default:
 		assert(false);
 	}
@@ -6,31 +6,46 @@
 #include <xcb/composite.h>
 #include <xcb/record.h>
 #include <xcb/shape.h>
+#include <xcb/damage.h>
 #include <algorithm>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
+#include <deque>
+#include <set>
 #include "os.h"
 #include "linux/x11.h"
 #include "linux/shm.h"
+#include "linux/overlay.h"
+#include "linux/frametimer.h"
+#include "linux/glcapture.h"
 
 using namespace priv_os_x11;
 
 struct TrackedEvent {
 	xcb_window_t window;
 	WindowEventType type;
+	// environment the callback belongs to, its listeners are dropped when it is torn down
+	napi_env env;
 	Napi::ThreadSafeFunction callback;
 	Napi::FunctionReference callbackRef;
 	TrackedEvent(xcb_window_t window, WindowEventType type, Napi::Function callback) :
 		window(window),
 		type(type),
+		env(callback.Env()),
 		callback(Napi::ThreadSafeFunction::New(callback.Env(), callback, "event", 0, 1, [](Napi::Env) {})),
 		callbackRef(Napi::Persistent(callback)) {}
 };
 
 std::thread windowThread;
 std::thread recordThread;
+std::thread clickCaptureThread;
 bool windowThreadExists = false;
+std::atomic<bool> windowThreadStopping(false); // Set while StopWindowThreadIfIdle waits for the event threads
+xcb_window_t windowThreadWakeup = 0; // InputOnly window, a client message to it wakes up the window thread
+xcb_record_context_t recordContext = 0; // Enabled record context, disabling it ends the record thread's reply loop
+std::mutex recordMutex; // Locks recordContext
 std::vector<TrackedEvent> trackedEvents;
 size_t rsDepth = 0;
 
@@ -41,9 +56,39 @@ std::mutex eventMutex; // Locks the trackedEvents vector
 std::mutex windowThreadMutex; // Locks windowThread. Should NEVER be locked from inside the window thread
 std::mutex rsDepthMutex; // Locks the rsDepth variable
 
+// Windows with a damage object, notifications arrive in the window thread. Counted since several features can use them
+struct DamagedWindow {
+	xcb_damage_damage_t damage = 0;
+	int users = 0;
+	FrameTimer frames;
+};
+std::map<xcb_window_t, DamagedWindow> damagedWindows;
+bool damageInitialized = false;
+uint8_t damageFirstEvent = 0;
+std::mutex damageMutex; // Locks damagedWindows and the damage extension state
+std::condition_variable damageSignal; // Notified under damageMutex whenever a tracked window presents a frame
+
+// Clicks on windows with a click capture config are delivered by the click capture thread once the capture is done
+struct ClickCaptureJob {
+	xcb_window_t window;
+	// root coordinates of the click
+	int16_t x, y;
+	ClickCaptureConfig config;
+	// frame counter of the window at the time of the click
+	uint64_t startFrame;
+	std::chrono::steady_clock::time_point time;
+};
+std::map<xcb_window_t, ClickCaptureConfig> clickCaptureConfigs;
+std::deque<ClickCaptureJob> clickCaptureJobs;
+bool clickCaptureStop = false;
+std::mutex clickCaptureMutex; // Locks clickCaptureConfigs, clickCaptureJobs and clickCaptureStop, take before damageMutex
+std::condition_variable clickCaptureSignal;
+
 void WindowThread();
 void RecordThread();
+void ClickCaptureThread();
 void StartWindowThread();
+void StopWindowThreadIfIdle();
 
 JSRectangle OSWindow::GetBounds() {
 	return GetClientBounds();
@@ -56,7 +101,7 @@ JSRectangle OSWindow::GetClientBounds() {
 	xcb_get_geometry_reply_t* geometry = xcb_get_geometry_reply(connection, gcookie, &error);
 	if (error != NULL) {
 		free(error);
-		return JSRectangle();
+		return JSRectangle(0, 0, 0, 0);
 	}
 	error = NULL;
 	xcb_translate_coordinates_cookie_t tcookie = xcb_translate_coordinates(connection, this->handle, rootWindow, 0, 0);
@@ -64,7 +109,7 @@ JSRectangle OSWindow::GetClientBounds() {
 	if (error != NULL) {
 		free(error);
 		free(geometry);
-		return JSRectangle();
+		return JSRectangle(0, 0, 0, 0);
 	}
 	auto x = translation->dst_x;
     auto y = translation->dst_y;
@@ -122,6 +167,111 @@ OSWindow OSWindow::FromJsValue(const Napi::Value jsval) {
 	return OSWindow(handleint);
 }
 
+std::vector<OSWindowInfo> OSQueryWindows(const std::vector<OSWindow>& windows, uint32_t fields) {
+	ensureConnection();
+	struct Cookies {
+		xcb_get_geometry_cookie_t geometry;
+		xcb_translate_coordinates_cookie_t translation;
+		xcb_get_window_attributes_cookie_t attributes;
+		xcb_get_property_cookie_t netName;
+		xcb_get_property_cookie_t name;
+		xcb_get_property_cookie_t wmClass;
+		xcb_get_property_cookie_t pid;
+		xcb_get_property_cookie_t transientFor;
+	};
+	// send the requests for all windows before waiting for any reply so the whole query takes one round-trip
+	std::vector<Cookies> cookies(windows.size());
+	for (size_t i = 0; i < windows.size(); i++) {
+		xcb_window_t wnd = windows[i].handle;
+		Cookies& c = cookies[i];
+		// geometry doubles as the validity check
+		c.geometry = xcb_get_geometry_unchecked(connection, wnd);
+		if (fields & (WindowInfoField::Bounds | WindowInfoField::ClientBounds)) {
+			c.translation = xcb_translate_coordinates_unchecked(connection, wnd, rootWindow, 0, 0);
+		}
+		if (fields & WindowInfoField::MapState) {
+			c.attributes = xcb_get_window_attributes_unchecked(connection, wnd);
+		}
+		if (fields & WindowInfoField::Title) {
+			c.netName = xcb_get_property_unchecked(connection, 0, wnd, ewmhConnection._NET_WM_NAME, ewmhConnection.UTF8_STRING, 0, 100);
+			c.name = xcb_get_property_unchecked(connection, 0, wnd, XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 0, 100);
+		}
+		if (fields & WindowInfoField::Class) {
+			c.wmClass = xcb_get_property_unchecked(connection, 0, wnd, XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, 0, 64);
+		}
+		if (fields & WindowInfoField::Pid) {
+			c.pid = xcb_get_property_unchecked(connection, 0, wnd, ewmhConnection._NET_WM_PID, XCB_ATOM_CARDINAL, 0, 1);
+		}
+		if (fields & WindowInfoField::TransientFor) {
+			c.transientFor = xcb_get_property_unchecked(connection, 0, wnd, XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, 0, 1);
+		}
+	}
+
+	typedef std::unique_ptr<xcb_get_property_reply_t, decltype(&free)> PropertyReply;
+	auto property = [](xcb_get_property_cookie_t cookie) {
+		return PropertyReply{ xcb_get_property_reply(connection, cookie, NULL), &free };
+	};
+	auto propertyString = [](const PropertyReply& reply) {
+		if (!reply) {
+			return std::string();
+		}
+		return std::string(reinterpret_cast<char*>(xcb_get_property_value(reply.get())), xcb_get_property_value_length(reply.get()));
+	};
+
+	// every reply has to be read even for invalid windows, otherwise xcb keeps them around
+	std::vector<OSWindowInfo> result(windows.size());
+	for (size_t i = 0; i < windows.size(); i++) {
+		Cookies& c = cookies[i];
+		OSWindowInfo& info = result[i];
+		std::unique_ptr<xcb_get_geometry_reply_t, decltype(&free)> geometry{ xcb_get_geometry_reply(connection, c.geometry, NULL), &free };
+		info.valid = !!geometry;
+		if (fields & (WindowInfoField::Bounds | WindowInfoField::ClientBounds)) {
+			std::unique_ptr<xcb_translate_coordinates_reply_t, decltype(&free)> translation{ xcb_translate_coordinates_reply(connection, c.translation, NULL), &free };
+			if (geometry && translation) {
+				// same as OSWindow::GetBounds, frames are ignored on linux
+				info.clientBounds = JSRectangle(translation->dst_x, translation->dst_y, geometry->width, geometry->height);
+				info.bounds = info.clientBounds;
+			}
+		}
+		if (fields & WindowInfoField::MapState) {
+			std::unique_ptr<xcb_get_window_attributes_reply_t, decltype(&free)> attributes{ xcb_get_window_attributes_reply(connection, c.attributes, NULL), &free };
+			info.mapped = attributes && attributes->map_state == XCB_MAP_STATE_VIEWABLE;
+		}
+		if (fields & WindowInfoField::Title) {
+			PropertyReply netName = property(c.netName);
+			PropertyReply name = property(c.name);
+			info.title = propertyString(netName);
+			if (info.title.empty()) {
+				info.title = propertyString(name);
+			}
+		}
+		if (fields & WindowInfoField::Class) {
+			// WM_CLASS holds the instance name and the class name, both null terminated
+			std::string wmClass = propertyString(property(c.wmClass));
+			size_t split = wmClass.find('\0');
+			if (split != std::string::npos) {
+				info.className = std::string(wmClass.c_str() + split + 1);
+			}
+		}
+		if (fields & WindowInfoField::Pid) {
+			PropertyReply pid = property(c.pid);
+			if (pid && xcb_get_property_value_length(pid.get()) >= 4) {
+				info.pid = *reinterpret_cast<uint32_t*>(xcb_get_property_value(pid.get()));
+			}
+		}
+		if (fields & WindowInfoField::TransientFor) {
+			PropertyReply transient = property(c.transientFor);
+			if (transient && xcb_get_property_value_length(transient.get()) >= 4) {
+				info.transientFor = OSWindow(*reinterpret_cast<xcb_window_t*>(xcb_get_property_value(transient.get())));
+			}
+		}
+		if (!info.valid) {
+			info = OSWindowInfo();
+		}
+	}
+	return result;
+}
+
 bool IsRsWindow(const xcb_window_t window) {
 	ensureConnection();
 	constexpr uint32_t long_length = 64; // Any length higher than 2x+3 of the longest string we may match is fine
@@ -200,116 +350,545 @@ void OSSetWindowParent(OSWindow window, OSWindow parent) {
 	}
 }
 
-void OSCaptureMulti(OSWindow wnd, CaptureMode mode, vector<CaptureRect> rects, Napi::Env env) {
-	// Ignore capture mode, XComposite will always work
+// Visibility of windows with a visibility listener, kept up to date by the window thread
+struct WindowVisibility {
+	bool mapped = true;
+	bool hidden = false;
+	bool obscured = false;
+	OSWindowVisibility state() const {
+		if (!mapped || hidden) { return OSWindowVisibility::Hidden; }
+		return (obscured ? OSWindowVisibility::Obscured : OSWindowVisibility::Visible);
+	}
+};
+std::map<xcb_window_t, WindowVisibility> windowVisibility;
+std::mutex visibilityMutex; // Locks windowVisibility
+
+// Reads the current state from the server, obscured is only known from events
+WindowVisibility FetchVisibility(xcb_window_t window) {
+	WindowVisibility visibility;
+	xcb_get_window_attributes_cookie_t attrcookie = xcb_get_window_attributes(connection, window);
+	xcb_get_property_cookie_t statecookie = xcb_ewmh_get_wm_state(&ewmhConnection, window);
+	xcb_get_window_attributes_reply_t* attributes = xcb_get_window_attributes_reply(connection, attrcookie, NULL);
+	if (attributes) {
+		visibility.mapped = attributes->map_state == XCB_MAP_STATE_VIEWABLE;
+		free(attributes);
+	}
+	xcb_ewmh_get_atoms_reply_t states;
+	if (xcb_ewmh_get_wm_state_reply(&ewmhConnection, statecookie, &states, NULL)) {
+		for (uint32_t i = 0; i < states.atoms_len; i++) {
+			if (states.atoms[i] == ewmhConnection._NET_WM_STATE_HIDDEN) { visibility.hidden = true; }
+		}
+		xcb_ewmh_get_atoms_reply_wipe(&states);
+	}
+	return visibility;
+}
+
+OSWindowVisibility OSGetWindowVisibility(OSWindow wnd) {
+	{
+		std::lock_guard<std::mutex> lock(visibilityMutex);
+		auto it = windowVisibility.find(wnd.handle);
+		if (it != windowVisibility.end()) {
+			return it->second.state();
+		}
+	}
 	ensureConnection();
-	xcb_composite_redirect_window(connection, wnd.handle, XCB_COMPOSITE_REDIRECT_AUTOMATIC);
-	xcb_pixmap_t pixId = xcb_generate_id(connection);
-	xcb_composite_name_window_pixmap(connection, wnd.handle, pixId);
+	return FetchVisibility(wnd.handle).state();
+}
 
-	xcb_get_geometry_cookie_t cookie = xcb_get_geometry(connection, pixId);
-	xcb_get_geometry_reply_t* reply = xcb_get_geometry_reply(connection, cookie, NULL);
-	if (!reply) {
-		xcb_free_pixmap(connection, pixId);
+bool IsKnownHidden(xcb_window_t window) {
+	std::lock_guard<std::mutex> lock(visibilityMutex);
+	auto it = windowVisibility.find(window);
+	return it != windowVisibility.end() && it->second.state() == OSWindowVisibility::Hidden;
+}
+
+// Windows that follow a parent window, moved by the window thread without a round trip through js
+struct WindowPin {
+	xcb_window_t parent;
+	OSWindowPinConfig config;
+	// last geometry sent for the window, configure events that don't change it are ignored
+	JSRectangle applied = JSRectangle(0, 0, 0, 0);
+};
+std::map<xcb_window_t, WindowPin> windowPins;
+std::mutex pinMutex; // Locks windowPins
+
+JSRectangle PinnedBounds(const OSWindowPinConfig& config, const JSRectangle& parent) {
+	if (config.cover) {
+		return parent;
+	}
+	int x = (config.pinLeft ? parent.x + config.hordist : parent.x + parent.width - config.hordist - config.width);
+	int y = (config.pinTop ? parent.y + config.verdist : parent.y + parent.height - config.verdist - config.height);
+	return JSRectangle(x, y, config.width, config.height);
+}
+
+void OSSetWindowPin(OSWindow wnd, OSWindow parent, const OSWindowPinConfig* config) {
+	std::lock_guard<std::mutex> lock(pinMutex);
+	if (!config) {
+		windowPins.erase(wnd.handle);
 		return;
 	}
+	// js may have moved the window since, so the next parent move always repositions it
+	WindowPin& pin = windowPins[wnd.handle];
+	pin.parent = parent.handle;
+	pin.config = *config;
+	pin.applied = JSRectangle(0, 0, 0, 0);
+}
 
-	XShmCapture acquirer(connection, pixId);
+// Should only be called from the window thread
+void ApplyWindowPins(xcb_window_t parent) {
+	{
+		std::lock_guard<std::mutex> lock(pinMutex);
+		if (std::none_of(windowPins.begin(), windowPins.end(), [parent](auto& pin) { return pin.second.parent == parent; })) {
+			return;
+		}
+	}
+	// the event only has coordinates relative to the wm frame, ask for the client area in root coordinates
+	JSRectangle bounds = OSWindow(parent).GetClientBounds();
+	if (bounds.width <= 0 || bounds.height <= 0) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(pinMutex);
+	bool changed = false;
+	for (auto& entry : windowPins) {
+		WindowPin& pin = entry.second;
+		if (pin.parent != parent) {
+			continue;
+		}
+		JSRectangle rect = PinnedBounds(pin.config, bounds);
+		if (rect.width <= 0 || rect.height <= 0) {
+			continue;
+		}
+		if (rect.x == pin.applied.x && rect.y == pin.applied.y && rect.width == pin.applied.width && rect.height == pin.applied.height) {
+			continue;
+		}
+		const uint32_t values[] = { (uint32_t)rect.x, (uint32_t)rect.y, (uint32_t)rect.width, (uint32_t)rect.height };
+		xcb_configure_window(connection, entry.first, XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y | XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, values);
+		pin.applied = rect;
+		changed = true;
+	}
+	if (changed) {
+		xcb_flush(connection);
+	}
+}
 
-	for (CaptureRect &rect : rects) {
-		acquirer.copy(reinterpret_cast<char*>(rect.data), rect.size, rect.rect.x, rect.rect.y, rect.rect.width, rect.rect.height);
+// The shm segments are reused between captures, allocating and attaching a new one costs more than the transfer itself
+std::mutex captureMutex; // Locks the capture sessions, redirectedWindows and glHookedWindows
+std::unique_ptr<XShmCapture> captureSession;
+std::unique_ptr<XShmCapture> desktopSession;
+// Windows we redirected for window mode captures
+std::set<xcb_window_t> redirectedWindows;
+
+// Clients running with the glhook library, see linux/glhook.cc
+struct GLHookedWindow {
+	uint32_t pid = 0;
+	std::unique_ptr<GLHookCapture> capture;
+	std::chrono::steady_clock::time_point lastAttempt;
+};
+std::map<xcb_window_t, GLHookedWindow> glHookedWindows;
+// older hook frames mean the hook only just started reading back again or the client stalled, composite is more current then
+constexpr std::chrono::milliseconds glFrameMaxAge{ 100 };
+
+// Must be called with captureMutex held. A client without the hook is only checked again once per second, and so is
+// the pid of a hooked one. DestroyNotify only arrives for windows the window thread watches, a destroyed window or
+// a reused id would otherwise keep the hook of a client that is gone
+GLHookCapture* FindGLHook(xcb_window_t window) {
+	auto now = std::chrono::steady_clock::now();
+	GLHookedWindow& entry = glHookedWindows[window];
+	if (now - entry.lastAttempt < std::chrono::seconds(1)) {
+		return entry.capture.get();
+	}
+	entry.lastAttempt = now;
+	auto info = OSQueryWindows({ OSWindow(window) }, WindowInfoField::Pid);
+	if (info.empty() || !info[0].valid) {
+		glHookedWindows.erase(window);
+		return nullptr;
 	}
+	if (info[0].pid != entry.pid) {
+		entry.pid = info[0].pid;
+		entry.capture.reset();
+	}
+	if (!entry.capture && entry.pid != 0) {
+		entry.capture = GLHookCapture::Open(entry.pid);
+	}
+	return entry.capture.get();
+}
 
-	free(reply);
+// Grab the client area of wnd straight from the root window. The game keeps rendering unredirected, but anything
+// on top of it ends up in the capture. Must be called with captureMutex held
+template<typename F>
+void CaptureDesktopFrame(OSWindow wnd, F cb) {
+	// hand the window back to direct rendering if window mode was used before
+	if (redirectedWindows.erase(wnd.handle)) {
+		xcb_composite_unredirect_window(connection, wnd.handle, XCB_COMPOSITE_REDIRECT_AUTOMATIC);
+	}
+	JSRectangle bounds = wnd.GetClientBounds();
+	if (bounds.width <= 0 || bounds.height <= 0) {
+		return;
+	}
+	if (!desktopSession) {
+		desktopSession = std::make_unique<XShmCapture>(connection);
+	}
+	if (desktopSession->captureArea(rootWindow, bounds.x, bounds.y, bounds.width, bounds.height)) {
+		cb(*desktopSession);
+	}
+}
+
+// Fetch the current contents of wnd into the shared capture session and call cb with it, all reads
+// inside cb come from the same frame. Throws for windows that are known to be hidden, the buffers of the
+// caller would otherwise keep whatever they held before
+template<typename F>
+void CaptureWindowFrame(OSWindow wnd, CaptureMode mode, F cb) {
+	// There is nothing new to see in a hidden window, don't bother the server with it
+	if (IsKnownHidden(wnd.handle)) {
+		throw std::runtime_error("window not visible");
+	}
+	ensureConnection();
+	std::lock_guard<std::mutex> lock(captureMutex);
+	if (mode == CaptureMode::Desktop) {
+		CaptureDesktopFrame(wnd, cb);
+		return;
+	}
+	if (mode == CaptureMode::OpenGL) {
+		GLHookCapture* hook = FindGLHook(wnd.handle);
+		if (hook && hook->read(glFrameMaxAge, cb)) {
+			return;
+		}
+	}
+
+	// XComposite will always work, OpenGL falls back to it when the client isn't hooked
+	if (redirectedWindows.insert(wnd.handle).second) {
+		xcb_composite_redirect_window(connection, wnd.handle, XCB_COMPOSITE_REDIRECT_AUTOMATIC);
+	}
+	xcb_pixmap_t pixId = xcb_generate_id(connection);
+	xcb_composite_name_window_pixmap(connection, wnd.handle, pixId);
+
+	if (!captureSession) {
+		captureSession = std::make_unique<XShmCapture>(connection);
+	}
+	bool captured = false;
+	try {
+		captured = captureSession->capture(pixId);
+	} catch (...) {
+		xcb_free_pixmap(connection, pixId);
+		throw;
+	}
 	xcb_free_pixmap(connection, pixId);
+	if (captured) {
+		cb(*captureSession);
+	}
 }
 
-OSWindow OSGetActiveWindow() {
+void OSCaptureMulti(OSWindow wnd, CaptureMode mode, vector<CaptureRect> rects, Napi::Env env) {
+	CaptureWindowFrame(wnd, mode, [&rects](auto& acquirer) {
+		for (CaptureRect &rect : rects) {
+			acquirer.copy(reinterpret_cast<char*>(rect.data), rect.size, rect.rect.x, rect.rect.y, rect.rect.width, rect.rect.height);
+		}
+	});
+}
+
+void OSSamplePixels(OSWindow wnd, CaptureMode mode, const int32_t* points, size_t count, uint32_t* out, Napi::Env env) {
+	CaptureWindowFrame(wnd, mode, [points, count, out](auto& acquirer) {
+		for (size_t i = 0; i < count; i++) {
+			out[i] = acquirer.pixel(points[i * 2], points[i * 2 + 1]);
+		}
+	});
+}
+
+// _NET_ACTIVE_WINDOW as last seen by the window thread, only valid while activeWindowTracked is set
+std::atomic<xcb_window_t> activeWindow{ 0 };
+std::atomic<bool> activeWindowTracked{ false };
+
+xcb_window_t FetchActiveWindow() {
 	xcb_get_property_cookie_t cookie = xcb_ewmh_get_active_window(&ewmhConnection, 0);
 	xcb_window_t window;
 	if (xcb_ewmh_get_active_window_reply(&ewmhConnection, cookie, &window, NULL) == 0) {
-		return OSWindow(0);
+		return 0;
 	}
+	return window;
+}
 
-	return OSWindow(window);
+OSWindow OSGetActiveWindow() {
+	if (activeWindowTracked) {
+		return OSWindow(activeWindow);
+	}
+	ensureConnection();
+	return OSWindow(FetchActiveWindow());
 }
 
 
-// Only for use from the window thread
-struct CondPair {
-	std::condition_variable condvar;
-	std::mutex mutex;
-	bool done;
-	CondPair(): done(false) {}
-	CondPair(CondPair& other): done(other.done) {}
-	CondPair(CondPair&& other): done(other.done) {}
+// Js calls that the window, record and click capture threads are waiting on, each waits for its own calls to finish.
+// Calls into an environment that is torn down never run, OSRemoveEnvironment marks those done instead
+struct PendingCall {
+	napi_env env;
+	bool done = false;
+	PendingCall(napi_env env) : env(env) {}
 };
-std::vector<CondPair> condvars;
+std::list<PendingCall> pendingCalls;
+std::mutex pendingCallMutex; // Locks pendingCalls, take after eventMutex
+std::condition_variable pendingCallSignal;
+
 template<typename F, typename COND>
 void IterateEvents(COND cond, F callback) {
+	std::vector<std::list<PendingCall>::iterator> waiting;
 	eventMutex.lock();
 	for (auto it = trackedEvents.begin(); it != trackedEvents.end(); it++) {
 		if (cond(*it)) {
-			condvars.push_back(CondPair());
-			CondPair* pair = &*condvars.end();
-			it->callback.BlockingCall([callback, &pair](Napi::Env env, Napi::Function jsCallback) {
+			// list elements don't move, the js thread can safely signal through this pointer
+			std::list<PendingCall>::iterator call;
+			{
+				std::lock_guard<std::mutex> lock(pendingCallMutex);
+				call = pendingCalls.emplace(pendingCalls.end(), it->env);
+			}
+			PendingCall* pending = &*call;
+			napi_status status = it->callback.BlockingCall([callback, pending](Napi::Env env, Napi::Function jsCallback) {
 				callback(env, jsCallback);
-				std::unique_lock<std::mutex> lock(pair->mutex);
-				pair->done = true;
-				pair->condvar.notify_all();
+				std::lock_guard<std::mutex> lock(pendingCallMutex);
+				pending->done = true;
+				pendingCallSignal.notify_all();
 			});
+			if (status != napi_ok) {
+				// the environment is closing, the call is never going to run
+				std::lock_guard<std::mutex> lock(pendingCallMutex);
+				pending->done = true;
+			}
+			waiting.push_back(call);
 		}
 	}
 	eventMutex.unlock();
-	for(auto it = condvars.begin(); it != condvars.end(); it++) {
-		std::unique_lock<std::mutex> lock(it->mutex);
-		while(!it->done) it->condvar.wait(lock);
+	std::unique_lock<std::mutex> lock(pendingCallMutex);
+	for (auto call : waiting) {
+		pendingCallSignal.wait(lock, [call]() { return call->done; });
+		pendingCalls.erase(call);
 	}
-	condvars.clear();
+}
+
+// Normalize rects into the minimal y-x banded region, consecutive bands with the same spans are merged
+std::vector<xcb_rectangle_t> BandedRegion(const std::vector<JSRectangle>& rects) {
+	std::vector<int> edges;
+	for (const JSRectangle& r : rects) {
+		if (r.width > 0 && r.height > 0) {
+			edges.push_back(r.y);
+			edges.push_back(r.y + r.height);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+	std::vector<xcb_rectangle_t> out;
+	std::vector<std::pair<int, int>> spans;
+	std::vector<std::pair<int, int>> prevSpans;
+	size_t prevStart = 0;
+	int prevBottom = 0;
+	for (size_t i = 0; i + 1 < edges.size(); i++) {
+		int y0 = edges[i];
+		int y1 = edges[i + 1];
+		spans.clear();
+		for (const JSRectangle& r : rects) {
+			if (r.width > 0 && r.height > 0 && r.y <= y0 && r.y + r.height >= y1) {
+				spans.push_back({ r.x, r.x + r.width });
+			}
+		}
+		std::sort(spans.begin(), spans.end());
+		size_t merged = 0;
+		for (size_t j = 0; j < spans.size(); j++) {
+			if (merged != 0 && spans[j].first <= spans[merged - 1].second) {
+				spans[merged - 1].second = std::max(spans[merged - 1].second, spans[j].second);
+			} else {
+				spans[merged++] = spans[j];
+			}
+		}
+		spans.resize(merged);
+		if (spans.empty()) {
+			prevSpans.clear();
+			continue;
+		}
+		if (!prevSpans.empty() && prevBottom == y0 && spans == prevSpans) {
+			for (size_t j = prevStart; j < out.size(); j++) {
+				out[j].height += y1 - y0;
+			}
+		} else {
+			prevStart = out.size();
+			for (auto& span : spans) {
+				out.push_back({ (int16_t)span.first, (int16_t)y0, (uint16_t)(span.second - span.first), (uint16_t)(y1 - y0) });
+			}
+			prevSpans = spans;
+		}
+		prevBottom = y1;
+	}
+	return out;
+}
+
+// Last shape that was sent for each window, shape updates that don't change anything are skipped
+struct WindowShapeState {
+	// false until the first shape was sent, an empty rect list is a real shape that has to go out too
+	bool sent = false;
+	// true when the shape came from a bitmap or was reset, rects is empty in that case
+	bool masked = false;
+	// hash of the bitmap, 0 when the shape was reset
+	uint64_t maskHash = 0;
+	std::vector<xcb_rectangle_t> rects;
+};
+std::mutex shapeMutex;
+std::map<xcb_window_t, WindowShapeState> windowShapes;
+
+bool operator==(const xcb_rectangle_t& a, const xcb_rectangle_t& b) {
+	return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
 }
 
 void OSSetWindowShape(OSWindow window, std::vector<JSRectangle> rects) {
 	ensureConnection();
-	std::vector<xcb_rectangle_t> xrects;
-	xrects.reserve(rects.size());
-	for (size_t i = 0; i < rects.size(); i += 1) {
-		xcb_rectangle_t rect;
-		rect.x = rects[i].x;
-		rect.y = rects[i].y;
-		rect.width = rects[i].width;
-		rect.height = rects[i].height;
-		xrects.push_back(rect);
-	}
-	uint8_t ordering = 0;
-	if (xrects.size() < 2) ordering = 3;
+	std::vector<xcb_rectangle_t> xrects = BandedRegion(rects);
+
+	std::lock_guard<std::mutex> lock(shapeMutex);
+	WindowShapeState& state = windowShapes[window.handle];
 	//TODO this 5k x 5k special case is weird, implement separate clear call again?
-	if (rects.size() == 1 && rects[1].width >= 5000 && rects[1].height >= 5000) {
-		xcb_shape_mask(connection, 0, XCB_SHAPE_SK_INPUT, window.handle, 0, 0, 0);
+	if (xrects.size() == 1 && xrects[0].width >= 5000 && xrects[0].height >= 5000) {
+		if (state.sent && state.masked && state.maskHash == 0) {
+			return;
+		}
+		xcb_shape_mask(connection, XCB_SHAPE_SO_SET, XCB_SHAPE_SK_INPUT, window.handle, 0, 0, XCB_NONE);
+		state.masked = true;
+		state.maskHash = 0;
+		state.rects.clear();
 	}
 	else {
-		xcb_shape_rectangles(connection, XCB_SHAPE_SO_SET, XCB_SHAPE_SK_INPUT, ordering, window.handle, 0, 0, xrects.size(), xrects.data());
+		if (state.sent && !state.masked && state.rects == xrects) {
+			return;
+		}
+		xcb_shape_rectangles(connection, XCB_SHAPE_SO_SET, XCB_SHAPE_SK_INPUT, XCB_CLIP_ORDERING_YX_BANDED, window.handle, 0, 0, xrects.size(), xrects.data());
+		state.masked = false;
+		state.rects = std::move(xrects);
 	}
+	state.sent = true;
 	xcb_flush(connection);
 }
 
+void OSSetWindowShapeMask(OSWindow window, const uint8_t* rgba, int width, int height) {
+	ensureConnection();
+	const xcb_setup_t* setup = xcb_get_setup(connection);
+	// rows are padded to the scanline unit of the server, usually 32 bits
+	size_t stride = ((size_t)width + setup->bitmap_format_scanline_pad - 1) / setup->bitmap_format_scanline_pad * setup->bitmap_format_scanline_pad / 8;
+	bool lsbFirst = setup->bitmap_format_bit_order == XCB_IMAGE_ORDER_LSB_FIRST;
+	std::vector<uint8_t> bits(stride * height, 0);
+	uint64_t hash = 14695981039346656037ull;
+	for (int y = 0; y < height; y++) {
+		uint8_t* row = bits.data() + y * stride;
+		for (int x = 0; x < width; x++) {
+			if (rgba[((size_t)y * width + x) * 4 + 3] >= 128) {
+				row[x / 8] |= (lsbFirst ? 1 << (x % 8) : 0x80 >> (x % 8));
+			}
+		}
+		for (size_t i = 0; i < stride; i++) {
+			hash = (hash ^ row[i]) * 1099511628211ull;
+		}
+	}
+	hash ^= ((uint64_t)width << 32) | (uint32_t)height;
+	// 0 is reserved for a reset shape
+	hash |= 1;
+
+	std::lock_guard<std::mutex> lock(shapeMutex);
+	WindowShapeState& state = windowShapes[window.handle];
+	if (state.sent && state.masked && state.maskHash == hash) {
+		return;
+	}
+
+	xcb_pixmap_t pixmap = xcb_generate_id(connection);
+	xcb_create_pixmap(connection, 1, pixmap, window.handle, width, height);
+	// XY_BITMAP draws set bits in the foreground and clear ones in the background, the defaults are the other way around
+	xcb_gcontext_t gc = xcb_generate_id(connection);
+	const uint32_t gcValues[] = { 1, 0 };
+	xcb_create_gc(connection, gc, pixmap, XCB_GC_FOREGROUND | XCB_GC_BACKGROUND, gcValues);
+	// split the upload so every request fits in the maximum request size
+	size_t maxBytes = xcb_get_maximum_request_length(connection) * 4 - 64;
+	int rowsPerRequest = std::max<int>(1, maxBytes / std::max<size_t>(1, stride));
+	for (int y = 0; y < height; y += rowsPerRequest) {
+		int rows = std::min(rowsPerRequest, height - y);
+		xcb_put_image(connection, XCB_IMAGE_FORMAT_XY_BITMAP, pixmap, gc, width, rows, 0, y, 0, 1, stride * rows, bits.data() + y * stride);
+	}
+	xcb_shape_mask(connection, XCB_SHAPE_SO_SET, XCB_SHAPE_SK_INPUT, window.handle, 0, 0, pixmap);
+	xcb_free_gc(connection, gc);
+	xcb_free_pixmap(connection, pixmap);
+	xcb_flush(connection);
+
+	state.sent = true;
+	state.masked = true;
+	state.maskHash = hash;
+	state.rects.clear();
+}
+
+std::mutex overlayMutex;
+std::map<xcb_window_t, std::unique_ptr<XOverlay>> overlays;
+
+void OSDrawOverlay(OSWindow wnd, JSRectangle bounds, const vector<OverlayPrimitive>& primitives) {
+	ensureConnection();
+	std::lock_guard<std::mutex> lock(overlayMutex);
+	auto& overlay = overlays[wnd.handle];
+	if (!overlay) {
+		try {
+			overlay = std::make_unique<XOverlay>(connection, xcb_setup_roots_iterator(xcb_get_setup(connection)).data);
+		} catch (...) {
+			overlays.erase(wnd.handle);
+			throw;
+		}
+		// clicks should go through to the game
+		OSSetWindowShape(OSWindow(overlay->window), {});
+	}
+	overlay->setBounds(bounds);
+	overlay->draw(primitives);
+	// keep the overlay on top of the game when it gets raised
+	const uint32_t stack = XCB_STACK_MODE_ABOVE;
+	xcb_configure_window(connection, overlay->window, XCB_CONFIG_WINDOW_STACK_MODE, &stack);
+	xcb_flush(connection);
+}
+
+void OSCloseOverlay(OSWindow wnd) {
+	std::lock_guard<std::mutex> lock(overlayMutex);
+	overlays.erase(wnd.handle);
+}
+
 bool OSGetMouseState() {
 	return isLeftMouseDown;
 }
 
+// The X events needed for the listeners of window, must be called with eventMutex held
+uint32_t ListenerEventMask(xcb_window_t window) {
+	uint32_t mask = 0;
+	for (const TrackedEvent& e : trackedEvents) {
+		if (e.window != window) {
+			continue;
+		}
+		mask |= XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+		if (e.type == WindowEventType::Visibility) {
+			mask |= XCB_EVENT_MASK_VISIBILITY_CHANGE | XCB_EVENT_MASK_PROPERTY_CHANGE;
+		}
+	}
+	return mask;
+}
+
+bool HasListener(xcb_window_t window, WindowEventType type) {
+	return std::any_of(trackedEvents.begin(), trackedEvents.end(), [window, type](const TrackedEvent& e) { return e.window == window && e.type == type; });
+}
+
 void OSNewWindowListener(OSWindow window, WindowEventType type, Napi::Function callback) {
+	ensureConnection();
 	auto event = TrackedEvent(window.handle, type, callback);
 
-	// If this is a new window, request all its events from X server
+	// Add the event and request the X events it needs
 	eventMutex.lock();
-	if (window.handle != 0 && std::find_if(trackedEvents.begin(), trackedEvents.end(), [window](TrackedEvent& e) {return e.window == window.handle;}) == trackedEvents.end()) {
-		constexpr uint32_t values[] = { XCB_EVENT_MASK_STRUCTURE_NOTIFY };
+	bool newVisibility = type == WindowEventType::Visibility && !HasListener(window.handle, type);
+	trackedEvents.push_back(std::move(event));
+	if (window.handle != 0) {
+		const uint32_t values[] = { ListenerEventMask(window.handle) };
 		xcb_change_window_attributes(connection, window.handle, XCB_CW_EVENT_MASK, values);
 	}
-	
-	// Add the event
-	trackedEvents.push_back(std::move(event));
 	eventMutex.unlock();
 
+	// Events are selected before reading the initial state, so no change can be missed
+	if (newVisibility) {
+		WindowVisibility visibility = FetchVisibility(window.handle);
+		std::lock_guard<std::mutex> lock(visibilityMutex);
+		windowVisibility[window.handle] = visibility;
+	}
+
 	// Start a window thread if there wasn't already one running
 	StartWindowThread();
 }
@@ -317,12 +896,6 @@ void OSNewWindowListener(OSWindow window, WindowEventType type, Napi::Function c
 void OSRemoveWindowListener(OSWindow window, WindowEventType type, Napi::Function callback) {
 	eventMutex.lock();
 
-	// If there are no more tracked events for this window, request X server to stop sending any events about it
-	if (window.handle != 0 && std::find_if(trackedEvents.begin(), trackedEvents.end(), [window](TrackedEvent& e) {return e.window == window.handle;}) == trackedEvents.end()) {
-		constexpr uint32_t values[] = { XCB_NONE };
-		xcb_change_window_attributes_checked(connection, window.handle, XCB_CW_EVENT_MASK, values);
-	}
-
 	bool wait = trackedEvents.size() != 0;
 
 	// Remove any matching events
@@ -341,16 +914,22 @@ void OSRemoveWindowListener(OSWindow window, WindowEventType type, Napi::Functio
 		trackedEvents.end()
 	);
 
+	// Only keep requesting the X events that remaining listeners need, none if there are no more
+	if (window.handle != 0) {
+		const uint32_t values[] = { ListenerEventMask(window.handle) };
+		xcb_change_window_attributes(connection, window.handle, XCB_CW_EVENT_MASK, values);
+		xcb_flush(connection);
+	}
+	if (type == WindowEventType::Visibility && !HasListener(window.handle, type)) {
+		std::lock_guard<std::mutex> lock(visibilityMutex);
+		windowVisibility.erase(window.handle);
+	}
+
 	wait &= trackedEvents.size() == 0;
 	eventMutex.unlock();
 
-	// If the window thread has nothing left to do, send it a wakeup, then wait for it to exit
 	if (wait) {
-		xcb_disconnect(connection);
-		xcb_flush(connection);
-		windowThread.join();
-		recordThread.join();
-		connection = NULL;
+		StopWindowThreadIfIdle();
 	}
 }
 
@@ -358,7 +937,251 @@ bool WindowThreadShouldRun() {
 	eventMutex.lock();
 	bool anyEvents = trackedEvents.size() != 0;
 	eventMutex.unlock();
-	return anyEvents;
+	std::lock_guard<std::mutex> lock(damageMutex);
+	return anyEvents || !damagedWindows.empty();
+}
+
+// Drops everything that lives on the X connection, must be called while the connection is still open. The server
+// destroys our overlays and undoes our redirects on disconnect anyway, but the sessions would keep using it
+void ReleaseConnectionState() {
+	{
+		std::lock_guard<std::mutex> lock(overlayMutex);
+		overlays.clear();
+	}
+	std::lock_guard<std::mutex> lock(captureMutex);
+	for (xcb_window_t window : redirectedWindows) {
+		xcb_composite_unredirect_window(connection, window, XCB_COMPOSITE_REDIRECT_AUTOMATIC);
+	}
+	redirectedWindows.clear();
+	captureSession.reset();
+	desktopSession.reset();
+	xcb_flush(connection);
+}
+
+// Stops the event threads when nothing needs them anymore. The connection stays open, other environments and
+// capture calls keep using it, OSRemoveEnvironment closes it once the last environment is gone
+void StopWindowThreadIfIdle() {
+	std::lock_guard<std::mutex> lock(windowThreadMutex);
+	if (!windowThread.joinable() || WindowThreadShouldRun()) {
+		return;
+	}
+	windowThreadStopping = true;
+	{
+		std::lock_guard<std::mutex> lock(clickCaptureMutex);
+		clickCaptureStop = true;
+	}
+	clickCaptureSignal.notify_all();
+	{
+		// ends the blocking enable_context reply on the record connection, a context that isn't enabled yet is
+		// disabled by the record thread itself once it sees windowThreadStopping
+		std::lock_guard<std::mutex> lock(recordMutex);
+		if (recordContext != 0) {
+			xcb_record_disable_context(connection, recordContext);
+		}
+	}
+	// nobody reads events from the connection until the thread starts again
+	const uint32_t rootValues[] = { 0 };
+	xcb_change_window_attributes(connection, rootWindow, XCB_CW_EVENT_MASK, rootValues);
+	xcb_client_message_event_t wakeup = {};
+	wakeup.response_type = XCB_CLIENT_MESSAGE;
+	wakeup.format = 32;
+	wakeup.window = windowThreadWakeup;
+	wakeup.type = XCB_ATOM_NONE;
+	xcb_send_event(connection, 0, windowThreadWakeup, XCB_EVENT_MASK_NO_EVENT, (const char*)&wakeup);
+	xcb_flush(connection);
+
+	clickCaptureThread.join();
+	windowThread.join();
+	recordThread.join();
+	clickCaptureStop = false;
+	windowThreadStopping = false;
+	windowThreadExists = false;
+	xcb_destroy_window(connection, windowThreadWakeup);
+	xcb_flush(connection);
+	windowThreadWakeup = 0;
+}
+
+// Environments (main thread and workers) that loaded the addon
+size_t environmentCount = 0;
+std::mutex environmentMutex; // Locks environmentCount, take before the other mutexes
+
+void OSAddEnvironment(Napi::Env env) {
+	std::lock_guard<std::mutex> lock(environmentMutex);
+	environmentCount++;
+	// connect while js is still starting up, the first api call then finds the connection ready
+	startConnection();
+}
+
+void OSRemoveEnvironment(Napi::Env env) {
+	napi_env handle = env;
+	std::lock_guard<std::mutex> envLock(environmentMutex);
+
+	// The listeners of env can't be called anymore, drop them the same way OSRemoveWindowListener does
+	eventMutex.lock();
+	std::set<xcb_window_t> windows;
+	trackedEvents.erase(
+		std::remove_if(trackedEvents.begin(), trackedEvents.end(), [handle, &windows](TrackedEvent& e) {
+			if (e.env != handle) {
+				return false;
+			}
+			windows.insert(e.window);
+			e.callback.Release();
+			return true;
+		}),
+		trackedEvents.end()
+	);
+	for (xcb_window_t window : windows) {
+		if (window != 0 && connection != NULL) {
+			const uint32_t values[] = { ListenerEventMask(window) };
+			xcb_change_window_attributes(connection, window, XCB_CW_EVENT_MASK, values);
+		}
+		if (!HasListener(window, WindowEventType::Visibility)) {
+			std::lock_guard<std::mutex> lock(visibilityMutex);
+			windowVisibility.erase(window);
+		}
+	}
+	if (connection != NULL) {
+		xcb_flush(connection);
+	}
+	eventMutex.unlock();
+	{
+		// event threads may be blocked on calls that will never run now
+		std::lock_guard<std::mutex> lock(pendingCallMutex);
+		for (PendingCall& call : pendingCalls) {
+			if (call.env == handle) {
+				call.done = true;
+			}
+		}
+	}
+	pendingCallSignal.notify_all();
+
+	if (--environmentCount != 0) {
+		StopWindowThreadIfIdle();
+		return;
+	}
+
+	// Last one out, release the shared state so an exiting worker doesn't leave a connection and threads behind
+	{
+		std::lock_guard<std::mutex> lock(clickCaptureMutex);
+		clickCaptureConfigs.clear();
+	}
+	{
+		std::lock_guard<std::mutex> lock(pinMutex);
+		windowPins.clear();
+	}
+	{
+		std::lock_guard<std::mutex> lock(shapeMutex);
+		windowShapes.clear();
+	}
+	{
+		std::lock_guard<std::mutex> lock(captureMutex);
+		glHookedWindows.clear();
+	}
+	if (connection != NULL) {
+		{
+			std::lock_guard<std::mutex> lock(damageMutex);
+			for (auto& entry : damagedWindows) {
+				xcb_damage_destroy(connection, entry.second.damage);
+			}
+			damagedWindows.clear();
+		}
+		ReleaseConnectionState();
+	}
+	StopWindowThreadIfIdle();
+	{
+		// capture calls from other threads may still be using the connection
+		std::lock_guard<std::mutex> capture(captureMutex);
+		std::lock_guard<std::mutex> damage(damageMutex);
+		closeConnection();
+		damageInitialized = false;
+	}
+}
+
+// Must be called with damageMutex held, extension info belongs to the current connection
+bool EnsureDamage() {
+	if (!damageInitialized) {
+		damageInitialized = true;
+		damageFirstEvent = 0;
+		const xcb_query_extension_reply_t* extension = xcb_get_extension_data(connection, &xcb_damage_id);
+		if (extension && extension->present) {
+			free(xcb_damage_query_version_reply(connection, xcb_damage_query_version(connection, XCB_DAMAGE_MAJOR_VERSION, XCB_DAMAGE_MINOR_VERSION), NULL));
+			damageFirstEvent = extension->first_event;
+		}
+	}
+	return damageFirstEvent != 0;
+}
+
+void TrackDamage(xcb_window_t window) {
+	ensureConnection();
+	{
+		std::lock_guard<std::mutex> lock(damageMutex);
+		if (!EnsureDamage()) {
+			throw std::runtime_error("X damage extension is not available");
+		}
+		DamagedWindow& entry = damagedWindows[window];
+		if (entry.users++ == 0) {
+			entry.damage = xcb_generate_id(connection);
+			xcb_damage_create(connection, entry.damage, window, XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY);
+			xcb_flush(connection);
+		}
+	}
+	StartWindowThread();
+}
+
+void UntrackDamage(xcb_window_t window) {
+	{
+		std::lock_guard<std::mutex> lock(damageMutex);
+		auto it = damagedWindows.find(window);
+		if (it == damagedWindows.end()) {
+			return;
+		}
+		if (--it->second.users == 0) {
+			xcb_damage_destroy(connection, it->second.damage);
+			xcb_flush(connection);
+			damagedWindows.erase(it);
+		}
+	}
+	StopWindowThreadIfIdle();
+}
+
+// Should only be called from the window thread
+void HandleDamage(const xcb_damage_notify_event_t* notify) {
+	auto now = FrameTimer::clock::now();
+	std::lock_guard<std::mutex> lock(damageMutex);
+	auto it = damagedWindows.find(notify->drawable);
+	if (it == damagedWindows.end() || it->second.damage != notify->damage) {
+		return;
+	}
+	// non-empty level only reports again after the damage is cleared
+	xcb_damage_subtract(connection, notify->damage, XCB_NONE, XCB_NONE);
+	xcb_flush(connection);
+	it->second.frames.addFrame(now);
+	damageSignal.notify_all();
+}
+
+void OSStartFrameTracking(OSWindow wnd) {
+	TrackDamage(wnd.handle);
+}
+
+void OSStopFrameTracking(OSWindow wnd) {
+	UntrackDamage(wnd.handle);
+}
+
+OSFrameStats OSGetFrameStats(OSWindow wnd) {
+	{
+		// swaps of a hooked client are exact, damage can't tell frames apart from other redraws
+		std::lock_guard<std::mutex> lock(captureMutex);
+		auto hooked = glHookedWindows.find(wnd.handle);
+		if (hooked != glHookedWindows.end() && hooked->second.capture) {
+			return hooked->second.capture->frameStats(FrameTimer::clock::now());
+		}
+	}
+	std::lock_guard<std::mutex> lock(damageMutex);
+	auto it = damagedWindows.find(wnd.handle);
+	if (it == damagedWindows.end()) {
+		return OSFrameStats();
+	}
+	return it->second.frames.stats(FrameTimer::clock::now());
 }
 
 void StartWindowThread() {
@@ -366,8 +1189,13 @@ void StartWindowThread() {
 	windowThreadMutex.lock();
 	if (!windowThreadExists) {
 		windowThreadExists = true;
+		// never mapped, client messages sent to it with an empty event mask go to us
+		windowThreadWakeup = xcb_generate_id(connection);
+		xcb_create_window(connection, 0, windowThreadWakeup, rootWindow, 0, 0, 1, 1, 0, XCB_WINDOW_CLASS_INPUT_ONLY, XCB_COPY_FROM_PARENT, 0, NULL);
+		xcb_flush(connection);
 		windowThread = std::thread(WindowThread);
 		recordThread = std::thread(RecordThread);
+		clickCaptureThread = std::thread(ClickCaptureThread);
 	}
 	windowThreadMutex.unlock();
 }
@@ -411,13 +1239,39 @@ void HandleNewWindow(const xcb_window_t window, xcb_window_t parent) {
 	}
 }
 
+// Should only be called from the window thread, calls the visibility listeners if the state changed
+template<typename F>
+void UpdateVisibility(xcb_window_t window, F update) {
+	OSWindowVisibility state;
+	{
+		std::lock_guard<std::mutex> lock(visibilityMutex);
+		auto it = windowVisibility.find(window);
+		if (it == windowVisibility.end()) {
+			return;
+		}
+		OSWindowVisibility before = it->second.state();
+		update(it->second);
+		state = it->second.state();
+		if (state == before) {
+			return;
+		}
+	}
+	IterateEvents(
+		[window](const TrackedEvent& e){return e.type == WindowEventType::Visibility && e.window == window;},
+		[state](Napi::Env env, Napi::Function callback){callback.Call({Napi::String::New(env, WindowVisibilityText(state))});}
+	);
+}
+
 void WindowThread() {
-	// Request substructure events for root window
-	constexpr uint32_t rootValues[] = { XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY };
+	// Request substructure events for root window, property changes are needed to follow _NET_ACTIVE_WINDOW
+	constexpr uint32_t rootValues[] = { XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY | XCB_EVENT_MASK_PROPERTY_CHANGE };
     xcb_change_window_attributes(connection, rootWindow, XCB_CW_EVENT_MASK, rootValues);
+	// events are only delivered after the mask change, so this can't miss a change
+	activeWindow = FetchActiveWindow();
+	activeWindowTracked = true;
 
 	xcb_generic_event_t* event;
-	while (WindowThreadShouldRun()) {
+	while (!windowThreadStopping) {
 		event = xcb_wait_for_event(connection);
 		if (event) {
 			auto type = event->response_type & ~0x80;
@@ -431,6 +1285,8 @@ void WindowThread() {
 					xcb_configure_notify_event_t* configure = (xcb_configure_notify_event_t*)event;
 					xcb_window_t window = configure->window;
 					JSRectangle bounds = JSRectangle(configure->x, configure->y, configure->width, configure->height);
+					// move pinned windows first, js only hears about it afterwards
+					ApplyWindowPins(window);
 					IterateEvents(
 						[window](const TrackedEvent& e){return e.type == WindowEventType::Move && e.window == window;},
 						[bounds](Napi::Env env, Napi::Function callback){callback.Call({bounds.ToJs(env), Napi::String::New(env, "end")});}
@@ -447,6 +1303,16 @@ void WindowThread() {
 				case XCB_DESTROY_NOTIFY: {
 					xcb_destroy_notify_event_t* destroy = (xcb_destroy_notify_event_t*)event;
 					xcb_window_t window = destroy->window;
+					{
+						// the id can be reused for a new window that isn't redirected yet
+						std::lock_guard<std::mutex> lock(captureMutex);
+						redirectedWindows.erase(window);
+						glHookedWindows.erase(window);
+					}
+					{
+						std::lock_guard<std::mutex> lock(shapeMutex);
+						windowShapes.erase(window);
+					}
 					IterateEvents(
 						[window](const TrackedEvent& e){return e.type == WindowEventType::Close && e.window == window;},
 						[](Napi::Env env, Napi::Function callback){callback.Call({});}
@@ -460,12 +1326,51 @@ void WindowThread() {
 					}
 					break;
 				}
-				case XCB_EXPOSE: {
-					// Not an important event, but we use XCB_EXPOSE to wake up the window thread spontaneously,
-					// so it's important to catch it here
+				case XCB_MAP_NOTIFY: {
+					xcb_map_notify_event_t* map = (xcb_map_notify_event_t*)event;
+					UpdateVisibility(map->window, [](WindowVisibility& v) { v.mapped = true; });
+					break;
+				}
+				case XCB_UNMAP_NOTIFY: {
+					xcb_unmap_notify_event_t* unmap = (xcb_unmap_notify_event_t*)event;
+					UpdateVisibility(unmap->window, [](WindowVisibility& v) { v.mapped = false; });
+					break;
+				}
+				case XCB_VISIBILITY_NOTIFY: {
+					xcb_visibility_notify_event_t* visibility = (xcb_visibility_notify_event_t*)event;
+					bool obscured = visibility->state == XCB_VISIBILITY_FULLY_OBSCURED;
+					UpdateVisibility(visibility->window, [obscured](WindowVisibility& v) { v.obscured = obscured; });
+					break;
+				}
+				case XCB_PROPERTY_NOTIFY: {
+					xcb_property_notify_event_t* property = (xcb_property_notify_event_t*)event;
+					if (property->window != rootWindow && property->atom == ewmhConnection._NET_WM_STATE) {
+						bool hidden = FetchVisibility(property->window).hidden;
+						UpdateVisibility(property->window, [hidden](WindowVisibility& v) { v.hidden = hidden; });
+						break;
+					}
+					if (property->window != rootWindow || property->atom != ewmhConnection._NET_ACTIVE_WINDOW) {
+						break;
+					}
+					xcb_window_t window = FetchActiveWindow();
+					if (window == activeWindow.exchange(window)) {
+						break;
+					}
+					IterateEvents(
+						[](const TrackedEvent& e){return e.type == WindowEventType::ActiveChange && e.window == 0;},
+						[window](Napi::Env env, Napi::Function callback){callback.Call({Napi::BigInt::New(env, (uint64_t)window)});}
+					);
+					break;
+				}
+				case XCB_CLIENT_MESSAGE: {
+					// StopWindowThreadIfIdle sends one to windowThreadWakeup, the loop condition does the rest
 					break;
 				}
 				default: {
+					if (damageFirstEvent != 0 && type == damageFirstEvent + XCB_DAMAGE_NOTIFY) {
+						HandleDamage((xcb_damage_notify_event_t*)event);
+						break;
+					}
 					//std::cout << "native: got event type " << type << std::endl;
 					break;
 				}
@@ -477,7 +1382,7 @@ void WindowThread() {
 		}
 	}
 
-	windowThreadExists = false;
+	activeWindowTracked = false;
 	std::cout << "native: window thread exiting" << std::endl;
 }
 
@@ -565,6 +1470,107 @@ xcb_window_t HitTest(int16_t x, int16_t y) {
 	return out;
 }
 
+void OSSetClickCapture(OSWindow wnd, const ClickCaptureConfig* config) {
+	std::lock_guard<std::mutex> lock(clickCaptureMutex);
+	if (config) {
+		clickCaptureConfigs[wnd.handle] = *config;
+	} else {
+		clickCaptureConfigs.erase(wnd.handle);
+	}
+}
+
+// Called from the record thread, returns false if the click should be delivered right away without capture
+bool QueueClickCapture(xcb_window_t window, int16_t x, int16_t y) {
+	std::lock_guard<std::mutex> lock(clickCaptureMutex);
+	auto config = clickCaptureConfigs.find(window);
+	if (config == clickCaptureConfigs.end()) {
+		return false;
+	}
+	ClickCaptureJob job = { window, x, y, config->second, 0, std::chrono::steady_clock::now() };
+	{
+		std::lock_guard<std::mutex> damageLock(damageMutex);
+		auto damaged = damagedWindows.find(window);
+		if (damaged != damagedWindows.end()) {
+			job.startFrame = damaged->second.frames.totalFrames();
+		}
+	}
+	clickCaptureJobs.push_back(job);
+	clickCaptureSignal.notify_all();
+	return true;
+}
+
+void RunClickCapture(const ClickCaptureJob& job) {
+	// wait for the client to render the result of the click, without damage tracking only the timeout is left
+	{
+		auto deadline = job.time + std::chrono::milliseconds(job.config.timeout);
+		std::unique_lock<std::mutex> lock(damageMutex);
+		damageSignal.wait_until(lock, deadline, [&job]() {
+			auto it = damagedWindows.find(job.window);
+			return it != damagedWindows.end() && it->second.frames.totalFrames() >= job.startFrame + job.config.frames;
+		});
+	}
+
+	struct Result {
+		JSRectangle rect;
+		int clickx, clicky;
+		std::vector<uint8_t> pixels;
+	};
+	auto result = std::make_shared<Result>();
+	try {
+		JSRectangle client = OSWindow(job.window).GetClientBounds();
+		result->clickx = job.x - client.x;
+		result->clicky = job.y - client.y;
+		int x1 = std::max(0, result->clickx - job.config.width / 2);
+		int y1 = std::max(0, result->clicky - job.config.height / 2);
+		int x2 = std::min(client.width, result->clickx - job.config.width / 2 + job.config.width);
+		int y2 = std::min(client.height, result->clicky - job.config.height / 2 + job.config.height);
+		result->rect = JSRectangle(x1, y1, x2 - x1, y2 - y1);
+		if (result->rect.width > 0 && result->rect.height > 0) {
+			std::vector<uint8_t> pixels((size_t)result->rect.width * result->rect.height * 4);
+			CaptureWindowFrame(OSWindow(job.window), job.config.mode, [&result, &pixels](auto& acquirer) {
+				acquirer.copy(reinterpret_cast<char*>(pixels.data()), pixels.size(), result->rect.x, result->rect.y, result->rect.width, result->rect.height);
+			});
+			result->pixels = std::move(pixels);
+		}
+	} catch (...) {
+		// still deliver the click, js falls back to capturing on its own
+	}
+
+	IterateEvents(
+		[&job](const TrackedEvent& e){return e.type == WindowEventType::Click && e.window == job.window;},
+		[result](Napi::Env env, Napi::Function callback) {
+			if (result->pixels.empty()) {
+				callback.Call({});
+				return;
+			}
+			auto buffer = Napi::ArrayBuffer::New(env, result->pixels.size());
+			memcpy(buffer.Data(), result->pixels.data(), result->pixels.size());
+			auto capture = Napi::Object::New(env);
+			capture.Set("x", result->clickx);
+			capture.Set("y", result->clicky);
+			capture.Set("rect", result->rect.ToJs(env));
+			capture.Set("data", Napi::Uint8Array::New(env, result->pixels.size(), buffer, 0, napi_uint8_clamped_array));
+			callback.Call({ capture });
+		}
+	);
+}
+
+void ClickCaptureThread() {
+	std::unique_lock<std::mutex> lock(clickCaptureMutex);
+	while (true) {
+		clickCaptureSignal.wait(lock, []() { return clickCaptureStop || !clickCaptureJobs.empty(); });
+		if (clickCaptureStop) {
+			break;
+		}
+		ClickCaptureJob job = clickCaptureJobs.front();
+		clickCaptureJobs.pop_front();
+		lock.unlock();
+		RunClickCapture(job);
+		lock.lock();
+	}
+	clickCaptureJobs.clear();
+}
+
 void RecordThread() {
 	// Second event thread for using the X Record API, which we need to receive mouse button events
 	const xcb_query_extension_reply_t* ext = xcb_get_extension_data(connection, &xcb_record_id);
@@ -603,10 +1609,13 @@ void RecordThread() {
 
 	// xcb-record event loop
 	xcb_record_enable_context_cookie_t cookie2 = xcb_record_enable_context(rec_connection, id);
-	while (WindowThreadShouldRun()) {
+	while (true) {
 		xcb_record_enable_context_reply_t* reply = xcb_record_enable_context_reply(rec_connection, cookie2, NULL);
 		if (!reply) {
 			std::cout << "native: error in xcb_record_enable_context_reply" << std::endl;
+			if (xcb_connection_has_error(rec_connection)) {
+				break;
+			}
 			continue;
 		}
 		if (reply->client_swapped) {
@@ -615,8 +1624,19 @@ void RecordThread() {
 		}
 
 		// 0 is XRecordFromServer; we also receive 4 (XRecordStartOfData) at the start of execution, and
-		// 5 (XRecordEndOfData) when we invalidate the main connection, which works as this thread's end-wakeup
-		if (reply->category == 0) {
+		// 5 (XRecordEndOfData) when StopWindowThreadIfIdle disables the context, which works as this thread's end-wakeup
+		if (reply->category == 4) {
+			std::lock_guard<std::mutex> lock(recordMutex);
+			recordContext = id;
+			if (windowThreadStopping) {
+				// the stop request came before the context was enabled
+				xcb_record_disable_context(connection, id);
+				xcb_flush(connection);
+			}
+		} else if (reply->category == 5) {
+			free(reply);
+			break;
+		} else if (reply->category == 0) {
 			uint8_t* data = xcb_record_enable_context_data(reply);
 			int data_len = xcb_record_enable_context_data_length(reply);
 			if (data_len == sizeof(xcb_button_press_event_t)) {
@@ -629,10 +1649,12 @@ void RecordThread() {
 							int16_t click_x = event->root_x;
 							int16_t click_y = event->root_y;
 							xcb_window_t hit = HitTest(click_x, click_y);
-							IterateEvents(
-								[hit](const TrackedEvent& e){return e.type == WindowEventType::Click && e.window == hit;},
-								[](Napi::Env env, Napi::Function callback){callback.Call({});}
-							);
+							if (!QueueClickCapture(hit, click_x, click_y)) {
+								IterateEvents(
+									[hit](const TrackedEvent& e){return e.type == WindowEventType::Click && e.window == hit;},
+									[](Napi::Env env, Napi::Function callback){callback.Call({});}
+								);
+							}
 						}
 						if(button == 1){
 							isLeftMouseDown = true;
@@ -653,7 +1675,10 @@ void RecordThread() {
 		free(reply);
 	}
 
-	xcb_record_disable_context(rec_connection, id);
+	{
+		std::lock_guard<std::mutex> lock(recordMutex);
+		recordContext = 0;
+	}
 	xcb_record_free_context(rec_connection, id);
 	xcb_flush(rec_connection);
 	xcb_disconnect(rec_connection);
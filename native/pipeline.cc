@@ -0,0 +1,328 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "pipeline.h"
+#include "derived.h"
+
+uint8_t* ImagePipeline::arenaBase() {
+	uintptr_t start = reinterpret_cast<uintptr_t>(this->arena.data());
+	return this->arena.data() + (((start + 63) & ~(uintptr_t)63) - start);
+}
+
+size_t ImagePipeline::allocate(size_t size) {
+	size_t offset = (this->arenaSize + 63) & ~(size_t)63;
+	this->arenaSize = offset + size;
+	return offset;
+}
+
+void ImagePipeline::addChain(JSRectangle capture, std::vector<PipelineStage> stages) {
+	if (capture.width <= 0 || capture.height <= 0 || capture.width > 1e4 || capture.height > 1e4) {
+		throw std::invalid_argument("invalid capture size");
+	}
+	PipelineChain chain;
+	chain.capture = capture;
+	chain.captureOffset = allocate((size_t)capture.width * capture.height * 4);
+
+	int width = capture.width;
+	int height = capture.height;
+	int channels = 4;
+	bool ended = false;
+	for (PipelineStage& stage : stages) {
+		if (ended) {
+			throw std::invalid_argument("histogram and findSubImage have to be the last stage");
+		}
+		switch (stage.op) {
+		case PipelineOp::Crop: {
+			const JSRectangle& r = stage.rect;
+			if (r.x < 0 || r.y < 0 || r.width <= 0 || r.height <= 0 || r.x + r.width > width || r.y + r.height > height) {
+				throw std::invalid_argument("crop outside of image");
+			}
+			width = r.width;
+			height = r.height;
+			break;
+		}
+		case PipelineOp::Channel:
+			if (channels != 4) {
+				throw std::invalid_argument("channel needs an rgba image");
+			}
+			if (stage.channel < 0 || stage.channel > 4) {
+				throw std::invalid_argument("unknown channel");
+			}
+			channels = 1;
+			stage.offset = allocate((size_t)width * height);
+			break;
+		case PipelineOp::Threshold:
+			if (channels != 1) {
+				throw std::invalid_argument("threshold needs a single channel image");
+			}
+			stage.offset = allocate((size_t)width * height);
+			break;
+		case PipelineOp::Downscale:
+			if (stage.value < 1 || width / stage.value == 0 || height / stage.value == 0) {
+				throw std::invalid_argument("invalid downscale factor");
+			}
+			width /= stage.value;
+			height /= stage.value;
+			stage.offset = allocate((size_t)width * height * channels);
+			break;
+		case PipelineOp::Histogram:
+			ended = true;
+			break;
+		case PipelineOp::FindSubImage:
+			if (channels != 4) {
+				throw std::invalid_argument("findSubImage needs an rgba image");
+			}
+			if (stage.needleWidth <= 0 || stage.needleHeight <= 0 || stage.needle.size() < (size_t)stage.needleWidth * stage.needleHeight * 4) {
+				throw std::invalid_argument("image data does not match size");
+			}
+			if (stage.rect.width <= 0 || stage.rect.height <= 0) {
+				stage.rect = JSRectangle(0, 0, width, height);
+			}
+			ended = true;
+			break;
+		}
+		stage.width = width;
+		stage.height = height;
+		stage.channels = channels;
+	}
+	chain.stages = std::move(stages);
+	this->chains.push_back(std::move(chain));
+	this->arena.resize(this->arenaSize + 63);
+}
+
+std::vector<PipelineResult> ImagePipeline::run(OSWindow wnd, CaptureMode mode, Napi::Env env) {
+	std::vector<CaptureRect> capts;
+	for (PipelineChain& chain : this->chains) {
+		capts.emplace_back(arenaBase() + chain.captureOffset, (size_t)chain.capture.width * chain.capture.height * 4, chain.capture);
+	}
+	OSCaptureMulti(wnd, mode, capts, env);
+
+	std::vector<PipelineResult> results;
+	results.reserve(this->chains.size());
+	for (PipelineChain& chain : this->chains) {
+		results.push_back(runChain(chain));
+	}
+	return results;
+}
+
+PipelineResult ImagePipeline::runChain(PipelineChain& chain) {
+	PipelineResult res;
+	ImageView img;
+	img.data = arenaBase() + chain.captureOffset;
+	img.width = chain.capture.width;
+	img.height = chain.capture.height;
+	img.channels = 4;
+	img.stride = (size_t)img.width * 4;
+
+	for (const PipelineStage& stage : chain.stages) {
+		ImageView out;
+		out.data = arenaBase() + stage.offset;
+		out.width = stage.width;
+		out.height = stage.height;
+		out.channels = stage.channels;
+		out.stride = (size_t)stage.width * stage.channels;
+
+		switch (stage.op) {
+		case PipelineOp::Crop:
+			img.data = img.Pixel(stage.rect.x, stage.rect.y);
+			img.width = stage.width;
+			img.height = stage.height;
+			break;
+		case PipelineOp::Channel:
+			for (int y = 0; y < out.height; y++) {
+				const uint8_t* src = img.Pixel(0, y);
+				uint8_t* dst = out.Pixel(0, y);
+				if (stage.channel == 4) {
+					for (int x = 0; x < out.width; x++, src += 4) {
+						dst[x] = PixelLuminance(src);
+					}
+				} else {
+					for (int x = 0; x < out.width; x++, src += 4) {
+						dst[x] = src[stage.channel];
+					}
+				}
+			}
+			img = out;
+			break;
+		case PipelineOp::Threshold: {
+			uint8_t above = (stage.invert ? 0 : 255);
+			uint8_t below = 255 - above;
+			for (int y = 0; y < out.height; y++) {
+				const uint8_t* src = img.Pixel(0, y);
+				uint8_t* dst = out.Pixel(0, y);
+				for (int x = 0; x < out.width; x++) {
+					dst[x] = (src[x] >= stage.value ? above : below);
+				}
+			}
+			img = out;
+			break;
+		}
+		case PipelineOp::Downscale: {
+			int f = stage.value;
+			int area = f * f;
+			for (int y = 0; y < out.height; y++) {
+				uint8_t* dst = out.Pixel(0, y);
+				for (int x = 0; x < out.width; x++) {
+					for (int c = 0; c < out.channels; c++) {
+						int sum = 0;
+						for (int dy = 0; dy < f; dy++) {
+							const uint8_t* src = img.Pixel(x * f, y * f + dy) + c;
+							for (int dx = 0; dx < f; dx++) {
+								sum += src[dx * out.channels];
+							}
+						}
+						dst[x * out.channels + c] = (uint8_t)((sum + area / 2) / area);
+					}
+				}
+			}
+			img = out;
+			break;
+		}
+		case PipelineOp::Histogram:
+			res.kind = PipelineResult::Kind::Histogram;
+			res.histogram.assign((size_t)img.channels * 256, 0);
+			for (int y = 0; y < img.height; y++) {
+				const uint8_t* src = img.Pixel(0, y);
+				for (int x = 0; x < img.width * img.channels; x += img.channels) {
+					for (int c = 0; c < img.channels; c++) {
+						res.histogram[c * 256 + src[x + c]]++;
+					}
+				}
+			}
+			return res;
+		case PipelineOp::FindSubImage:
+			res.kind = PipelineResult::Kind::Matches;
+			res.matches = FindSubImage(img.data, img.width, img.height, img.stride, stage.rect, stage.needle.data(), stage.needleWidth, stage.needleHeight, stage.value, stage.maxresults);
+			return res;
+		}
+	}
+	res.image = img;
+	return res;
+}
+
+static PipelineStage StageFromJsValue(Napi::Env env, const Napi::Value& val) {
+	auto obj = val.As<Napi::Object>();
+	auto op = obj.Get("op").As<Napi::String>().Utf8Value();
+	auto optionalInt = [&obj](const char* key, int def) {
+		auto v = obj.Get(key);
+		return (v.IsNumber() ? v.As<Napi::Number>().Int32Value() : def);
+	};
+	PipelineStage stage;
+	if (op == "crop") {
+		stage.op = PipelineOp::Crop;
+		stage.rect = JSRectangle::FromJsValue(obj.Get("rect"));
+	} else if (op == "channel") {
+		static const std::map<std::string, int> channels = { {"r", 0}, {"g", 1}, {"b", 2}, {"a", 3}, {"gray", 4} };
+		auto found = channels.find(obj.Get("channel").As<Napi::String>().Utf8Value());
+		if (found == channels.end()) {
+			throw Napi::RangeError::New(env, "unknown channel");
+		}
+		stage.op = PipelineOp::Channel;
+		stage.channel = found->second;
+	} else if (op == "threshold") {
+		stage.op = PipelineOp::Threshold;
+		stage.value = obj.Get("value").As<Napi::Number>().Int32Value();
+		stage.invert = obj.Get("invert").ToBoolean();
+	} else if (op == "downscale") {
+		stage.op = PipelineOp::Downscale;
+		stage.value = obj.Get("factor").As<Napi::Number>().Int32Value();
+	} else if (op == "histogram") {
+		stage.op = PipelineOp::Histogram;
+	} else if (op == "findSubImage") {
+		stage.op = PipelineOp::FindSubImage;
+		auto data = obj.Get("data").As<Napi::TypedArray>();
+		auto bytes = (const uint8_t*)data.ArrayBuffer().Data() + data.ByteOffset();
+		stage.needle.assign(bytes, bytes + data.ByteLength());
+		stage.needleWidth = obj.Get("width").As<Napi::Number>().Int32Value();
+		stage.needleHeight = obj.Get("height").As<Napi::Number>().Int32Value();
+		auto rect = obj.Get("rect");
+		if (!rect.IsNull() && !rect.IsUndefined()) {
+			stage.rect = JSRectangle::FromJsValue(rect);
+		}
+		stage.value = optionalInt("tolerance", 0);
+		int maxresults = optionalInt("maxresults", 0);
+		stage.maxresults = (maxresults > 0 ? maxresults : SIZE_MAX);
+	} else {
+		throw Napi::RangeError::New(env, "unknown pipeline stage " + op);
+	}
+	return stage;
+}
+
+void NativeImagePipeline::Init(Napi::Env env) {
+	auto cls = DefineClass(env, "NativeImagePipeline", {
+		InstanceMethod("run", &NativeImagePipeline::Run)
+	});
+	env.GetInstanceData<PluginInstance>()->pipelineConstructor = Napi::Persistent(cls);
+}
+
+Napi::Object NativeImagePipeline::New(Napi::Env env, const Napi::Value& chains) {
+	auto obj = env.GetInstanceData<PluginInstance>()->pipelineConstructor.New({});
+	ImagePipeline& pipeline = NativeImagePipeline::Unwrap(obj)->pipeline;
+	auto jschains = chains.As<Napi::Array>();
+	for (uint32_t i = 0; i < jschains.Length(); i++) {
+		auto jschain = jschains.Get(i).As<Napi::Object>();
+		auto rect = JSRectangle::FromJsValue(jschain.Get("rect"));
+		std::vector<PipelineStage> stages;
+		auto jsstages = jschain.Get("stages");
+		if (jsstages.IsArray()) {
+			auto arr = jsstages.As<Napi::Array>();
+			for (uint32_t a = 0; a < arr.Length(); a++) {
+				stages.push_back(StageFromJsValue(env, arr.Get(a)));
+			}
+		}
+		try {
+			pipeline.addChain(rect, std::move(stages));
+		} catch (const std::invalid_argument& e) {
+			throw Napi::TypeError::New(env, "chain " + std::to_string(i) + ": " + e.what());
+		}
+	}
+	return obj;
+}
+
+NativeImagePipeline::NativeImagePipeline(const Napi::CallbackInfo& info) : Napi::ObjectWrap<NativeImagePipeline>(info) {}
+
+Napi::Value NativeImagePipeline::Run(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto wnd = OSWindow::FromJsValue(info[0]);
+	auto mode = CaptureModeFromJsValue(info[1]);
+	std::vector<PipelineResult> results;
+	try {
+		results = this->pipeline.run(wnd, mode, env);
+	} catch (const std::exception& e) {
+		throw Napi::Error::New(env, e.what());
+	}
+
+	auto ret = Napi::Array::New(env, results.size());
+	for (uint32_t i = 0; i < results.size(); i++) {
+		const PipelineResult& res = results[i];
+		switch (res.kind) {
+		case PipelineResult::Kind::Image: {
+			const ImageView& img = res.image;
+			size_t rowsize = (size_t)img.width * img.channels;
+			auto buffer = Napi::ArrayBuffer::New(env, rowsize * img.height);
+			uint8_t* out = (uint8_t*)buffer.Data();
+			for (int y = 0; y < img.height; y++) {
+				memcpy(out + y * rowsize, img.Pixel(0, y), rowsize);
+			}
+			auto jsimg = Napi::Object::New(env);
+			jsimg.Set("width", img.width);
+			jsimg.Set("height", img.height);
+			jsimg.Set("channels", img.channels);
+			jsimg.Set("data", Napi::Uint8Array::New(env, buffer.ByteLength(), buffer, 0, napi_uint8_clamped_array));
+			ret.Set(i, jsimg);
+			break;
+		}
+		case PipelineResult::Kind::Histogram: {
+			auto hist = Napi::Uint32Array::New(env, res.histogram.size());
+			memcpy(hist.Data(), res.histogram.data(), res.histogram.size() * sizeof(uint32_t));
+			ret.Set(i, hist);
+			break;
+		}
+		case PipelineResult::Kind::Matches: {
+			ret.Set(i, SubImageMatchesToJs(env, res.matches));
+			break;
+		}
+		}
+	}
+	return ret;
+}
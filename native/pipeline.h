@@ -0,0 +1,105 @@
+/**
+ * An image pipeline runs a fixed chain of image operations on a capture in a single native call. Js describes the
+ * chains once and gets a compiled plan back. Every image size follows from the capture rects, so all intermediate
+ * images are laid out in one arena at compile time and a run doesn't allocate anything besides its results
+ */
+
+#pragma once
+#include <memory>
+#include "os.h"
+#include "frame.h"
+
+// Image in the arena, crops are views into their source so rows can be further apart than width
+struct ImageView {
+	uint8_t* data = nullptr;
+	int width = 0;
+	int height = 0;
+	// 4 for rgba, 1 for a single extracted channel
+	int channels = 4;
+	size_t stride = 0;
+	uint8_t* Pixel(int x, int y) const { return data + (size_t)y * stride + (size_t)x * channels; }
+};
+
+enum class PipelineOp {
+	// view of rect in the current image
+	Crop,
+	// single channel image, channel 0-3 is r,g,b,a and 4 is luminance
+	Channel,
+	// 255 where a single channel image is >= value and 0 elsewhere, the other way around with invert
+	Threshold,
+	// average of value*value blocks
+	Downscale,
+	// counts of every value per channel, ends the chain
+	Histogram,
+	// positions of needle in rect, ends the chain
+	FindSubImage
+};
+
+struct PipelineStage {
+	PipelineOp op = PipelineOp::Crop;
+	JSRectangle rect = JSRectangle(0, 0, 0, 0);
+	int channel = 0;
+	// threshold value, downscale factor or search tolerance
+	int value = 0;
+	bool invert = false;
+	std::vector<uint8_t> needle;
+	int needleWidth = 0;
+	int needleHeight = 0;
+	size_t maxresults = SIZE_MAX;
+
+	// output layout, set by the compiler
+	int width = 0;
+	int height = 0;
+	int channels = 4;
+	size_t offset = 0;
+};
+
+struct PipelineChain {
+	JSRectangle capture;
+	size_t captureOffset = 0;
+	std::vector<PipelineStage> stages;
+};
+
+struct PipelineResult {
+	enum class Kind { Image, Histogram, Matches } kind = Kind::Image;
+	// points into the arena, only valid until the next run
+	ImageView image;
+	std::vector<uint32_t> histogram;
+	std::vector<SubImageMatch> matches;
+};
+
+class ImagePipeline {
+public:
+	/**
+	 * Checks that the stages fit together and lays out their images, throws std::invalid_argument when they don't.
+	 * Must not be called after the first run
+	 */
+	void addChain(JSRectangle capture, std::vector<PipelineStage> stages);
+	// Captures all chains from one frame of wnd and runs them, one result per chain
+	std::vector<PipelineResult> run(OSWindow wnd, CaptureMode mode, Napi::Env env);
+
+private:
+	size_t allocate(size_t size);
+	PipelineResult runChain(PipelineChain& chain);
+	// 64 byte aligned start of the arena, offsets from allocate are relative to it
+	uint8_t* arenaBase();
+
+	std::vector<PipelineChain> chains;
+	// vectors only guarantee the alignment of new, over-allocated by 63 bytes and aligned by arenaBase
+	std::vector<uint8_t> arena;
+	size_t arenaSize = 0;
+};
+
+class NativeImagePipeline : public Napi::ObjectWrap<NativeImagePipeline> {
+public:
+	// registers the js class, pipelines are created with New
+	static void Init(Napi::Env env);
+	// compiles the js chain definitions
+	static Napi::Object New(Napi::Env env, const Napi::Value& chains);
+	NativeImagePipeline(const Napi::CallbackInfo& info);
+
+private:
+	Napi::Value Run(const Napi::CallbackInfo& info);
+
+	ImagePipeline pipeline;
+};
@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include "templates.h"
+
+std::shared_ptr<NeedleTemplate> NeedleTemplate::Create(const uint8_t* rgba, int width, int height) {
+	auto tmpl = std::make_shared<NeedleTemplate>();
+	size_t size = (size_t)width * height * 4;
+	// vectors only guarantee the alignment of new, over-allocate and align by hand
+	tmpl->storage.resize(size + 63);
+	uintptr_t start = reinterpret_cast<uintptr_t>(tmpl->storage.data());
+	tmpl->pixels = tmpl->storage.data() + (((start + 63) & ~(uintptr_t)63) - start);
+	memcpy(tmpl->pixels, rgba, size);
+	tmpl->width = width;
+	tmpl->height = height;
+	tmpl->anchor = PickNeedleAnchor(tmpl->pixels, width, height);
+	tmpl->offsets = NeedleOffsets(tmpl->pixels, width, height, tmpl->anchor);
+	return tmpl;
+}
+
+std::vector<std::shared_ptr<NeedleTemplate>> CreateNeedleTemplates(const std::vector<const uint8_t*>& images, const std::vector<int>& widths, const std::vector<int>& heights) {
+	std::vector<std::shared_ptr<NeedleTemplate>> templates(images.size());
+	size_t threadCount = std::min<size_t>(images.size(), std::max(1u, std::thread::hardware_concurrency()));
+	if (threadCount <= 1) {
+		for (size_t i = 0; i < images.size(); i++) {
+			templates[i] = NeedleTemplate::Create(images[i], widths[i], heights[i]);
+		}
+		return templates;
+	}
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < threadCount; t++) {
+		threads.emplace_back([&, t]() {
+			for (size_t i = t; i < images.size(); i += threadCount) {
+				templates[i] = NeedleTemplate::Create(images[i], widths[i], heights[i]);
+			}
+		});
+	}
+	for (auto& thread : threads) { thread.join(); }
+	return templates;
+}
+
+std::vector<SubImageNeedle> TemplateSearchesFromJsValue(Napi::Env env, const Napi::Value& val, int imgwidth, int imgheight, std::vector<std::shared_ptr<NeedleTemplate>>& keep) {
+	auto inst = env.GetInstanceData<PluginInstance>();
+	auto arr = val.As<Napi::Array>();
+	std::vector<SubImageNeedle> needles(arr.Length());
+	for (uint32_t i = 0; i < arr.Length(); i++) {
+		auto item = arr.Get(i);
+		Napi::Object opts;
+		uint32_t id;
+		if (item.IsNumber()) {
+			id = item.As<Napi::Number>().Uint32Value();
+		} else {
+			opts = item.As<Napi::Object>();
+			id = opts.Get("template").As<Napi::Number>().Uint32Value();
+		}
+		if (id >= inst->templates.size() || !inst->templates[id]) {
+			throw Napi::RangeError::New(env, "unknown template");
+		}
+		auto& tmpl = inst->templates[id];
+		keep.push_back(tmpl);
+
+		SubImageNeedle& needle = needles[i];
+		needle.data = tmpl->Pixels();
+		needle.width = tmpl->width;
+		needle.height = tmpl->height;
+		needle.anchor = tmpl->anchor;
+		needle.offsets = &tmpl->offsets;
+		needle.rect = JSRectangle(0, 0, imgwidth, imgheight);
+		if (!opts.IsEmpty()) {
+			auto rect = opts.Get("rect");
+			if (!rect.IsNull() && !rect.IsUndefined()) { needle.rect = JSRectangle::FromJsValue(rect); }
+			auto tolerance = opts.Get("tolerance");
+			if (tolerance.IsNumber()) { needle.tolerance = tolerance.As<Napi::Number>().Int32Value(); }
+			auto maxresults = opts.Get("maxresults");
+			if (maxresults.IsNumber()) { needle.maxresults = std::max(1u, maxresults.As<Napi::Number>().Uint32Value()); }
+		}
+	}
+	return needles;
+}
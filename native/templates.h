@@ -0,0 +1,34 @@
+/**
+ * Needle images that are registered once and then referred to by handle. The pixels are kept in aligned native
+ * memory together with their search metadata, so searches don't marshal or preprocess the needles on every call
+ */
+
+#pragma once
+#include <memory>
+#include "frame.h"
+
+struct NeedleTemplate {
+	int width = 0;
+	int height = 0;
+	// pixel index of the search anchor, -1 if the template has no opaque pixels and never matches
+	int anchor = -1;
+	// byte offsets of the opaque pixels except the anchor, the part of the search setup that doesn't depend on the image
+	std::vector<int> offsets;
+
+	// rgba, 64 byte aligned
+	const uint8_t* Pixels() const { return pixels; }
+	static std::shared_ptr<NeedleTemplate> Create(const uint8_t* rgba, int width, int height);
+
+private:
+	std::vector<uint8_t> storage;
+	uint8_t* pixels = nullptr;
+};
+
+// Creates the templates of several images on parallel threads
+std::vector<std::shared_ptr<NeedleTemplate>> CreateNeedleTemplates(const std::vector<const uint8_t*>& images, const std::vector<int>& widths, const std::vector<int>& heights);
+
+/**
+ * Parses an array of searches that refer to registered templates, either a handle or
+ * { template, rect?, tolerance?, maxresults? }. The needles point into the templates in keep, which has to outlive them
+ */
+std::vector<SubImageNeedle> TemplateSearchesFromJsValue(Napi::Env env, const Napi::Value& val, int imgwidth, int imgheight, std::vector<std::shared_ptr<NeedleTemplate>>& keep);
@@ -1,5 +1,21 @@
 #include "util.h"
 
+const std::map<CaptureMode, std::string> captureModeText = {
+	{CaptureMode::Desktop,"desktop"},
+	{CaptureMode::Window,"window"},
+	{CaptureMode::OpenGL,"opengl"}
+};
+
+CaptureMode CaptureModeFromJsValue(const Napi::Value& val) {
+	auto captmodetext = val.As<Napi::String>().Utf8Value();
+	for (auto mode : captureModeText) {
+		if (mode.second == captmodetext) {
+			return mode.first;
+		}
+	}
+	throw Napi::RangeError::New(val.Env(), "unknown capture mode");
+}
+
 //TODO this should never be needed
 void flipBGRAtoRGBA(void* data, size_t len) {
 	byte* index = (byte*)data;
@@ -12,6 +12,8 @@
 #include <assert.h>
 #include <unordered_map>
 #include <list>
+#include <memory>
+#include "ocr.h"
 
 using std::string;
 using std::vector;
@@ -19,8 +21,26 @@ using std::wstring;
 
 typedef unsigned char byte;
 
+class RegionWatch;
+class CaptureScheduler;
+struct NeedleTemplate;
+
 //state storage per context
-struct PluginInstance {};
+struct PluginInstance {
+	//fonts loaded with loadFont, the js side refers to them by index
+	vector<std::shared_ptr<OCRFont>> fonts;
+	//needle images registered with registerTemplates, also referred to by index, empty after unregisterTemplates
+	vector<std::shared_ptr<NeedleTemplate>> templates;
+	//active watchRegions subscriptions by id
+	std::map<uint32_t, std::shared_ptr<RegionWatch>> regionWatches;
+	uint32_t nextRegionWatch = 1;
+	//batches captureScheduled requests, started on first use
+	std::shared_ptr<CaptureScheduler> captureScheduler;
+	//js class of the handles returned by captureFrame
+	Napi::FunctionReference frameConstructor;
+	//js class of the compiled pipelines returned by compileImagePipeline
+	Napi::FunctionReference pipelineConstructor;
+};
 
 enum class CaptureMode {
 	//Capture the desktop pixels relative to target window
@@ -54,8 +74,26 @@ struct JSRectangle {
 		int h = rect.Get("height").As<Napi::Number>().Int32Value();
 		return JSRectangle(x, y, w, h);
 	}
+	//packed x,y,width,height quads in an Int32Array, one pointer access instead of four property lookups per rect
+	static vector<JSRectangle> FromQuads(const Napi::Value& val) {
+		if (!val.IsTypedArray() || val.As<Napi::TypedArray>().TypedArrayType() != napi_int32_array) {
+			throw Napi::TypeError::New(val.Env(), "rect quads must be an Int32Array");
+		}
+		auto quads = val.As<Napi::Int32Array>();
+		if (quads.ElementLength() % 4 != 0) {
+			throw Napi::TypeError::New(val.Env(), "rect quads must have a multiple of 4 values");
+		}
+		vector<JSRectangle> rects(quads.ElementLength() / 4);
+		const int32_t* q = quads.Data();
+		for (size_t i = 0; i < rects.size(); i++) {
+			rects[i] = JSRectangle(q[i * 4], q[i * 4 + 1], q[i * 4 + 2], q[i * 4 + 3]);
+		}
+		return rects;
+	}
 };
 
+CaptureMode CaptureModeFromJsValue(const Napi::Value& val);
+
 void fillImageOpaque(void* data, size_t len);
 void flipBGRAtoRGBA(void* data, size_t len);
 void flipBGRAtoRGBA(void* outdata, void* indata, size_t len);
@@ -0,0 +1,133 @@
+#include <cstring>
+#include "watch.h"
+
+uint64_t HashPixels(const uint8_t* data, size_t size) {
+	constexpr uint64_t prime = 0x9E3779B97F4A7C15ull;
+	uint64_t lanes[4] = { 1, 2, 3, 4 };
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32) {
+		for (int lane = 0; lane < 4; lane++) {
+			uint64_t v;
+			memcpy(&v, data + i + lane * 8, 8);
+			uint64_t h = (lanes[lane] ^ v) * prime;
+			lanes[lane] = h ^ (h >> 29);
+		}
+	}
+	uint64_t hash = size;
+	for (; i < size; i++) {
+		hash = (hash ^ data[i]) * prime;
+	}
+	for (int lane = 0; lane < 4; lane++) {
+		hash = (hash ^ lanes[lane]) * prime;
+		hash ^= hash >> 32;
+	}
+	return hash;
+}
+
+RegionWatch::RegionWatch(OSWindow wnd, CaptureMode mode, const std::vector<JSRectangle>& rects, int interval, Napi::Function callback)
+	: wnd(wnd), mode(mode), interval(interval), env(callback.Env()) {
+	for (const JSRectangle& rect : rects) {
+		Region region;
+		region.rect = rect;
+		region.pixels.resize((size_t)rect.width * rect.height * 4);
+		this->regions.push_back(std::move(region));
+	}
+	// only one batch of changes can be pending, slow js consumers get the latest state instead of a backlog
+	this->callback = Napi::ThreadSafeFunction::New(callback.Env(), callback, "regionwatch", 1, 1);
+#ifdef OS_LINUX
+	// damage tells us when the client rendered, no need to capture in between
+	try {
+		OSStartFrameTracking(wnd);
+		this->frameTracking = true;
+	} catch (...) {}
+#endif
+	this->thread = std::thread(&RegionWatch::run, this);
+}
+
+RegionWatch::~RegionWatch() {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	this->wakeup.notify_all();
+	this->thread.join();
+	this->callback.Release();
+#ifdef OS_LINUX
+	if (this->frameTracking) {
+		OSStopFrameTracking(this->wnd);
+	}
+#endif
+}
+
+void RegionWatch::run() {
+	std::unique_lock<std::mutex> lock(this->mutex);
+	while (!this->stopping) {
+		lock.unlock();
+		tick();
+		lock.lock();
+		this->wakeup.wait_for(lock, this->interval, [this]() { return this->stopping; });
+	}
+}
+
+// returns false if there were changes that could not be delivered yet
+bool RegionWatch::tick() {
+	uint64_t frame = 0;
+#ifdef OS_LINUX
+	if (this->frameTracking) {
+		frame = OSGetFrameStats(this->wnd).frames;
+		if (frame == this->lastFrame) {
+			return true;
+		}
+	}
+#endif
+
+	std::vector<CaptureRect> capts;
+	capts.reserve(this->regions.size());
+	for (Region& region : this->regions) {
+		capts.emplace_back(region.pixels.data(), region.pixels.size(), region.rect);
+	}
+	try {
+		OSCaptureMulti(this->wnd, this->mode, capts, this->env);
+	} catch (...) {
+		// window is probably gone, js unwatches on close
+		return true;
+	}
+
+	std::vector<uint64_t> hashes(this->regions.size());
+	auto changes = std::make_unique<std::vector<Change>>();
+	for (size_t i = 0; i < this->regions.size(); i++) {
+		Region& region = this->regions[i];
+		hashes[i] = HashPixels(region.pixels.data(), region.pixels.size());
+		if (!region.reported || hashes[i] != region.hash) {
+			changes->push_back({ (uint32_t)i, region.rect, region.pixels });
+		}
+	}
+	if (!changes->empty()) {
+		auto status = this->callback.NonBlockingCall(changes.get(), [](Napi::Env env, Napi::Function jsCallback, std::vector<Change>* changes) {
+			std::unique_ptr<std::vector<Change>> owned(changes);
+			auto arr = Napi::Array::New(env, changes->size());
+			for (uint32_t i = 0; i < changes->size(); i++) {
+				Change& change = (*changes)[i];
+				auto buffer = Napi::ArrayBuffer::New(env, change.pixels.size());
+				memcpy(buffer.Data(), change.pixels.data(), change.pixels.size());
+				auto obj = Napi::Object::New(env);
+				obj.Set("index", change.index);
+				obj.Set("rect", change.rect.ToJs(env));
+				obj.Set("data", Napi::Uint8Array::New(env, change.pixels.size(), buffer, 0, napi_uint8_clamped_array));
+				arr.Set(i, obj);
+			}
+			jsCallback.Call({ arr });
+		});
+		if (status != napi_ok) {
+			// queue is full, report again on the next tick
+			return false;
+		}
+		changes.release();
+		for (size_t i = 0; i < this->regions.size(); i++) {
+			this->regions[i].hash = hashes[i];
+			this->regions[i].reported = true;
+		}
+	}
+	this->lastFrame = frame;
+	return true;
+}
@@ -0,0 +1,55 @@
+/**
+ * Region watches capture a fixed set of rects of a window on a background thread and only report the rects
+ * whose contents changed since the last report, so apps don't have to re-capture and compare regions in js
+ */
+
+#pragma once
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include "os.h"
+
+// Fast non-cryptographic hash of pixel data, four independent lanes so the main loop vectorizes
+uint64_t HashPixels(const uint8_t* data, size_t size);
+
+class RegionWatch {
+public:
+	// callback receives an array of { index, rect, data } for the changed rects, index refers to the rects argument
+	RegionWatch(OSWindow wnd, CaptureMode mode, const std::vector<JSRectangle>& rects, int interval, Napi::Function callback);
+	~RegionWatch();
+
+private:
+	struct Region {
+		JSRectangle rect;
+		std::vector<uint8_t> pixels;
+		// hash of the last contents that were delivered to js
+		uint64_t hash = 0;
+		bool reported = false;
+	};
+	struct Change {
+		uint32_t index;
+		JSRectangle rect;
+		std::vector<uint8_t> pixels;
+	};
+
+	void run();
+	bool tick();
+
+	OSWindow wnd;
+	CaptureMode mode;
+	std::chrono::milliseconds interval;
+	std::vector<Region> regions;
+	// only passed on to OSCaptureMulti, which doesn't touch js
+	Napi::Env env;
+	Napi::ThreadSafeFunction callback;
+	// frame counter of the window when it was last captured, captures are skipped while it doesn't change
+	bool frameTracking = false;
+	uint64_t lastFrame = UINT64_MAX;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wakeup;
+	bool stopping = false;
+};
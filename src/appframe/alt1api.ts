@@ -2,6 +2,7 @@
 import type * as alt1types from "alt1";
 import { ipcRenderer } from "electron";
 import { FlatImageData, SyncResponse, OverlayCommand, RsClientState } from "../shared";
+import type { FrameStats, RegionChange } from "../native";
 
 let warningsTriggered: string[] = [];
 function warn(key: string, message: string) {
@@ -221,6 +222,8 @@ let getters: PropertyDescriptorMap = {
 	rsScaling: { get() { return getRsInfo().scaling; } },
 	rsLinked: { get() { return true; } }, //can no longer open apps without rs
 	captureMethod: { get() { return getRsInfo().captureMode; } },
+	//"hidden" while minimized or on another workspace, captures throw a "window not visible" error then
+	rsVisibility: { get() { return getRsInfo().visibility; } },
 	//TODO
 	currentWorld: { get() { return 1; } },
 	lastWorldHop: { get() { return 0; } },
@@ -232,6 +235,32 @@ let getters: PropertyDescriptorMap = {
 
 Object.defineProperties(alt1api, getters);
 
+let regionWatchCallbacks = new Map<number, (changes: RegionChange[]) => void>();
+ipcRenderer.on("regionchange", (e, id: number, changes: RegionChange[]) => {
+	regionWatchCallbacks.get(id)?.(changes);
+});
+
+//api's that don't exist in the alt1 typings yet
+Object.assign(alt1api, {
+	//points are x,y pairs, resolves to one rgba pixel per point, all taken from the same frame
+	async samplePixelsAsync(points: Int32Array) {
+		return await ipcRenderer.invoke("samplepixels", points) as Uint32Array;
+	},
+	//rolling fps and frame times of the rs client, null if the platform can't measure it
+	async getFrameStatsAsync() {
+		return await ipcRenderer.invoke("framestats") as FrameStats | null;
+	},
+	//cb is called with the rects whose pixels changed, resolves to a function that stops the watch
+	async watchRegions(rects: alt1types.RectLike[], interval: number, cb: (changes: RegionChange[]) => void) {
+		let id = await ipcRenderer.invoke("watchregions", rects, interval) as number;
+		regionWatchCallbacks.set(id, cb);
+		return () => {
+			regionWatchCallbacks.delete(id);
+			ipcRenderer.invoke("unwatchregions", id);
+		};
+	}
+});
+
 //TODO need some changes to make this work
 //contextBridge.exposeInMainWorld("alt1", alt1api);
 (window as any).alt1 = alt1api;
@@ -2,7 +2,7 @@ import * as a1lib from "alt1";
 import { IpcMain, IpcMainEvent, IpcMainInvokeEvent, screen } from "electron/main"
 import { sameDomainResolve } from "./lib";
 import { admins, fixTooltip, getManagedAppWindow, ManagedWindow, openApp } from "./main";
-import { native } from "./native";
+import { native, NativeFrame } from "./native";
 import { settings } from "./settings";
 import { FlatImageData, OverlayCommand, Rectangle, RsClientState } from "./shared";
 import { rsInstances } from "./rsinstance";
@@ -33,7 +33,7 @@ function isAdmin(e: IpcMainEvent | IpcMainInvokeEvent) {
 	return admins.has(e.sender.id);
 }
 
-function detectCornerEdge(img: FlatImageData, rect: a1lib.Rect, hor: boolean, reverse: boolean, thresh: number) {
+function detectCornerEdge(frame: NativeFrame, rect: a1lib.Rect, hor: boolean, reverse: boolean, thresh: number) {
 	if (!hor) {
 		var rect1 = new a1lib.Rect(rect.x, rect.y, rect.width, snapcornerlength);
 		var rect2 = new a1lib.Rect(rect.x, rect.y + rect.height - snapcornerlength, rect.width, snapcornerlength);
@@ -41,21 +41,22 @@ function detectCornerEdge(img: FlatImageData, rect: a1lib.Rect, hor: boolean, re
 		var rect1 = new a1lib.Rect(rect.x, rect.y, snapcornerlength, rect.height);
 		var rect2 = new a1lib.Rect(rect.x + rect.width - snapcornerlength, rect.y, snapcornerlength, rect.height);
 	}
-	let edgetop = detectEdge(img, rect1, hor, reverse, thresh);
-	let edgebot = detectEdge(img, rect2, hor, reverse, thresh);
+	let edgetop = detectEdge(frame, rect1, hor, reverse, thresh);
+	let edgebot = detectEdge(frame, rect2, hor, reverse, thresh);
 	return (edgetop.score > edgebot.score ? edgetop : edgebot);
 }
 
-function detectEdge(img: FlatImageData, rect: a1lib.Rect, hor: boolean, reverse: boolean, thresh: number) {
+function detectEdge(frame: NativeFrame, rect: a1lib.Rect, hor: boolean, reverse: boolean, thresh: number) {
 	let originalsize = (hor ? rect.width : rect.height);
-	rect.intersect(new a1lib.Rect(0, 0, img.width, img.height));
+	rect.intersect(new a1lib.Rect(0, 0, frame.width, frame.height));
 
-	let scanstride = (hor ? img.width * 4 : 4);
-	let scancount = (hor ? rect.height : rect.width) - 1;
-	let secondstride = (hor ? 4 : img.width * 4);
-	let secondcount = (hor ? rect.width : rect.height);
-
-	let startindex = rect.x * 4 + rect.y * img.width * 4;
+	//each step compares a line with the next one, the sum of the edge plane over the line is that difference
+	let scancount = (rect.width > 0 && rect.height > 0 ? (hor ? rect.height : rect.width) : 0) - 1;
+	let lines = new Int32Array(Math.max(0, scancount + 1) * 4);
+	for (let i = 0; i <= scancount; i++) {
+		lines.set(hor ? [rect.x, rect.y + i, rect.width, 1] : [rect.x + i, rect.y, 1, rect.height], i * 4);
+	}
+	let diffs = (lines.length != 0 ? frame.sumDerived(hor ? "edgey" : "edgex", lines) : new Float64Array(0));
 
 	let posbase = (hor ? rect.y : rect.x);
 
@@ -64,18 +65,8 @@ function detectEdge(img: FlatImageData, rect: a1lib.Rect, hor: boolean, reverse:
 		pos: posbase + (reverse ? hor ? rect.height : rect.width : 0)
 	};
 	for (let scanstep = 0; scanstep <= scancount; scanstep++) {
-		let dsum = 0;
 		let scanindex = (reverse ? scancount - scanstep : scanstep);
-		let ibase = startindex + scanindex * scanstride;
-		for (let step = 0; step < secondcount; step++) {
-			let i1 = ibase + step * secondstride;
-			let i2 = ibase + scanstride + step * secondstride;
-
-			dsum += Math.abs(img.data[i1 + 0] - img.data[i2 + 0]);
-			dsum += Math.abs(img.data[i1 + 1] - img.data[i2 + 1]);
-			dsum += Math.abs(img.data[i1 + 2] - img.data[i2 + 2]);
-		}
-		let score = dsum / originalsize;
+		let score = diffs[scanindex] / originalsize;
 		if (score > best.score) {
 			best.pos = posbase + scanindex + 1;
 			best.score = score;
@@ -86,8 +77,8 @@ function detectEdge(img: FlatImageData, rect: a1lib.Rect, hor: boolean, reverse:
 	}
 
 	//also treat the window bounds as edges
-	if (!hor && !reverse && rect.x + rect.width == img.width) { best.pos = img.width; best.score = 1000; }
-	if (hor && !reverse && rect.y + rect.height == img.height) { best.pos = img.height; best.score = 1000; }
+	if (!hor && !reverse && rect.x + rect.width == frame.width) { best.pos = frame.width; best.score = 1000; }
+	if (hor && !reverse && rect.y + rect.height == frame.height) { best.pos = frame.height; best.score = 1000; }
 	if (!hor && reverse && rect.x == 0 && rect.width != 0) { best.pos = 0; best.score = 1000; }
 	if (hor && reverse && rect.y == 0 && rect.height != 0) { best.pos = 0; best.score = 1000; }
 
@@ -112,13 +103,14 @@ function startDrag(wnd: ManagedWindow, left: boolean, top: boolean, right: boole
 	let diry = 0;
 
 	//TODO display scaling
-	let imgdata = native.captureWindowMulti(wnd.rsClient.window.handle, settings.captureMode, { main: { x: 0, y: 0, width: rsbounds.width, height: rsbounds.height } }).main;
-	let img: FlatImageData = { data: imgdata, width: rsbounds.width, height: rsbounds.height };
+	//the frame stays native, each tick only copies the strips around the dragged edges
+	let frame = wnd.rsClient.captureFrame();
 
 	let tick = () => {
 		//can't rely on any window events for this since were crossing like 5 processes and 23 threads
 		if (!native.getMouseState()) {
 			clearInterval(interval);
+			frame.release();
 			return;
 		}
 		let pos = screen.getCursorScreenPoint();
@@ -139,22 +131,22 @@ function startDrag(wnd: ManagedWindow, left: boolean, top: boolean, right: boole
 
 		if (dirx > 0 && right) {
 			let rect = new a1lib.Rect(wndright, wndtop, snapdistance, wndbot - wndtop);
-			let edge = detectCornerEdge(img, rect, false, false, snapthresh);
+			let edge = detectCornerEdge(frame, rect, false, false, snapthresh);
 			if (edge.score > snapthresh) { snapdx = edge.pos - wndright; }
 		}
 		if (dirx < 0 && left) {
 			let rect = new a1lib.Rect(wndleft - snapdistance, wndtop, snapdistance, wndbot - wndtop);
-			let edge = detectCornerEdge(img, rect, false, true, snapthresh);
+			let edge = detectCornerEdge(frame, rect, false, true, snapthresh);
 			if (edge.score > snapthresh) { snapdx = edge.pos - wndleft; }
 		}
 		if (diry > 0 && bot) {
 			let rect = new a1lib.Rect(wndleft, wndbot, wndright - wndleft, snapdistance);
-			let edge = detectCornerEdge(img, rect, true, false, snapthresh);
+			let edge = detectCornerEdge(frame, rect, true, false, snapthresh);
 			if (edge.score > snapthresh) { snapdy = edge.pos - wndbot; }
 		}
 		if (diry < 0 && top) {
 			let rect = new a1lib.Rect(wndright, wndtop - snapdistance, wndright - wndleft, snapdistance);
-			let edge = detectCornerEdge(img, rect, true, true, snapthresh);
+			let edge = detectCornerEdge(frame, rect, true, true, snapthresh);
 			if (edge.score > snapthresh) { snapdy = edge.pos - wndtop; }
 		}
 
@@ -229,19 +221,53 @@ export function initIpcApi(ipcMain: IpcMain) {
 			lastActiveTime: client.lastActiveTime,
 			ping: 10,//TODO
 			scaling: 1,//TODO
-			captureMode: settings.captureMode
+			captureMode: settings.captureMode,
+			visibility: client.visibility
 		};
 		e.returnValue = { value: state };
 	}));
 
-	ipcMain.handle("capture", (e, x, y, width, height) => {
+	//async captures from all apps that arrive within a few ms of each other are served from the same snapshot
+	ipcMain.handle("capture", async (e, x, y, width, height) => {
 		let client = expectPermittedRsClient(e);
-		return native.captureWindowMulti(client.window.handle, settings.captureMode, { main: { x, y, width, height } }).main;
+		return (await client.captureAsync({ main: { x, y, width, height } })).main;
 	});
 
 	ipcMain.handle("capturemulti", (e, rects: { [key: string]: Rectangle }) => {
 		let client = expectPermittedRsClient(e);
-		return native.captureWindowMulti(client.window.handle, settings.captureMode, rects);
+		return client.captureAsync(rects);
+	});
+
+	ipcMain.handle("samplepixels", (e, points: Int32Array) => {
+		let client = expectPermittedRsClient(e);
+		return client.samplePixels(points);
+	});
+
+	let regionWatchIds = 0;
+	let regionWatches = new Map<number, () => void>();
+	ipcMain.handle("watchregions", (e, rects: Rectangle[], interval: number) => {
+		let client = expectPermittedRsClient(e);
+		let sender = e.sender;
+		let id = ++regionWatchIds;
+		let stop = client.watchRegions(rects, interval, changes => {
+			if (!sender.isDestroyed()) { sender.send("regionchange", id, changes); }
+		});
+		regionWatches.set(id, stop);
+		sender.once("destroyed", () => {
+			regionWatches.delete(id);
+			stop();
+		});
+		return id;
+	});
+
+	ipcMain.handle("unwatchregions", (e, id: number) => {
+		regionWatches.get(id)?.();
+		regionWatches.delete(id);
+	});
+
+	ipcMain.handle("framestats", (e) => {
+		let client = expectPermittedRsClient(e);
+		return client.getFrameStats();
 	});
 
 	ipcMain.on("settooltip", syncwrap((e, text: string) => {
@@ -265,6 +291,10 @@ export function initIpcApi(ipcMain: IpcMain) {
 		native.setWindowShape(wnd, rects);
 	}));
 
+	ipcMain.on("shapemask", syncwrap((e, wnd: BigInt, img: FlatImageData) => {
+		native.setWindowShapeMask(wnd, img.data, img.width, img.height);
+	}));
+
 	ipcMain.handle("openapp", async (e, url) => {
 		if (isAdmin(e)) {
 			let app = settings.bookmarks.find(a => a.configUrl == url);
@@ -297,6 +327,7 @@ export function initIpcApi(ipcMain: IpcMain) {
 	ipcMain.handle("setcapturemode", (e, newmode) => {
 		if (isAdmin(e)) {
 			settings.captureMode = newmode;
+			rsInstances.forEach(inst => inst.updateClickCapture());
 		}
 	})
 }
\ No newline at end of file
@@ -1,23 +1,56 @@
 import * as path from "path";
 import * as fs from "fs";
 import { BrowserWindow } from "electron";
-import { Rectangle } from "./shared";
+import { OverlayPrimitive, Rectangle } from "./shared";
 import { boundMethod } from "autobind-decorator";
 import { TypedEmitter } from "./typedemitter";
 import { PinRect } from "./settings";
+import type { FontDefinition, ColortTriplet } from "alt1/ocr";
 
 export type CaptureMode = "desktop" | "window" | "opengl";
 
 export var native: {
-	captureWindowMulti: <T extends { [key: string]: Rectangle | undefined | null }>(wnd: BigInt, mode: CaptureMode, rect: T) => { [key in keyof T]: Uint8ClampedArray },
+	//rects can also be packed as x,y,width,height quads, the captures are then stored back to back in one buffer in the same order
+	captureWindowMulti: {
+		<T extends { [key: string]: Rectangle | undefined | null }>(wnd: BigInt, mode: CaptureMode, rect: T): { [key in keyof T]: Uint8ClampedArray },
+		(wnd: BigInt, mode: CaptureMode, rects: Int32Array): Uint8ClampedArray
+	},
+	captureScheduled: {
+		<T extends { [key: string]: Rectangle | undefined | null }>(wnd: BigInt, mode: CaptureMode, rect: T, priority?: number, maxdelay?: number): Promise<{ [key in keyof T]: Uint8ClampedArray }>,
+		(wnd: BigInt, mode: CaptureMode, rects: Int32Array, priority?: number, maxdelay?: number): Promise<Uint8ClampedArray>
+	},
+	captureFrame: (wnd: BigInt, mode: CaptureMode) => NativeFrame,
+	compileImagePipeline: (chains: ImagePipelineChain[]) => NativeImagePipeline,
+	//one rgba pixel per x,y pair, points outside the client area are 0 (transparent, captured pixels are opaque)
+	samplePixels: (wnd: BigInt, mode: CaptureMode, points: Int32Array) => Uint32Array,
+	setDerivedCacheBudget: (bytes: number) => void,
+	registerTemplates: (images: { data: Uint8ClampedArray | Uint8Array, width: number, height: number }[]) => number[],
+	unregisterTemplates: (handles: number[]) => void,
+	findTemplates: (data: Uint8ClampedArray | Uint8Array, width: number, height: number, searches: TemplateSearch[]) => { x: number, y: number }[][],
+	findSubImages: (data: Uint8ClampedArray | Uint8Array, width: number, height: number, needles: SubImageNeedle[]) => { x: number, y: number }[][],
+	watchRegions: (wnd: BigInt, mode: CaptureMode, rects: Rectangle[], interval: number, cb: (changes: RegionChange[]) => void) => number,
+	unwatchRegions: (id: number) => void,
 	getRsHandles: () => BigInt[],
 	getActiveWindow: () => BigInt,
 	getWindowBounds: (wnd: BigInt) => Rectangle,
 	getClientBounds: (wnd: BigInt) => Rectangle,
 	getWindowTitle: (wnd: BigInt) => string,
+	queryWindows: (wnds: BigInt[], fields: WindowInfoField[]) => WindowInfo[],
+	queryWindowsAsync: (wnds: BigInt[], fields: WindowInfoField[]) => Promise<WindowInfo[]>,
 	setWindowParent: (wnd: BigInt, parent: BigInt) => void,
+	getWindowVisibility: (wnd: BigInt) => WindowVisibility,
 	getMouseState: () => boolean,
-	setWindowShape: (wnd: BigInt, rects: Rectangle[]) => void,
+	setWindowShape: (wnd: BigInt, rects: Rectangle[] | Int32Array) => void,
+	setWindowShapeMask: (wnd: BigInt, rgba: Uint8ClampedArray | Uint8Array, width: number, height: number) => void,
+	setWindowPin: (wnd: BigInt, parent: BigInt, config: NativePinConfig | null) => void,
+	setClickCapture: (wnd: BigInt, config: ClickCaptureConfig | null) => void,
+	startFrameTracking: (wnd: BigInt) => void,
+	stopFrameTracking: (wnd: BigInt) => void,
+	getFrameStats: (wnd: BigInt) => FrameStats | null,
+	drawOverlay: (wnd: BigInt, bounds: Rectangle, primitives: OverlayPrimitive[]) => void,
+	closeOverlay: (wnd: BigInt) => void,
+	loadFont: (font: FontDefinition) => number,
+	findReadLine: (data: Uint8ClampedArray, width: number, height: number, fonts: number[], colors: ColortTriplet[], x: number, y: number) => NativeReadLineResult[],
 
 	newWindowListener: <T extends keyof windowEvents>(wnd: BigInt, type: T, cb: windowEvents[T]) => void,
 	removeWindowListener: <T extends keyof windowEvents>(wnd: BigInt, type: T, cb: windowEvents[T]) => void,
@@ -41,13 +74,111 @@ export function reloadAddon() {
 	native = __non_webpack_require__(addonpath);
 }
 
+export type NativeReadLineResult = {
+	text: string,
+	debugArea: { x: number, y: number, w: number, h: number },
+	fragments: { text: string, color: ColortTriplet, index: number, xstart: number, xend: number }[]
+};
+
+//same matching rules as NativeFrame.findSubImage, rect defaults to the whole image
+export type SubImageNeedle = { data: Uint8ClampedArray | Uint8Array, width: number, height: number, rect?: Rectangle | null, tolerance?: number, maxresults?: number };
+
+//handle from registerTemplates, or a handle with the search options of SubImageNeedle
+export type TemplateSearch = number | { template: number, rect?: Rectangle | null, tolerance?: number, maxresults?: number };
+
+//edgex/edgey are the summed rgb differences with the pixel to the right/below
+export type DerivedPlane = "luminance" | "edgex" | "edgey";
+
+//full client capture that stays in native memory, all reads come from the same snapshot
+//call release() when done with it to free the pixels before the handle is garbage collected
+export interface NativeFrame {
+	readonly width: number,
+	readonly height: number,
+	getRegion(rect: Rectangle): Uint8ClampedArray,
+	//same format as native.samplePixels, points outside the frame are 0
+	samplePixels(points: Int32Array): Uint32Array,
+	//needle pixels with alpha<128 match anything, tolerance is the max summed rgb difference per pixel
+	findSubImage(data: Uint8ClampedArray | Uint8Array, width: number, height: number, rect?: Rectangle | null, tolerance?: number, maxresults?: number): { x: number, y: number }[],
+	//all needles in one pass over the frame, one list of matches per needle
+	findSubImages(needles: SubImageNeedle[]): { x: number, y: number }[][],
+	findTemplates(searches: TemplateSearch[]): { x: number, y: number }[][],
+	//normalized cross-correlation on luminance, tolerant of brightness differences, each scale is tried (default [1])
+	//matches are sorted by score (-1 to 1), overlapping weaker matches are dropped
+	findSubImageNcc(data: Uint8ClampedArray | Uint8Array, width: number, height: number, options?: { rect?: Rectangle, scales?: number[], threshold?: number, maxresults?: number }): { x: number, y: number, width: number, height: number, scale: number, score: number }[],
+	//derived planes are computed once per frame and region (default whole frame) and cached natively
+	getDerived(plane: DerivedPlane, rect: Rectangle, region?: Rectangle): Uint16Array,
+	//sum of the plane over each x,y,w,h quad in rects, rects have to be inside region
+	sumDerived(plane: DerivedPlane, rects: Int32Array, region?: Rectangle): Float64Array,
+	release(): void
+}
+
+//rects of crop and findSubImage are relative to the image coming out of the previous stage
+//histogram and findSubImage end a chain, threshold needs a single channel image from a channel stage
+export type ImagePipelineStage = { op: "crop", rect: Rectangle }
+	| { op: "channel", channel: "r" | "g" | "b" | "a" | "gray" }
+	| { op: "threshold", value: number, invert?: boolean }
+	| { op: "downscale", factor: number }
+	| { op: "histogram" }
+	| { op: "findSubImage", data: Uint8ClampedArray | Uint8Array, width: number, height: number, rect?: Rectangle | null, tolerance?: number, maxresults?: number };
+export type ImagePipelineChain = { rect: Rectangle, stages: ImagePipelineStage[] };
+//histograms hold 256 counts per channel
+export type ImagePipelineResult = { width: number, height: number, channels: 1 | 4, data: Uint8ClampedArray } | Uint32Array | { x: number, y: number }[];
+
+//all chains are captured from the same frame in one native call, one result per chain
+export interface NativeImagePipeline {
+	run(wnd: BigInt, mode: CaptureMode): ImagePipelineResult[]
+}
+
+//index refers to the rects passed to watchRegions
+export type RegionChange = { index: number, rect: Rectangle, data: Uint8ClampedArray };
+
+//hidden is minimized, unmapped or on another workspace, obscured (fully covered) is only detected on X11 without a compositor
+export type WindowVisibility = "visible" | "obscured" | "hidden";
+
+export type NativePinConfig = { mode: "cover" } | { mode: "auto", pinhor: "left" | "right", pinver: "top" | "bot", hordist: number, verdist: number, width: number, height: number };
+
+//frames is the number of frames to wait for after the click, timeout (ms) caps that wait
+export type ClickCaptureConfig = { width?: number, height?: number, frames?: number, timeout?: number, mode?: CaptureMode };
+//x,y is the click and rect the captured area, both in client coordinates
+export type ClickCapture = { x: number, y: number, rect: Rectangle, data: Uint8ClampedArray };
+
+//frame intervals are in ms
+export type FrameStats = {
+	fps: number,
+	sinceLastFrame: number,
+	samples: number,
+	frameTime: { mean: number, min: number, p50: number, p90: number, p99: number, max: number }
+};
+
+export type WindowInfoField = "title" | "class" | "bounds" | "clientBounds" | "mapped" | "pid" | "transientFor";
+//only the requested fields are set, and only if valid is true
+export type WindowInfo = {
+	valid: boolean,
+	title?: string,
+	class?: string,
+	bounds?: Rectangle,
+	clientBounds?: Rectangle,
+	mapped?: boolean,
+	pid?: number,
+	transientFor?: BigInt
+};
+
 type windowEvents = {
 	close: () => any,
 	move: (bounds: Rectangle, phase: "start" | "moving" | "end") => any,
 	show: (wnd: BigInt, event: number) => any,
-	click: () => any
+	//capture is set when a click capture is configured for the window and succeeded
+	click: (capture?: ClickCapture) => any,
+	//only on OSNullWindow
+	activechange: (wnd: BigInt) => any,
+	visibility: (visibility: WindowVisibility) => any
 };
 
+//query info of many windows in one batch, runs off-thread
+export function queryWindows(windows: OSWindow[], fields: WindowInfoField[]) {
+	return native.queryWindowsAsync(windows.map(w => w.handle), fields);
+}
+
 export function getActiveWindow() {
 	return new OSWindow(native.getActiveWindow());
 }
@@ -66,6 +197,7 @@ export class OSWindow {
 	getTitle() { return native.getWindowTitle(this.handle); }
 	getBounds() { return native.getWindowBounds(this.handle); }
 	getClientBounds() { return native.getClientBounds(this.handle); }
+	getVisibility() { return native.getWindowVisibility(this.handle); }
 	setParent(parent: OSWindow | null) { return native.setWindowParent(this.handle, parent ? parent.handle : BigInt(0)) }
 
 	on<T extends keyof windowEvents>(type: T, cb: windowEvents[T]) {
@@ -97,6 +229,8 @@ export class OSWindowPin extends TypedEmitter<OSWindowPinEvents>{
 	wndwidth = 0;
 	wndheight = 0;
 	dockmode: "cover" | "auto";
+	//the event thread moves the window itself when the parent moves, js only needs to keep the pin rules up to date
+	nativePin = process.platform == "linux";
 	constructor(window: BrowserWindow, parent: OSWindow, dockmode: "cover" | "auto") {
 		super();
 		this.window = window;
@@ -104,8 +238,9 @@ export class OSWindowPin extends TypedEmitter<OSWindowPinEvents>{
 		this.dockmode = dockmode;
 		this.pinhor = "left";
 		this.pinver = "top";
-		this.updateDocking();
 		this.oswindow = new OSWindow(window.getNativeWindowHandle());
+		this.updateDocking();
+		this.updateNativePin();
 		native.setWindowParent(this.oswindow.handle, parent.handle);
 		this.parent.on("move", this.onmove);
 		this.parent.on("close", this.onclose);
@@ -119,6 +254,7 @@ export class OSWindowPin extends TypedEmitter<OSWindowPinEvents>{
 		this.pinver = istop ? "top" : "bot";
 		this.wndverdist = istop ? rect.top : rect.bot;
 		this.wndheight = rect.height;
+		this.updateNativePin();
 		this.synchPosition();
 	}
 	getPinRect() {
@@ -134,6 +270,9 @@ export class OSWindowPin extends TypedEmitter<OSWindowPinEvents>{
 		return r;
 	}
 	unpin() {
+		if (this.nativePin) {
+			native.setWindowPin(this.oswindow.handle, this.parent.handle, null);
+		}
 		native.setWindowParent(this.oswindow.handle, BigInt(0));
 		this.parent.removeListener("move", this.onmove);
 		this.parent.removeListener("close", this.onclose);
@@ -154,6 +293,23 @@ export class OSWindowPin extends TypedEmitter<OSWindowPinEvents>{
 			this.wndverdist = Math.min(top, bot);
 			this.wndwidth = bounds.width;
 			this.wndheight = bounds.height;
+			this.updateNativePin();
+		}
+	}
+	updateNativePin() {
+		if (!this.nativePin) { return; }
+		if (this.dockmode == "cover") {
+			native.setWindowPin(this.oswindow.handle, this.parent.handle, { mode: "cover" });
+		} else {
+			native.setWindowPin(this.oswindow.handle, this.parent.handle, {
+				mode: "auto",
+				pinhor: this.pinhor,
+				pinver: this.pinver,
+				hordist: this.wndhordist,
+				verdist: this.wndverdist,
+				width: this.wndwidth,
+				height: this.wndheight
+			});
 		}
 	}
 	synchPosition(parentbounds?: Rectangle) {
@@ -170,7 +326,9 @@ export class OSWindowPin extends TypedEmitter<OSWindowPinEvents>{
 	}
 	@boundMethod
 	onmove(bounds: Rectangle, phase: "start" | "moving" | "end") {
-		this.synchPosition(bounds);
+		if (!this.nativePin) {
+			this.synchPosition(bounds);
+		}
 		this.emit("moved");
 	}
 	@boundMethod
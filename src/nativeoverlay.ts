@@ -0,0 +1,88 @@
+import { boundMethod } from "autobind-decorator";
+import { native, OSWindow } from "./native";
+import { OverlayState } from "./overlaystate";
+import type { OverlayCommand, OverlayPrimitive, Rectangle } from "./shared";
+import { TypedEmitter } from "./typedemitter";
+
+type NativeOverlayEvents = {
+	close: []
+}
+
+//Draws the overlay api in a native X11 window instead of a transparent browser window
+export class NativeOverlay extends TypedEmitter<NativeOverlayEvents>{
+	state = new OverlayState();
+	parent: OSWindow;
+	bounds: Rectangle;
+	redrawtimer: NodeJS.Timeout | null = null;
+	shutdowntimer: NodeJS.Timeout | null = null;
+	static readonly shutdowntimeout = 30 * 1000;
+
+	constructor(parent: OSWindow) {
+		super();
+		this.parent = parent;
+		this.bounds = parent.getClientBounds();
+		this.parent.on("move", this.onmove);
+		this.parent.on("close", this.close);
+	}
+
+	command(frameid: number, commands: OverlayCommand[]) {
+		let now = Date.now();
+		this.state.parseCommands(frameid, commands, now);
+		this.redraw(now);
+	}
+
+	closeFrame(frameid: number) {
+		this.state.closeFrame(frameid);
+		this.redraw(Date.now());
+	}
+
+	@boundMethod
+	onmove(bounds: Rectangle, phase: "start" | "moving" | "end") {
+		//the move event has outer bounds, the overlay covers the client area
+		this.bounds = this.parent.getClientBounds();
+		this.redraw(Date.now(), true);
+	}
+
+	@boundMethod
+	redraw(now: number, force = false) {
+		let update = this.state.update(now);
+
+		let drawcount = 0;
+		if (force || update.changed) {
+			let primitives: OverlayPrimitive[] = [];
+			for (let g of this.state.groups) {
+				for (let prim of g.primitives) {
+					drawcount++;
+					if (prim.visible) { primitives.push(prim.action); }
+				}
+			}
+			native.drawOverlay(this.parent.handle, this.bounds, primitives);
+		}
+
+		if (drawcount == 0 && !this.shutdowntimer) {
+			this.shutdowntimer = setTimeout(this.close, NativeOverlay.shutdowntimeout);
+		}
+		if (drawcount != 0 && this.shutdowntimer) {
+			clearTimeout(this.shutdowntimer);
+			this.shutdowntimer = null;
+		}
+
+		if (this.redrawtimer) {
+			clearTimeout(this.redrawtimer);
+			this.redrawtimer = null;
+		}
+		if (isFinite(update.nextupdate)) {
+			this.redrawtimer = setTimeout(this.redraw, update.nextupdate - Date.now(), update.nextupdate);
+		}
+	}
+
+	@boundMethod
+	close() {
+		if (this.redrawtimer) { clearTimeout(this.redrawtimer); }
+		if (this.shutdowntimer) { clearTimeout(this.shutdowntimer); }
+		this.parent.removeListener("move", this.onmove);
+		this.parent.removeListener("close", this.close);
+		native.closeOverlay(this.parent.handle);
+		this.emit("close");
+	}
+}
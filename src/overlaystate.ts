@@ -0,0 +1,100 @@
+import type { OverlayCommand, OverlayPrimitive } from "./shared";
+
+type ActivePrimitive = { endtime: number, visible: boolean, deleted: boolean, action: OverlayPrimitive };
+type OverlayGroup = { name: string, frameid: number, zindex: number, frozen: boolean, primitives: ActivePrimitive[], nextupdate: number };
+type FrameState = { currentgroup: OverlayGroup; };
+
+//Group and timing state of the overlay api, shared by the overlay window and the native overlay
+export class OverlayState {
+	groups: OverlayGroup[] = [];
+	frames = new Map<number, FrameState>();
+	iszsorted = true;
+
+	findFrameState(frameid: number) {
+		let s = this.frames.get(frameid);
+		if (s) { return s; }
+		s = { currentgroup: this.findgroup(frameid, "") };
+		this.frames.set(frameid, s);
+		return s;
+	}
+
+	findgroup(frameid: number, groupid: string) {
+		let g = this.groups.find(q => q.name == groupid && q.frameid == frameid);
+		if (g) { return g; }
+		g = { name: groupid, frameid: frameid, frozen: false, zindex: 0, primitives: [], nextupdate: Infinity };
+		this.groups.push(g);
+		return g;
+	}
+
+	closeFrame(frameid: number) {
+		this.frames.delete(frameid);
+		this.groups = this.groups.filter(q => q.frameid == frameid);
+	}
+
+	parseCommands(frameid: number, commands: OverlayCommand[], now: number) {
+		let framestate = this.findFrameState(frameid);
+		let currentgroup = framestate.currentgroup;
+		for (let c of commands) {
+			if (c.command == "draw") {
+				currentgroup.primitives.push({ visible: !currentgroup.frozen, deleted: false, endtime: now + c.time, action: c.action });
+				if (!currentgroup.frozen) { currentgroup.nextupdate = 0; }
+			} else if (c.command == "setgroup") {
+				currentgroup = this.findgroup(frameid, c.groupid);
+			} else if (c.command == "cleargroup") {
+				let group = this.findgroup(frameid, c.groupid);
+				group.primitives.forEach(p => p.deleted = true);
+				if (!group.frozen) { group.nextupdate = 0; }
+			} else if (c.command == "setgroupzindex") {
+				let group = this.findgroup(frameid, c.groupid);
+				group.zindex = c.zindex;
+				this.iszsorted = false;
+				group.nextupdate = 0;
+			} else if (c.command == "freezegroup") {
+				this.findgroup(frameid, c.groupid).frozen = true;
+			} else if (c.command == "continuegroup" || c.command == "refreshgroup") {
+				let group = this.findgroup(frameid, c.groupid);
+				let oldfreeze = group.frozen;
+				group.frozen = false;
+				this.cleanGroup(group, now);
+				if (c.command == "refreshgroup") {
+					group.frozen = oldfreeze;
+				}
+				group.nextupdate = 0;
+			}
+		}
+	}
+
+	cleanGroup(g: OverlayGroup, now: number) {
+		const bonustime = (!g.frozen ? 0 : 10 * 1000);
+		let endtime = now - bonustime;
+		g.primitives = g.primitives.filter(p => (!p.deleted || g.frozen) && p.endtime > endtime);
+		//elements created during freeze
+		let nextupdate = Infinity;
+		for (let prim of g.primitives) {
+			if (!g.frozen) { prim.visible = true; }
+			nextupdate = Math.min(nextupdate, prim.endtime + bonustime);
+		}
+		g.nextupdate = nextupdate;
+	}
+
+	//expires primitives, returns whether the visible state changed and when it changes next
+	update(now: number) {
+		if (!this.iszsorted) {
+			this.groups = this.groups.sort((a, b) => a.zindex - b.zindex);
+			this.iszsorted = true;
+		}
+
+		let currentnextupdate = Infinity;
+		let newnextupdate = Infinity;
+		for (let g of this.groups) {
+			currentnextupdate = Math.min(currentnextupdate, g.nextupdate);
+			this.cleanGroup(g, now);
+			newnextupdate = Math.min(newnextupdate, g.nextupdate);
+		}
+
+		//remove obsolete groups
+		this.groups = this.groups.filter(q => q.primitives.length != 0 || q.frozen || q.zindex != 0);
+
+		return { changed: currentnextupdate <= now, nextupdate: newnextupdate };
+	}
+}
@@ -2,7 +2,7 @@ import { ImgRefData, Rect } from "alt1";
 import * as OCR from "alt1/ocr";
 import RightClickReader from "../rightclick";
 
-const chatfonts: { name: TextResult["font"], font: OCR.FontDefinition }[] = [
+export const chatfonts: { name: TextResult["font"], font: OCR.FontDefinition }[] = [
 	{ name: "10pt", font: require("alt1/fonts/chatbox/10pt.js") },
 	{ name: "12pt", font: require("alt1/fonts/chatbox/12pt.js") },
 	{ name: "14pt", font: require("alt1/fonts/chatbox/14pt.js") },
@@ -10,7 +10,7 @@ const chatfonts: { name: TextResult["font"], font: OCR.FontDefinition }[] = [
 	{ name: "18pt", font: require("alt1/fonts/chatbox/18pt.js") },
 ];
 
-type TextResult = {
+export type TextResult = {
 	type: "text",
 	font: "10pt" | "12pt" | "14pt" | "16pt" | "18pt",//larger than 18 has unreasonable perf cost
 	line: ReturnType<typeof OCR["findReadLine"]>
@@ -52,7 +52,21 @@ export const defaultcolors: OCR.ColortTriplet[] = [
 	[215, 195, 119] //interface preset color
 ];
 
-export function readAnything(img: ImageData, x: number, y: number) {
+//reads chat text in the given color at x,y, tries the chatfonts in order
+export type ChatTextReader = (img: ImageData, col: OCR.ColortTriplet, x: number, y: number) => TextResult | null;
+
+export function readChatText(img: ImageData, col: OCR.ColortTriplet, x: number, y: number) {
+	for (let font of chatfonts) {
+		let text11pt = OCR.findReadLine(img, font.font, [col], x, y);
+		let m = text11pt.text.match(/\w/g);
+		//match at least 3 word characters efore we accept it
+		if (m && m.length >= 3)
+			return { type: "text", font: font.name, line: text11pt } as TextResult;
+	}
+	return null;
+}
+
+export function readAnything(img: ImageData, x: number, y: number, readText: ChatTextReader = readChatText) {
 	let reader = new RightClickReader();
 	if (reader.find(new ImgRefData(img))) {
 		let menu = reader.read(img);
@@ -61,13 +75,8 @@ export function readAnything(img: ImageData, x: number, y: number) {
 
 	let col = OCR.getChatColor(img, new Rect(x - 10, y - 7, 20, 7), defaultcolors);
 	if (col) {
-		for (let font of chatfonts) {
-			let text11pt = OCR.findReadLine(img, font.font, [col], x, y);
-			let m = text11pt.text.match(/\w/g);
-			//match at least 3 word characters efore we accept it
-			if (m && m.length >= 3)
-				return { type: "text", font: font.name, line: text11pt } as TextResult;
-		}
+		let text = readText(img, col, x, y);
+		if (text) { return text; }
 	}
 
 	//TODO other fonts
@@ -0,0 +1,21 @@
+import * as OCR from "alt1/ocr";
+import { native } from "../../native";
+import { chatfonts, TextResult } from ".";
+
+//font handles in the native addon, fonts only have to be converted once
+let fonthandles: number[] | null = null;
+
+//same as readChatText but runs the glyph matching in the native addon, all fonts are read in parallel
+export function readChatTextNative(img: ImageData, col: OCR.ColortTriplet, x: number, y: number) {
+	if (!fonthandles) {
+		fonthandles = chatfonts.map(f => native.loadFont(f.font));
+	}
+	let lines = native.findReadLine(img.data, img.width, img.height, fonthandles, [col], x, y);
+	for (let i = 0; i < lines.length; i++) {
+		let m = lines[i].text.match(/\w/g);
+		//match at least 3 word characters efore we accept it
+		if (m && m.length >= 3)
+			return { type: "text", font: chatfonts[i].name, line: lines[i] } as TextResult;
+	}
+	return null;
+}
@@ -2,7 +2,7 @@ import { app, BrowserWindow } from "electron";
 import * as electron from "electron";
 import * as path from "path";
 import { delay } from "./lib";
-import { OSWindow, native, OSWindowPin, OSNullWindow } from "./native";
+import { OSWindow, native, OSWindowPin, OSNullWindow, RegionChange, ClickCapture, WindowVisibility } from "./native";
 import { OverlayCommand } from "./shared";
 import { TypedEmitter } from "./typedemitter";
 import { boundMethod } from "autobind-decorator";
@@ -10,20 +10,30 @@ import { AppPermission, settings } from "./settings";
 import { openApp, managedWindows, selectAppContexts } from "./main";
 import { Alt1EventType, ImgRef, ImgRefData, PointLike, Rect, RectLike } from "alt1";
 import { readAnything } from "./readers/alt1reader";
+import { readChatTextNative } from "./readers/alt1reader/native";
+import { NativeOverlay } from "./nativeoverlay";
 import RightClickReader from "./readers/rightclick";
 
 
 export var rsInstances: RsInstance[] = [];
 
 const newRsWindow = (handle) => new RsInstance(new OSWindow(handle));
+const activeWindowChanged = (handle: BigInt) => {
+	for (let inst of rsInstances) {
+		inst.setActive(inst.window.handle == handle);
+	}
+}
 
 export function initRsInstanceTracking() {
 	detectInstances();
 	OSNullWindow.on("show", newRsWindow);
+	OSNullWindow.on("activechange", activeWindowChanged);
+	activeWindowChanged(native.getActiveWindow());
 };
 
 export function stopRsInstanceTracking() {
 	OSNullWindow.removeListener("show", newRsWindow);
+	OSNullWindow.removeListener("activechange", activeWindowChanged);
 }
 
 export function detectInstances() {
@@ -54,7 +64,8 @@ export function getRsInstanceFromWnd(wnd: OSWindow) {
 }
 
 type RsInstanceEvents = {
-	close: []
+	close: [],
+	visibility: [WindowVisibility]
 }
 
 
@@ -112,16 +123,33 @@ class ActiveRightclick {
 export class RsInstance extends TypedEmitter<RsInstanceEvents>{
 	window: OSWindow;
 	overlayWindow: { browser: BrowserWindow, pin: OSWindowPin | null, stalledOverlay: { frameid: number, cmd: OverlayCommand[] }[] } | null;
+	nativeOverlay: NativeOverlay | null = null;
+	frameTracking = false;
+	regionWatches = new Set<number>();
 	activeRightclick: ActiveRightclick | null = null;
 	isActive = false;
 	lastActiveTime = 0;
+	//on linux captures of a hidden client are skipped natively while this is tracked
+	visibility: WindowVisibility = "visible";
 
 	constructor(rswindow: OSWindow) {
 		super();
 		this.window = rswindow;
 		this.window.on("close", this.close);
 		this.window.on("click", this.clientClicked);
+		this.window.on("visibility", this.visibilityChanged);
+		this.visibility = this.window.getVisibility();
 		this.overlayWindow = null;
+		this.isActive = native.getActiveWindow() == this.window.handle;
+		if (process.platform == "linux") {
+			try {
+				native.startFrameTracking(this.window.handle);
+				this.frameTracking = true;
+			} catch (e) {
+				console.log("frame tracking not available", e);
+			}
+			this.updateClickCapture();
+		}
 
 		for (let app of settings.bookmarks) {
 			if (app.wasOpen) {
@@ -139,6 +167,18 @@ export class RsInstance extends TypedEmitter<RsInstanceEvents>{
 		rsInstances.splice(rsInstances.indexOf(this), 1);
 		this.window.removeListener("close", this.close);
 		this.window.removeListener("click", this.clientClicked);
+		this.window.removeListener("visibility", this.visibilityChanged);
+		if (process.platform == "linux") {
+			native.setClickCapture(this.window.handle, null);
+		}
+		for (let id of this.regionWatches) {
+			native.unwatchRegions(id);
+		}
+		this.regionWatches.clear();
+		if (this.frameTracking) {
+			native.stopFrameTracking(this.window.handle);
+			this.frameTracking = false;
+		}
 		this.emit("close");
 		console.log(`stopped tracking rs client with handle: ${this.window.handle}`);
 	}
@@ -150,23 +190,31 @@ export class RsInstance extends TypedEmitter<RsInstanceEvents>{
 	}
 
 	@boundMethod
-	async clientClicked() {
+	async clientClicked(clickcapture?: ClickCapture) {
 		this.lastActiveTime = Date.now();
 		if (this.activeRightclick) {
 			this.activeRightclick.close();
 		}
 		//TODO actually check if it is a rightclick
 		if (true) {
-			//need to wait for 2 frames to get rendered (doublebuffered)
-			await delay(2 * 50);
-			let mousepos = this.screenToClient(electron.screen.getCursorScreenPoint());
-			let captrect = new Rect(mousepos.x - 300, mousepos.y - 300, 600, 600);
-			captrect.intersect({ x: 0, y: 0, ...this.getClientSize() });
-			if (captrect.width <= 0 || captrect.height <= 0) {
-				console.log("tried to capture 0 size area around mouse click");
-				return;
+			let captrect: Rect;
+			let capt: ImageData;
+			if (clickcapture) {
+				//already captured natively after the click was rendered
+				captrect = new Rect(clickcapture.rect.x, clickcapture.rect.y, clickcapture.rect.width, clickcapture.rect.height);
+				capt = new ImageData(clickcapture.data, captrect.width, captrect.height);
+			} else {
+				//need to wait for 2 frames to get rendered (doublebuffered)
+				await delay(2 * 50);
+				let mousepos = this.screenToClient(electron.screen.getCursorScreenPoint());
+				captrect = new Rect(mousepos.x - 300, mousepos.y - 300, 600, 600);
+				captrect.intersect({ x: 0, y: 0, ...this.getClientSize() });
+				if (captrect.width <= 0 || captrect.height <= 0) {
+					console.log("tried to capture 0 size area around mouse click");
+					return;
+				}
+				capt = this.capture(captrect);
 			}
-			let capt = this.capture(captrect);
 			let reader = new RightClickReader();
 			let img = new ImgRefData(capt, 0, 0);
 			if (reader.find(img)) {
@@ -185,6 +233,19 @@ export class RsInstance extends TypedEmitter<RsInstanceEvents>{
 		}
 	}
 
+	//capture the area around clicks natively once the client rendered the result, for rightclick menu detection
+	updateClickCapture() {
+		if (process.platform == "linux") {
+			native.setClickCapture(this.window.handle, { width: 600, height: 600, frames: 2, timeout: 2 * 50, mode: settings.captureMode });
+		}
+	}
+
+	@boundMethod
+	visibilityChanged(visibility: WindowVisibility) {
+		this.visibility = visibility;
+		this.emit("visibility", visibility);
+	}
+
 	setActive(active: boolean) {
 		if (active != this.isActive) {
 			this.isActive = active;
@@ -219,6 +280,39 @@ export class RsInstance extends TypedEmitter<RsInstanceEvents>{
 		return new ImageData(capt.main, rect.width, rect.height);
 	}
 
+	//snapshot of the whole client that several readers can share without copying it to js
+	captureFrame() {
+		return native.captureFrame(this.window.handle, settings.captureMode);
+	}
+
+	//batched with other async captures of this client, maxdelay is how long (ms) the request may wait for others to join,
+	//a request without others pending for this client is captured right away
+	captureAsync<T extends { [key: string]: RectLike | undefined | null }>(rects: T, priority = 0, maxdelay = 5) {
+		return native.captureScheduled(this.window.handle, settings.captureMode, rects, priority, maxdelay);
+	}
+
+	//points are x,y pairs in client coordinates, returns one rgba pixel (in memory byte order) per point, 0 outside the client area
+	samplePixels(points: Int32Array) {
+		return native.samplePixels(this.window.handle, settings.captureMode, points);
+	}
+
+	//calls cb with the rects whose contents changed, checked every interval ms (and only after a new frame where this is known)
+	//returns a function that stops the watch
+	watchRegions(rects: RectLike[], interval: number, cb: (changes: RegionChange[]) => void) {
+		let id = native.watchRegions(this.window.handle, settings.captureMode, rects.map(r => ({ x: r.x, y: r.y, width: r.width, height: r.height })), interval, cb);
+		this.regionWatches.add(id);
+		return () => {
+			if (this.regionWatches.delete(id)) {
+				native.unwatchRegions(id);
+			}
+		};
+	}
+
+	//rolling fps and frame time distribution of the client, null when not measured on this platform
+	getFrameStats() {
+		return (this.frameTracking ? native.getFrameStats(this.window.handle) : null);
+	}
+
 	alt1Pressed() {
 		let mousescreen = electron.screen.getCursorScreenPoint();
 		let mousepos = this.screenToClient(mousescreen);
@@ -226,7 +320,7 @@ export class RsInstance extends TypedEmitter<RsInstanceEvents>{
 		captrect.intersect({ x: 0, y: 0, ...this.getClientSize() });
 		if (!captrect.containsPoint(mousepos.x, mousepos.y)) { throw new Error("alt+1 pressed outside client"); }
 		let img = this.capture(captrect);
-		let res = readAnything(img, mousepos.x - captrect.x, mousepos.y - captrect.y);
+		let res = readAnything(img, mousepos.x - captrect.x, mousepos.y - captrect.y, readChatTextNative);
 		if (res?.type == "text") {
 			let str = res.line.text;
 			console.log("text " + res.font + ": " + str);
@@ -249,6 +343,24 @@ export class RsInstance extends TypedEmitter<RsInstanceEvents>{
 	}
 
 	overlayCommands(frameid: number, commands: OverlayCommand[]) {
+		if (process.platform == "linux" && settings.nativeOverlay && !this.overlayWindow) {
+			try {
+				if (!this.nativeOverlay) {
+					let overlay = new NativeOverlay(this.window);
+					overlay.once("close", () => {
+						this.nativeOverlay = null;
+						console.log("native overlay closed");
+					});
+					this.nativeOverlay = overlay;
+				}
+				this.nativeOverlay.command(frameid, commands);
+				return;
+			} catch (e) {
+				//no compositor or 32 bit visual, use the overlay window instead
+				console.log("native overlay failed, falling back to overlay window", e);
+				this.nativeOverlay?.close();
+			}
+		}
 		if (!this.overlayWindow) {
 			console.log("opening overlay");
 			let bounds = this.window.getClientBounds();
@@ -44,6 +44,8 @@ var checkBookmark = Checks.obj({
 
 var checkSettings = Checks.obj({
 	captureMode: Checks.strenum<CaptureMode>({ desktop: "Desktop", opengl: "OpenGL", window: "Window" }, "window"),
+	//draw the overlay api in a native X11 window instead of a transparent browser window, linux only
+	nativeOverlay: Checks.bool(),
 	bookmarks: Checks.arr(checkBookmark)
 });
 
@@ -106,6 +108,15 @@ class ManagedSettings extends TypedEmitter<SettingsEvents> {
 		this.emit("changed");
 	}
 
+	get nativeOverlay() {
+		return this.settings.nativeOverlay;
+	}
+
+	set nativeOverlay(enabled: boolean) {
+		this.settings.nativeOverlay = enabled;
+		this.emit("changed");
+	}
+
 	/**
 	 * Emit the "changed" event on AppConfig if the contents of this array are modified.
 	 */
@@ -1,4 +1,4 @@
-import { CaptureMode } from "./native";
+import { CaptureMode, WindowVisibility } from "./native";
 
 export type FlatImageData = { data: Uint8ClampedArray, width: number, height: number };
 export type SyncResponse<T> = { error: string } | { error: undefined, value: T };
@@ -9,7 +9,8 @@ export type RsClientState = {
 	lastActiveTime: number,
 	ping: number,
 	scaling: number,
-	captureMode: CaptureMode
+	captureMode: CaptureMode,
+	visibility: WindowVisibility
 }
 
 